@@ -0,0 +1,445 @@
+//***************************************************************************************
+// CastleBench.cpp
+//
+// Headless benchmark for the procedural castle in CastleLayout.h.  Like GeometryBench
+// it needs no window or GPU, only "lab assignment 1/CastleLayout.cpp", and prints one
+// JSON document to stdout.
+//
+// Windows: build CastleBench.vcxproj from the solution.
+// Linux: put DirectXMath's Inc directory and a sal.h on the include path (see
+// WaveBench.cpp), then from the repository root:
+//
+//   g++ -std=c++14 -O2 -I<DirectXMath>/Inc -I<dir with sal.h> -o castlebench
+//       CastleBench/CastleBench.cpp "lab assignment 1/CastleLayout.cpp"
+//
+// Usage: castlebench [--min-time seconds]
+//        castlebench --check
+//
+// Every iteration lays the whole castle out again into the same CastleLayout, as a
+// level editor would while a slider moves, so after the warm-up no iteration allocates.
+// instance_mb is the size of the per-instance stream the castle is drawn from, and
+// world_matrix_mb what one 4x4 world matrix per piece would take instead; draws is the
+// number of instanced draws, against one draw per piece as separate render items.
+//
+// --check runs the correctness checks instead, prints one line per check, reports
+// every failure on stderr and exits non-zero if any check failed.
+//***************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include "../lab assignment 1/CastleLayout.h"
+
+namespace
+{
+	struct Options
+	{
+		double MinTime = 0.5;
+		bool Check = false;
+	};
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for(int a = 1; a < argc; ++a)
+		{
+			if(std::strcmp(argv[a], "--check") == 0)
+				options.Check = true;
+			else if(a + 1 < argc && std::strcmp(argv[a], "--min-time") == 0)
+				options.MinTime = std::atof(argv[++a]);
+			else
+				return false;
+		}
+
+		return true;
+	}
+
+	// Mean nanoseconds per call of body, after one warm-up call.
+	double TimeIterations(double minTime, const std::function<void()>& body)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		body();
+
+		int iterations = 0;
+		const Clock::time_point start = Clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			body();
+			++iterations;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while(elapsed < minTime || iterations < 3);
+
+		return elapsed*1e9 / iterations;
+	}
+
+	class JsonWriter
+	{
+	public:
+		void Begin(const char* workload, const char* params)
+		{
+			std::printf("%s\n    { \"workload\": \"%s\", \"params\": \"%s\"",
+				mFirst ? "" : ",", workload, params);
+			mFirst = false;
+		}
+
+		void Field(const char* name, double value)
+		{
+			std::printf(", \"%s\": %.6g", name, value);
+		}
+
+		void End()
+		{
+			std::printf(" }");
+			std::fflush(stdout);
+		}
+
+	private:
+		bool mFirst = true;
+	};
+
+	void BenchLayout(JsonWriter& json, double minTime, const char* workload, const char* params,
+		const CastleParams& castle)
+	{
+		CastleLayout layout;
+		const double ns = TimeIterations(minTime, [&]() { BuildCastleLayout(castle, layout); });
+
+		const double instanceCount = (double)layout.Instances.size();
+
+		int draws = 0;
+		for(int p = 0; p < (int)CastlePiece::Count; ++p)
+			draws += layout.Pieces[p].Count != 0 ? 1 : 0;
+
+		json.Begin(workload, params);
+		json.Field("instances", instanceCount);
+		json.Field("walls", layout.Pieces[(int)CastlePiece::Wall].Count);
+		json.Field("merlons", layout.Pieces[(int)CastlePiece::Merlon].Count);
+		json.Field("towers", layout.Pieces[(int)CastlePiece::Tower].Count);
+		json.Field("roofs", layout.Pieces[(int)CastlePiece::Roof].Count);
+		json.Field("finials", layout.Pieces[(int)CastlePiece::Finial].Count);
+		json.Field("ms_per_layout", ns*1e-6);
+		json.Field("ns_per_instance", ns / instanceCount);
+		json.Field("instance_mb", instanceCount*sizeof(CastleInstance) / (1024.0*1024.0));
+		json.Field("world_matrix_mb", instanceCount*sizeof(DirectX::XMFLOAT4X4) / (1024.0*1024.0));
+		json.Field("draws", draws);
+		json.Field("draws_as_render_items", instanceCount);
+		json.End();
+	}
+
+	// A castle of perimeter with towerCount towers, merlons every spacing and walls cut
+	// into blocks of blockLength.
+	CastleParams MakeCastle(float perimeter, int towerCount, float spacing, float blockLength)
+	{
+		CastleParams castle;
+		castle.Perimeter = perimeter;
+		castle.TowerCount = towerCount;
+		castle.CrenellationSpacing = spacing;
+		castle.WallBlockLength = blockLength;
+		return castle;
+	}
+
+	// Results of --check.  Failures go to stderr as they happen (the first few of each
+	// check, so one broken loop cannot bury the rest), and a summary line per check to
+	// stdout.
+	class CheckReport
+	{
+	public:
+		void Begin(const char* name)
+		{
+			mName = name;
+			mCheckFailures = 0;
+		}
+
+		// Counts a failure unless condition holds; format and the rest are printf-style.
+		bool Expect(bool condition, const char* format, ...)
+		{
+			if(condition)
+				return true;
+
+			if(mCheckFailures++ < 8)
+			{
+				std::fprintf(stderr, "FAILED %s: ", mName);
+				va_list args;
+				va_start(args, format);
+				std::vfprintf(stderr, format, args);
+				va_end(args);
+				std::fprintf(stderr, "\n");
+			}
+
+			++mFailures;
+			return false;
+		}
+
+		void End()
+		{
+			std::printf("%-20s %s\n", mName, mCheckFailures == 0 ? "ok" : "FAILED");
+			std::fflush(stdout);
+		}
+
+		int Failures()const { return mFailures; }
+
+	private:
+		const char* mName = "";
+		int mCheckFailures = 0;
+		int mFailures = 0;
+	};
+
+	bool Near(float a, float b)
+	{
+		return std::fabs(a - b) <= 1e-4f + 1e-5f*std::max(std::fabs(a), std::fabs(b));
+	}
+
+	bool Near(const DirectX::XMFLOAT3& a, float x, float y, float z)
+	{
+		return Near(a.x, x) && Near(a.y, y) && Near(a.z, z);
+	}
+
+	// The default parameters give the castle the demo drew before it was generated: a
+	// 50 x 50 square of walls 15 high with 18.5 high towers on the corners, three
+	// merlons per wall and a 15 wide, 10.5 high gate in the wall facing -z.
+	void CheckDefaultCastle(CheckReport& report)
+	{
+		report.Begin("castle_default");
+
+		CastleLayout layout;
+		BuildCastleLayout(CastleParams(), layout);
+
+		const std::uint32_t expected[(int)CastlePiece::Count] = { 6, 12, 4, 4, 4 };
+		for(int p = 0; p < (int)CastlePiece::Count; ++p)
+			report.Expect(layout.Pieces[p].Count == expected[p], "piece %d: %u instances, expected %u", p, layout.Pieces[p].Count, expected[p]);
+		if(report.Failures() != 0)
+		{
+			report.End();
+			return;
+		}
+
+		const CastleInstance* walls = &layout.Instances[layout.Pieces[(int)CastlePiece::Wall].Start];
+		const CastleInstance* merlons = &layout.Instances[layout.Pieces[(int)CastlePiece::Merlon].Start];
+
+		// The gate wall: the stretches either side of the opening, then the lintel.
+		report.Expect(Near(walls[0].Position, -16.25f, 7.5f, -25.0f) && Near(walls[0].Scale, 17.5f, 15.0f, 2.25f),
+			"the left gate stretch is off");
+		report.Expect(Near(walls[1].Position, 16.25f, 7.5f, -25.0f) && Near(walls[1].Scale, 17.5f, 15.0f, 2.25f),
+			"the right gate stretch is off");
+		report.Expect(Near(walls[2].Position, 0.0f, 12.75f, -25.0f) && Near(walls[2].Scale, 15.0f, 4.5f, 2.25f),
+			"the lintel is off");
+
+		// The other three walls in one block each, running counterclockwise seen from above.
+		const float wallCentres[3][2] = { { 25.0f, 0.0f }, { 0.0f, 25.0f }, { -25.0f, 0.0f } };
+		for(int w = 0; w < 3; ++w)
+		{
+			report.Expect(Near(walls[3 + w].Position, wallCentres[w][0], 7.5f, wallCentres[w][1]) &&
+				Near(walls[3 + w].Scale, 50.0f, 15.0f, 2.25f), "wall %d is off", 3 + w);
+		}
+
+		// Three merlons per wall, 15 apart and centred on it, on top of the wall.
+		for(int m = 0; m < 12; ++m)
+		{
+			const float t = -15.0f + 15.0f*(m % 3);
+			const float sideX[4] = { t, 25.0f, -t, -25.0f };
+			const float sideZ[4] = { -25.0f, t, 25.0f, -t };
+			report.Expect(Near(merlons[m].Position, sideX[m / 3], 16.25f, sideZ[m / 3]) && Near(merlons[m].Scale, 7.5f, 2.5f, 2.25f),
+				"merlon %d at (%g, %g, %g)", m, merlons[m].Position.x, merlons[m].Position.y, merlons[m].Position.z);
+		}
+
+		// Towers on the corners, each with its roof and finial.
+		const float cornerX[4] = { -25.0f, 25.0f, 25.0f, -25.0f };
+		const float cornerZ[4] = { -25.0f, -25.0f, 25.0f, 25.0f };
+		const float heights[3] = { 9.25f, 21.0f, 24.0f };
+		const float scales[3][3] = { { 5.0f, 18.5f, 5.0f }, { 5.0f, 5.0f, 5.0f }, { 1.0f, 1.0f, 1.0f } };
+		for(int piece = 0; piece < 3; ++piece)
+		{
+			const CastlePieceRange& range = layout.Pieces[(int)CastlePiece::Tower + piece];
+			for(int k = 0; k < 4; ++k)
+			{
+				const CastleInstance& instance = layout.Instances[range.Start + k];
+				report.Expect(Near(instance.Position, cornerX[k], heights[piece], cornerZ[k]) &&
+					Near(instance.Scale, scales[piece][0], scales[piece][1], scales[piece][2]),
+					"piece %d on corner %d is off", (int)CastlePiece::Tower + piece, k);
+			}
+		}
+
+		report.End();
+	}
+
+	// What holds for every layout: ranges tile the instances in piece order with the
+	// counts the parameters ask for, pieces stand on the ground, walls fill every side
+	// but the gate in blocks no longer than asked, towers stand on one circle, and
+	// each range's bounds are exactly the box around its turned pieces.
+	void CheckLayout(CheckReport& report, const char* name, const CastleParams& params)
+	{
+		CastleLayout layout;
+		BuildCastleLayout(params, layout);
+
+		std::uint32_t next = 0;
+		for(int p = 0; p < (int)CastlePiece::Count; ++p)
+		{
+			report.Expect(layout.Pieces[p].Start == next, "%s: piece %d starts at %u, expected %u", name, p, layout.Pieces[p].Start, next);
+			next = layout.Pieces[p].Start + layout.Pieces[p].Count;
+		}
+		if(!report.Expect(next == layout.Instances.size(), "%s: ranges cover %u of %d instances", name, next, (int)layout.Instances.size()))
+			return;
+
+		const std::uint32_t towers = (std::uint32_t)params.TowerCount;
+		const bool roofs = params.RoofHeight > 0.0f;
+		report.Expect(layout.Pieces[(int)CastlePiece::Tower].Count == towers, "%s: wrong tower count", name);
+		report.Expect(layout.Pieces[(int)CastlePiece::Roof].Count == (roofs ? towers : 0), "%s: wrong roof count", name);
+		report.Expect(layout.Pieces[(int)CastlePiece::Finial].Count == (roofs && params.FinialRadius > 0.0f ? towers : 0),
+			"%s: wrong finial count", name);
+		report.Expect((layout.Pieces[(int)CastlePiece::Merlon].Count == 0) == (params.CrenellationSpacing <= 0.0f),
+			"%s: merlons do not follow the crenellation spacing", name);
+
+		// Towers on the circle through the polygon's corners.
+		const float sideLength = params.Perimeter / params.TowerCount;
+		const float circumradius = 0.5f*sideLength / std::sin(DirectX::XM_PI / params.TowerCount);
+		const CastlePieceRange& towerRange = layout.Pieces[(int)CastlePiece::Tower];
+		for(std::uint32_t i = towerRange.Start; i < towerRange.Start + towerRange.Count; ++i)
+		{
+			const DirectX::XMFLOAT3& p = layout.Instances[i].Position;
+			report.Expect(Near(std::sqrt(p.x*p.x + p.z*p.z), circumradius), "%s: tower %u is off the circle", name, i - towerRange.Start);
+		}
+
+		// The blocks standing on the ground run the whole perimeter except the gate.
+		const bool gate = params.GateWidth > 0.0f && params.GateHeight > 0.0f &&
+			params.GateWidth < sideLength - 2.0f*params.TowerRadius;
+		double groundLength = 0.0;
+		const CastlePieceRange& wallRange = layout.Pieces[(int)CastlePiece::Wall];
+		for(std::uint32_t i = wallRange.Start; i < wallRange.Start + wallRange.Count; ++i)
+		{
+			const CastleInstance& wall = layout.Instances[i];
+			if(Near(wall.Position.y - 0.5f*wall.Scale.y, 0.0f))
+				groundLength += wall.Scale.x;
+			if(params.WallBlockLength > 0.0f)
+				report.Expect(wall.Scale.x <= params.WallBlockLength*(1.0f + 1e-5f), "%s: a %g long block", name, wall.Scale.x);
+		}
+		const double expectedLength = params.Perimeter - (gate ? params.GateWidth : 0.0f);
+		report.Expect(std::fabs(groundLength - expectedLength) <= 1e-4*expectedLength, "%s: walls run %g, expected %g",
+			name, groundLength, expectedLength);
+
+		for(int p = 0; p < (int)CastlePiece::Count; ++p)
+		{
+			const CastlePieceRange& range = layout.Pieces[p];
+			if(range.Count == 0)
+				continue;
+
+			float lo[3] = { 1e30f, 1e30f, 1e30f };
+			float hi[3] = { -1e30f, -1e30f, -1e30f };
+			float maxScale = 0.0f;
+
+			for(std::uint32_t i = range.Start; i < range.Start + range.Count; ++i)
+			{
+				const CastleInstance& instance = layout.Instances[i];
+				report.Expect(instance.Scale.x > 0.0f && instance.Scale.y > 0.0f && instance.Scale.z > 0.0f,
+					"%s: piece %d instance %u has an empty scale", name, p, i);
+				report.Expect(instance.Position.y - 0.5f*instance.Scale.y >= -1e-4f, "%s: piece %d instance %u is below ground", name, p, i);
+
+				// The corners of the turned unit cube, as CastleInstanceWorld places them.
+				const float c = std::cos(instance.RotationY);
+				const float s = std::sin(instance.RotationY);
+				for(int corner = 0; corner < 8; ++corner)
+				{
+					const float x = ((corner & 1) ? 0.5f : -0.5f)*instance.Scale.x;
+					const float y = ((corner & 2) ? 0.5f : -0.5f)*instance.Scale.y;
+					const float z = ((corner & 4) ? 0.5f : -0.5f)*instance.Scale.z;
+					const float world[3] = { instance.Position.x + x*c + z*s, instance.Position.y + y, instance.Position.z - x*s + z*c };
+					for(int a = 0; a < 3; ++a)
+					{
+						lo[a] = std::min(lo[a], world[a]);
+						hi[a] = std::max(hi[a], world[a]);
+					}
+				}
+
+				maxScale = std::max(maxScale, std::max(std::max(instance.Scale.x, instance.Scale.y), instance.Scale.z));
+			}
+
+			const DirectX::BoundingBox& box = range.Bounds;
+			report.Expect(Near(box.Center, 0.5f*(lo[0] + hi[0]), 0.5f*(lo[1] + hi[1]), 0.5f*(lo[2] + hi[2])) &&
+				Near(box.Extents, 0.5f*(hi[0] - lo[0]), 0.5f*(hi[1] - lo[1]), 0.5f*(hi[2] - lo[2])),
+				"%s: piece %d bounds (%g, %g, %g) +- (%g, %g, %g) are not the box around its pieces", name, p,
+				box.Center.x, box.Center.y, box.Center.z, box.Extents.x, box.Extents.y, box.Extents.z);
+			report.Expect(range.MaxScale == maxScale, "%s: piece %d MaxScale %g, expected %g", name, p, range.MaxScale, maxScale);
+		}
+
+		// Laying out the same castle again reuses the instance array.
+		const CastleInstance* data = layout.Instances.data();
+		BuildCastleLayout(params, layout);
+		report.Expect(layout.Instances.data() == data, "%s: a second layout reallocated", name);
+	}
+
+	void CheckLayouts(CheckReport& report)
+	{
+		report.Begin("castle_layouts");
+
+		CheckLayout(report, "default", CastleParams());
+		CheckLayout(report, "town", MakeCastle(4000.0f, 32, 4.0f, 20.0f));
+		CheckLayout(report, "triangle", MakeCastle(150.0f, 3, 6.0f, 7.0f));
+		CheckLayout(report, "heptagon", MakeCastle(700.0f, 7, 9.0f, 0.0f));
+
+		CastleParams bare = MakeCastle(300.0f, 5, 0.0f, 25.0f);
+		bare.GateWidth = 0.0f;
+		bare.RoofHeight = 0.0f;
+		CheckLayout(report, "bare", bare);
+
+		CastleParams tallGate;
+		tallGate.GateHeight = 20.0f;
+		tallGate.FinialRadius = 0.0f;
+		CheckLayout(report, "tall gate", tallGate);
+
+		CastleParams wideGate;
+		wideGate.GateWidth = 48.0f;
+		CheckLayout(report, "gate wider than the wall", wideGate);
+
+		report.End();
+	}
+
+	int RunChecks()
+	{
+		CheckReport report;
+		CheckDefaultCastle(report);
+		CheckLayouts(report);
+		return report.Failures() == 0 ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: %s [--min-time seconds]\n"
+			"       %s --check\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	if(options.Check)
+		return RunChecks();
+
+	const double minTime = options.MinTime;
+
+	std::printf("{\n  \"hardware_threads\": %u,\n  \"min_time_s\": %g,\n  \"results\": [",
+		std::thread::hardware_concurrency(), minTime);
+
+	JsonWriter json;
+
+	// The castle the demo draws.
+	BenchLayout(json, minTime, "castle_default", "perimeter 200, 4 towers", CastleParams());
+
+	// Ever larger curtain walls, up to about a million pieces.
+	BenchLayout(json, minTime, "castle_town", "perimeter 4000, 32 towers, merlons every 4",
+		MakeCastle(4000.0f, 32, 4.0f, 20.0f));
+	BenchLayout(json, minTime, "castle_city", "perimeter 40000, 256 towers, merlons every 4",
+		MakeCastle(40000.0f, 256, 4.0f, 20.0f));
+	BenchLayout(json, minTime, "castle_wall", "perimeter 400000, 1024 towers, merlons every 4",
+		MakeCastle(400000.0f, 1024, 4.0f, 20.0f));
+	BenchLayout(json, minTime, "castle_frontier", "perimeter 4000000, 4096 towers, merlons every 4",
+		MakeCastle(4000000.0f, 4096, 4.0f, 20.0f));
+
+	std::printf("\n  ]\n}\n");
+	return 0;
+}
@@ -4,9 +4,118 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include "TaskScheduler.h"
 
 using namespace DirectX;
 
+namespace
+{
+	// cosf/sinf of i*step for i in [0, count].  Generators compute the angles of a ring
+	// once and reuse them for every stack, instead of calling cosf/sinf per vertex.
+	void BuildSinCosTable(GeometryGenerator::uint32 count, float step,
+		std::vector<float>& cosines, std::vector<float>& sines)
+	{
+		cosines.resize(count + 1);
+		sines.resize(count + 1);
+
+		for(GeometryGenerator::uint32 i = 0; i <= count; ++i)
+		{
+			cosines[i] = cosf(i*step);
+			sines[i] = sinf(i*step);
+		}
+	}
+
+	// Rows per task when grid generation is split across threads; roughly 16k
+	// vertices, enough to amortize the scheduling.
+	GeometryGenerator::uint32 GridRowsPerTask(GeometryGenerator::uint32 n)
+	{
+		return std::max<GeometryGenerator::uint32>(16384 / std::max<GeometryGenerator::uint32>(n, 1), 1);
+	}
+
+	// body(first, last) over [begin, end), on the scheduler if there is one.
+	void ForEachRowRange(TaskScheduler* scheduler, GeometryGenerator::uint32 begin, GeometryGenerator::uint32 end,
+		GeometryGenerator::uint32 grain, const std::function<void(GeometryGenerator::uint32, GeometryGenerator::uint32)>& body)
+	{
+		if(scheduler == nullptr)
+		{
+			body(begin, end);
+			return;
+		}
+
+		scheduler->ParallelFor((int)begin, (int)end, (int)grain, [&](int first, int last)
+		{
+			body((GeometryGenerator::uint32)first, (GeometryGenerator::uint32)last);
+		});
+	}
+
+	// Marks a free slot in EdgeMidpointMap; no edge joins vertex 0xffffffff to itself.
+	const std::uint64_t EmptyEdgeKey = ~0ull;
+
+	// Edge -> midpoint vertex index, for Subdivide.  Open addressing with linear
+	// probing in a table sized once for the worst case (no shared edges) at a load
+	// factor of at most one half, so it never rehashes.
+	class EdgeMidpointMap
+	{
+	public:
+		explicit EdgeMidpointMap(GeometryGenerator::uint32 maxEdges)
+		{
+			size_t capacity = 16;
+			while(capacity < 2*(size_t)maxEdges)
+				capacity *= 2;
+
+			mKeys.assign(capacity, EmptyEdgeKey);
+			mValues.resize(capacity);
+			mMask = capacity - 1;
+		}
+
+		// Index of the midpoint of edge (a, b) in either direction.  A new edge gets
+		// baseVertex + (edges seen so far) and its end points appended to edgeEnds.
+		GeometryGenerator::uint32 Insert(GeometryGenerator::uint32 a, GeometryGenerator::uint32 b,
+			GeometryGenerator::uint32 baseVertex, std::vector<GeometryGenerator::uint32>& edgeEnds)
+		{
+			if(b < a)
+				std::swap(a, b);
+
+			const std::uint64_t key = ((std::uint64_t)a << 32) | b;
+
+			// Fibonacci hashing spreads the (small, sequential) indices over the table.
+			size_t slot = (size_t)((key*0x9E3779B97F4A7C15ull) >> 32) & mMask;
+			while(mKeys[slot] != EmptyEdgeKey)
+			{
+				if(mKeys[slot] == key)
+					return mValues[slot];
+				slot = (slot + 1) & mMask;
+			}
+
+			const GeometryGenerator::uint32 index = baseVertex + (GeometryGenerator::uint32)(edgeEnds.size()/2);
+			mKeys[slot] = key;
+			mValues[slot] = index;
+			edgeEnds.push_back(a);
+			edgeEnds.push_back(b);
+
+			return index;
+		}
+
+	private:
+		std::vector<std::uint64_t> mKeys;
+		std::vector<GeometryGenerator::uint32> mValues;
+		size_t mMask = 0;
+	};
+}
+
+void GeometryGenerator::MeshData::WriteIndices(void* dst, uint32 indexStride)const
+{
+	if(indexStride == 4)
+	{
+		std::copy(Indices32.begin(), Indices32.end(), static_cast<uint32*>(dst));
+		return;
+	}
+
+	uint16* dst16 = static_cast<uint16*>(dst);
+	for(size_t i = 0; i < Indices32.size(); ++i)
+		dst16[i] = static_cast<uint16>(Indices32[i]);
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
     MeshData meshData;
@@ -104,6 +213,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 {
     MeshData meshData;
 
+	// Two poles plus stackCount-1 rings of sliceCount+1 vertices (the first and last
+	// vertex of a ring coincide but have different texture coordinates).  Each pole
+	// is a fan of sliceCount triangles and each band between rings has 2*sliceCount.
+	uint32 ringVertexCount = sliceCount + 1;
+	meshData.Vertices.resize(2 + (stackCount-1)*ringVertexCount);
+	meshData.Indices32.resize(6*sliceCount*(stackCount-1));
+
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
 	//
@@ -114,79 +230,81 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	Vertex* v = meshData.Vertices.data();
+	*v++ = topVertex;
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
 
+	// Every ring uses the same angles around the y-axis.
+	std::vector<float> cosTheta, sinTheta;
+	BuildSinCosTable(sliceCount, thetaStep, cosTheta, sinTheta);
+
 	// Compute vertices for each stack ring (do not count the poles as rings).
 	for(uint32 i = 1; i <= stackCount-1; ++i)
 	{
 		float phi = i*phiStep;
+		float sinPhi = sinf(phi);
+		float cosPhi = cosf(phi);
 
 		// Vertices of ring.
-        for(uint32 j = 0; j <= sliceCount; ++j)
+		for(uint32 j = 0; j <= sliceCount; ++j, ++v)
 		{
-			float theta = j*thetaStep;
-
-			Vertex v;
-
 			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
+			v->Position.x = radius*sinPhi*cosTheta[j];
+			v->Position.y = radius*cosPhi;
+			v->Position.z = radius*sinPhi*sinTheta[j];
 
 			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+			v->TangentU.x = -radius*sinPhi*sinTheta[j];
+			v->TangentU.y = 0.0f;
+			v->TangentU.z = +radius*sinPhi*cosTheta[j];
 
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+			XMVECTOR T = XMLoadFloat3(&v->TangentU);
+			XMStoreFloat3(&v->TangentU, XMVector3Normalize(T));
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+			XMVECTOR p = XMLoadFloat3(&v->Position);
+			XMStoreFloat3(&v->Normal, XMVector3Normalize(p));
 
-			meshData.Vertices.push_back( v );
+			v->TexC.x = j*thetaStep / XM_2PI;
+			v->TexC.y = phi / XM_PI;
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	*v = bottomVertex;
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
 	// and connects the top pole to the first ring.
 	//
 
-    for(uint32 i = 1; i <= sliceCount; ++i)
+	uint32* k = meshData.Indices32.data();
+
+	for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		*k++ = 0;
+		*k++ = i+1;
+		*k++ = i;
 	}
-	
+
 	//
 	// Compute indices for inner stacks (not connected to poles).
 	//
 
 	// Offset the indices to the index of the first vertex in the first ring.
 	// This is just skipping the top pole vertex.
-    uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
+	uint32 baseIndex = 1;
 	for(uint32 i = 0; i < stackCount-2; ++i)
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			*k++ = baseIndex + i*ringVertexCount + j;
+			*k++ = baseIndex + i*ringVertexCount + j+1;
+			*k++ = baseIndex + (i+1)*ringVertexCount + j;
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			*k++ = baseIndex + (i+1)*ringVertexCount + j;
+			*k++ = baseIndex + i*ringVertexCount + j+1;
+			*k++ = baseIndex + (i+1)*ringVertexCount + j+1;
 		}
 	}
 
@@ -200,12 +318,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
-	
+
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		*k++ = southPoleIndex;
+		*k++ = baseIndex+i;
+		*k++ = baseIndex+i+1;
 	}
 
     return meshData;
@@ -213,13 +331,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
-
 	//       v1
 	//       *
 	//      / \
@@ -230,48 +341,60 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+	// The input vertices are kept as they are and every edge gets one midpoint,
+	// shared by the triangles on either side of it, so a closed mesh stays closed.
+	std::vector<uint32> inputIndices;
+	inputIndices.swap(meshData.Indices32);
+
+	uint32 numTris = (uint32)inputIndices.size()/3;
+	uint32 baseVertex = (uint32)meshData.Vertices.size();
+
+	// Number the midpoints from baseVertex in the order their edges are first seen,
+	// writing the four new triangles as we go.
+	EdgeMidpointMap midpoints(3*numTris);
+	std::vector<uint32> edgeEnds;
+	edgeEnds.reserve(2*3*numTris);
+
+	meshData.Indices32.resize(numTris*12);
+	uint32* k = meshData.Indices32.data();
+
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
-
-		//
-		// Generate the midpoints.
-		//
-
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		uint32 v0 = inputIndices[i*3+0];
+		uint32 v1 = inputIndices[i*3+1];
+		uint32 v2 = inputIndices[i*3+2];
+
+		uint32 m0 = midpoints.Insert(v0, v1, baseVertex, edgeEnds);
+		uint32 m1 = midpoints.Insert(v1, v2, baseVertex, edgeEnds);
+		uint32 m2 = midpoints.Insert(v0, v2, baseVertex, edgeEnds);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		*k++ = v0;
+		*k++ = m0;
+		*k++ = m2;
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		*k++ = m0;
+		*k++ = m1;
+		*k++ = m2;
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		*k++ = m2;
+		*k++ = m1;
+		*k++ = v2;
+
+		*k++ = m0;
+		*k++ = v1;
+		*k++ = m1;
 	}
+
+	//
+	// Generate the midpoints.
+	//
+
+	uint32 edgeCount = (uint32)edgeEnds.size()/2;
+	meshData.Vertices.resize(baseVertex + edgeCount);
+
+	Vertex* v = meshData.Vertices.data();
+	for(uint32 e = 0; e < edgeCount; ++e)
+		v[baseVertex + e] = MidPoint(v[edgeEnds[e*2+0]], v[edgeEnds[e*2+1]]);
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -389,6 +512,18 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 {
     MeshData meshData;
 
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount+1;
+	uint32 ringCount = stackCount+1;
+
+	// The side rings, then each cap: a ring of its own plus a center vertex, and a fan
+	// of sliceCount triangles.
+	meshData.Vertices.reserve((ringCount+2)*ringVertexCount + 2);
+	meshData.Indices32.reserve(6*sliceCount*(stackCount+1));
+	meshData.Vertices.resize(ringCount*ringVertexCount);
+	meshData.Indices32.resize(6*sliceCount*stackCount);
+
 	//
 	// Build Stacks.
 	// 
@@ -398,83 +533,86 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	// Amount to increment radius as we move up each stack level from bottom to top.
 	float radiusStep = (topRadius - bottomRadius) / stackCount;
 
-	uint32 ringCount = stackCount+1;
+	// Every ring, and both caps, use the same angles around the y-axis.
+	float dTheta = 2.0f*XM_PI/sliceCount;
+	std::vector<float> cosines, sines;
+	BuildSinCosTable(sliceCount, dTheta, cosines, sines);
+
+	// Cylinder can be parameterized as follows, where we introduce v
+	// parameter that goes in the same direction as the v tex-coord
+	// so that the bitangent goes in the same direction as the v tex-coord.
+	//   Let r0 be the bottom radius and let r1 be the top radius.
+	//   y(v) = h - hv for v in [0,1].
+	//   r(v) = r1 + (r0-r1)v
+	//
+	//   x(t, v) = r(v)*cos(t)
+	//   y(t, v) = h - hv
+	//   z(t, v) = r(v)*sin(t)
+	// 
+	//  dx/dt = -r(v)*sin(t)
+	//  dy/dt = 0
+	//  dz/dt = +r(v)*cos(t)
+	//
+	//  dx/dv = (r0-r1)*cos(t)
+	//  dy/dv = -h
+	//  dz/dv = (r0-r1)*sin(t)
+	//
+	// Neither derivative depends on v, so the tangent frame of a slice is the same in
+	// every ring: compute it once per slice and copy it down the stacks.
+	std::vector<Vertex> frames(ringVertexCount);
+	for(uint32 j = 0; j <= sliceCount; ++j)
+	{
+		float c = cosines[j];
+		float s = sines[j];
+
+		// This is unit length.
+		frames[j].TangentU = XMFLOAT3(-s, 0.0f, c);
+
+		float dr = bottomRadius-topRadius;
+		XMFLOAT3 bitangent(dr*c, -height, dr*s);
+
+		XMVECTOR T = XMLoadFloat3(&frames[j].TangentU);
+		XMVECTOR B = XMLoadFloat3(&bitangent);
+		XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+		XMStoreFloat3(&frames[j].Normal, N);
+	}
 
 	// Compute vertices for each stack ring starting at the bottom and moving up.
+	Vertex* vertex = meshData.Vertices.data();
 	for(uint32 i = 0; i < ringCount; ++i)
 	{
 		float y = -0.5f*height + i*stackHeight;
 		float r = bottomRadius + i*radiusStep;
+		float v = 1.0f - (float)i/stackCount;
 
 		// vertices of ring
-		float dTheta = 2.0f*XM_PI/sliceCount;
-		for(uint32 j = 0; j <= sliceCount; ++j)
+		for(uint32 j = 0; j <= sliceCount; ++j, ++vertex)
 		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
+			vertex->Position = XMFLOAT3(r*cosines[j], y, r*sines[j]);
+			vertex->Normal = frames[j].Normal;
+			vertex->TangentU = frames[j].TangentU;
+			vertex->TexC = XMFLOAT2((float)j/sliceCount, v);
 		}
 	}
 
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
-
 	// Compute indices for each stack.
+	uint32* k = meshData.Indices32.data();
 	for(uint32 i = 0; i < stackCount; ++i)
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+			*k++ = i*ringVertexCount + j;
+			*k++ = (i+1)*ringVertexCount + j;
+			*k++ = (i+1)*ringVertexCount + j+1;
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			*k++ = i*ringVertexCount + j;
+			*k++ = (i+1)*ringVertexCount + j+1;
+			*k++ = i*ringVertexCount + j+1;
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	BuildCylinderTopCap(topRadius, height, sliceCount, cosines.data(), sines.data(), meshData);
+	BuildCylinderBottomCap(bottomRadius, height, sliceCount, cosines.data(), sines.data(), meshData);
 
     return meshData;
 }
@@ -904,19 +1042,18 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePentagonalPrism(float width
 	return meshData;
 }
 
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount,
+											const float* cosines, const float* sines, MeshData& meshData)
 {
 	uint32 baseIndex = (uint32)meshData.Vertices.size();
 
 	float y = 0.5f*height;
-	float dTheta = 2.0f*XM_PI/sliceCount;
 
 	// Duplicate cap ring vertices because the texture coordinates and normals differ.
 	for(uint32 i = 0; i <= sliceCount; ++i)
 	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
+		float x = topRadius*cosines[i];
+		float z = topRadius*sines[i];
 
 		// Scale down by the height to try and make top cap texture coord area
 		// proportional to base.
@@ -940,8 +1077,8 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 	}
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount,
+											   const float* cosines, const float* sines, MeshData& meshData)
 {
 	// 
 	// Build bottom cap.
@@ -951,11 +1088,10 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 	float y = -0.5f*height;
 
 	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
 	for(uint32 i = 0; i <= sliceCount; ++i)
 	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
+		float x = bottomRadius*cosines[i];
+		float z = bottomRadius*sines[i];
 
 		// Scale down by the height to try and make top cap texture coord area
 		// proportional to base.
@@ -980,16 +1116,77 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
+{
+	return CreateGrid(width, depth, m, n, nullptr);
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, TaskScheduler* scheduler)
 {
     MeshData meshData;
 
 	uint32 vertexCount = m*n;
 	uint32 faceCount   = (m-1)*(n-1)*2;
 
-	//
-	// Create the vertices.
-	//
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices32.resize(faceCount*3); // 3 indices per face
+
+	// Rows are independent, so each task fills its own slice of the output.
+	Vertex* vertices = meshData.Vertices.data();
+	uint32* indices = meshData.Indices32.data();
+	const uint32 grain = GridRowsPerTask(n);
+
+	ForEachRowRange(scheduler, 0, m, grain, [&](uint32 first, uint32 last)
+	{
+		WriteGridVertices(width, depth, m, n, first, last, vertices + first*n);
+	});
+
+	ForEachRowRange(scheduler, 0, m-1, grain, [&](uint32 first, uint32 last)
+	{
+		WriteGridIndices(n, first, last, 0, indices + first*(n-1)*6);
+	});
+
+    return meshData;
+}
 
+void GeometryGenerator::CreateGridChunks(float width, float depth, uint32 m, uint32 n, uint32 chunkRows,
+	const std::function<void(const GridChunk&)>& sink, TaskScheduler* scheduler)
+{
+	chunkRows = std::max(chunkRows, 1u);
+	const uint32 grain = GridRowsPerTask(n);
+
+	GridChunk chunk;
+	for(uint32 rowBegin = 0; rowBegin < m-1; rowBegin += chunkRows)
+	{
+		uint32 rowEnd = std::min(rowBegin + chunkRows, m-1);
+
+		chunk.RowBegin = rowBegin;
+		chunk.RowEnd = rowEnd;
+		chunk.FirstVertex = rowBegin*n;
+
+		// The buffers only grow, and only up to the first (full size) chunk.
+		chunk.Vertices.resize((rowEnd - rowBegin + 1)*n);
+		chunk.Indices32.resize((rowEnd - rowBegin)*(n-1)*6);
+
+		Vertex* vertices = chunk.Vertices.data();
+		uint32* indices = chunk.Indices32.data();
+
+		ForEachRowRange(scheduler, rowBegin, rowEnd + 1, grain, [&](uint32 first, uint32 last)
+		{
+			WriteGridVertices(width, depth, m, n, first, last, vertices + (first - rowBegin)*n);
+		});
+
+		ForEachRowRange(scheduler, rowBegin, rowEnd, grain, [&](uint32 first, uint32 last)
+		{
+			WriteGridIndices(n, first, last, chunk.FirstVertex, indices + (first - rowBegin)*(n-1)*6);
+		});
+
+		sink(chunk);
+	}
+}
+
+void GeometryGenerator::WriteGridVertices(float width, float depth, uint32 m, uint32 n,
+	uint32 rowBegin, uint32 rowEnd, Vertex* dst)
+{
 	float halfWidth = 0.5f*width;
 	float halfDepth = 0.5f*depth;
 
@@ -999,49 +1196,45 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
-	for(uint32 i = 0; i < m; ++i)
+	Vertex* v = dst;
+	for(uint32 i = rowBegin; i < rowEnd; ++i)
 	{
 		float z = halfDepth - i*dz;
-		for(uint32 j = 0; j < n; ++j)
+		float tv = i*dv;
+		for(uint32 j = 0; j < n; ++j, ++v)
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			v->Position = XMFLOAT3(x, 0.0f, z);
+			v->Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			v->TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			v->TexC = XMFLOAT2(j*du, tv);
 		}
 	}
- 
-    //
-	// Create the indices.
-	//
-
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
+}
 
+void GeometryGenerator::WriteGridIndices(uint32 n, uint32 rowBegin, uint32 rowEnd, uint32 firstVertex, uint32* dst)
+{
 	// Iterate over each quad and compute indices.
-	uint32 k = 0;
-	for(uint32 i = 0; i < m-1; ++i)
+	uint32* k = dst;
+	for(uint32 i = rowBegin; i < rowEnd; ++i)
 	{
+		uint32 row = i*n - firstVertex;
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			k[0] = row+j;
+			k[1] = row+j+1;
+			k[2] = row+n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			k[3] = row+n+j;
+			k[4] = row+j+1;
+			k[5] = row+n+j+1;
 
 			k += 6; // next quad
 		}
 	}
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
@@ -1188,57 +1381,63 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float radius, float c
 {
 	MeshData meshData;
 
+	// sliceCount+1 cross sections of crossCount+1 vertices each, two triangles per quad.
+	meshData.Vertices.resize((sliceCount + 1) * (crossCount + 1));
+	meshData.Indices32.resize(6 * sliceCount * crossCount);
+
 	// The steps for each of the separate rotations
 	float thetaStep = 2.0f * XM_PI / sliceCount; // the steps around the ring
 	float phiStep = 2.0f * XM_PI / crossCount; // the steps around the cross section
 
+	// Every cross section uses the same angles.
+	std::vector<float> cosPhi, sinPhi;
+	BuildSinCosTable(crossCount, phiStep, cosPhi, sinPhi);
+
 	// For each slice around the circumference of the torus
+	Vertex* v = meshData.Vertices.data();
 	for (uint32 i = 0; i <= sliceCount; ++i)
 	{
 		float theta = i * thetaStep;
+		float cosTheta = cosf(theta);
+		float sinTheta = sinf(theta);
 
 		// for each vertex around the cross section
-		for (uint32 j = 0; j <= crossCount; ++j)
+		for (uint32 j = 0; j <= crossCount; ++j, ++v)
 		{
-			float phi = j * phiStep;
-
-			Vertex v;
-
-			v.Position.x = radius * cosf(theta) + crossRadius * sinf(phi) * cosf(theta);
-			v.Position.y = crossRadius * cosf(phi);
-			v.Position.z = radius * sinf(theta) + crossRadius * sinf(phi) * sinf(theta);
+			v->Position.x = radius * cosTheta + crossRadius * sinPhi[j] * cosTheta;
+			v->Position.y = crossRadius * cosPhi[j];
+			v->Position.z = radius * sinTheta + crossRadius * sinPhi[j] * sinTheta;
 
 			// Partial derivative of P with respect to theta
-			v.TangentU.x = -crossRadius * sinf(phi) * sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = crossRadius * sinf(phi) * cosf(theta);
+			v->TangentU.x = -crossRadius * sinPhi[j] * sinTheta;
+			v->TangentU.y = 0.0f;
+			v->TangentU.z = crossRadius * sinPhi[j] * cosTheta;
 
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+			XMVECTOR T = XMLoadFloat3(&v->TangentU);
+			XMStoreFloat3(&v->TangentU, XMVector3Normalize(T));
 
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+			XMVECTOR p = XMLoadFloat3(&v->Position);
+			XMStoreFloat3(&v->Normal, XMVector3Normalize(p));
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
-
-			meshData.Vertices.push_back(v);
+			v->TexC.x = theta / XM_2PI;
+			v->TexC.y = j * phiStep / XM_PI;
 		}
 	}
 
-	uint32 baseIndex = 0;
-	uint32 ringVertexCount = sliceCount + 1;
+	// Each cross section holds crossCount+1 vertices.
+	const uint32 stride = crossCount + 1;
+	uint32* k = meshData.Indices32.data();
 	for (uint32 i = 0; i < sliceCount; ++i)
 	{
 		for (uint32 j = 0; j < crossCount; ++j)
 		{
-			meshData.Indices32.push_back(i * (sliceCount + 1) + (j + 1));
-			meshData.Indices32.push_back(i * (sliceCount + 1) + j);
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + j);
+			*k++ = i * stride + (j + 1);
+			*k++ = i * stride + j;
+			*k++ = (i + 1) * stride + j;
 
-			meshData.Indices32.push_back(i * (sliceCount + 1) + (j + 1));
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + j);
-			meshData.Indices32.push_back((i + 1) * (sliceCount + 1) + (j + 1));
+			*k++ = i * stride + (j + 1);
+			*k++ = (i + 1) * stride + j;
+			*k++ = (i + 1) * stride + (j + 1);
 		}
 	}
 
@@ -16,8 +16,11 @@
 
 #include <cstdint>
 #include <DirectXMath.h>
+#include <functional>
 #include <vector>
 
+class TaskScheduler;
+
 class GeometryGenerator
 {
 public:
@@ -25,6 +28,15 @@ public:
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
 
+	///<summary>
+	/// Revision of what the generators (and MeshOptimizer, MeshSimplifier and
+	/// MeshBounds) produce.  Bump it whenever any of them gives different output for
+	/// the same arguments.  Mesh cache files (see MeshBatchBuilder::SetCacheFile) are
+	/// keyed on it and on the call arguments only, so a file written by older code is
+	/// detected as stale through this constant and nothing else.
+	///</summary>
+	static const uint32 OutputRevision = 2;
+
 	struct Vertex
 	{
 		Vertex(){}
@@ -58,6 +70,23 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+        // Bytes per index of the narrowest format that addresses every vertex: 2 up to
+        // 65536 vertices, else 4.  The generators size Vertices exactly before writing
+        // any index, so this is settled as soon as a mesh is created.
+        uint32 IndexStride()const
+        {
+            return Vertices.size() <= 0x10000 ? 2 : 4;
+        }
+
+        ///<summary>
+        /// Writes Indices32 to dst at indexStride bytes per index (2 or 4, at least
+        /// IndexStride()), for example straight into this mesh's slice of an index
+        /// buffer shared by several meshes.  Nothing is cached, unlike GetIndices16().
+        ///</summary>
+        void WriteIndices(void* dst, uint32 indexStride)const;
+
+        // Keeps a 16-bit copy alongside Indices32 for the lifetime of the mesh; prefer
+        // WriteIndices when filling a buffer.
         std::vector<uint16>& GetIndices16()
         {
 			if(mIndices16.empty())
@@ -74,6 +103,22 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	///<summary>
+	/// One band of a grid produced by CreateGridChunks: grid rows [RowBegin, RowEnd]
+	/// (inclusive, so the edge row is shared with the next chunk) and the quads
+	/// between them.  Indices are relative to Vertices[0], so a chunk can be drawn on
+	/// its own; add FirstVertex to get indices into the full m x n grid.
+	///</summary>
+	struct GridChunk
+	{
+		uint32 RowBegin = 0;
+		uint32 RowEnd = 0;
+		uint32 FirstVertex = 0;
+
+		std::vector<Vertex> Vertices;
+		std::vector<uint32> Indices32;
+	};
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -121,15 +166,42 @@ public:
 	///</summary>
     MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
 
+	///<summary>
+	/// CreateGrid with the vertex and index rows split across the scheduler's threads.
+	/// Each task writes a disjoint range of the preallocated output, so the result is
+	/// identical to the serial version.  A null scheduler runs serially.
+	///</summary>
+	MeshData CreateGrid(float width, float depth, uint32 m, uint32 n, TaskScheduler* scheduler);
+
+	///<summary>
+	/// Streams the same grid as CreateGrid to sink in bands of at most chunkRows quad
+	/// rows, from the +z edge down.  The chunk passed to sink is reused for the next
+	/// band, so memory stays at one chunk however large the grid is.  Copy out what
+	/// you need before returning.  The scheduler, if any, fills each chunk in parallel.
+	///</summary>
+	void CreateGridChunks(float width, float depth, uint32 m, uint32 n, uint32 chunkRows,
+		const std::function<void(const GridChunk&)>& sink, TaskScheduler* scheduler = nullptr);
+
 	///<summary>
 	/// Creates a quad aligned with the screen.  This is useful for postprocessing and screen effects.
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
+
+	///<summary>
+	/// Splits every triangle into four.  Triangles that share an edge (the same two
+	/// vertex indices) share its midpoint, so welded meshes stay welded and each
+	/// level adds one vertex per edge rather than six per triangle.
+	///</summary>
 	void Subdivide(MeshData& meshData);
 private:
 	
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+    void BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount, const float* cosines, const float* sines, MeshData& meshData);
+    void BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount, const float* cosines, const float* sines, MeshData& meshData);
+
+    // Grid rows [rowBegin, rowEnd) of CreateGrid's vertices, and the indices of quad
+    // rows [rowBegin, rowEnd) relative to vertex firstVertex.
+    void WriteGridVertices(float width, float depth, uint32 m, uint32 n, uint32 rowBegin, uint32 rowEnd, Vertex* dst);
+    void WriteGridIndices(uint32 n, uint32 rowBegin, uint32 rowEnd, uint32 firstVertex, uint32* dst);
 };
 
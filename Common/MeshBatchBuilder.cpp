@@ -0,0 +1,337 @@
+//***************************************************************************************
+// MeshBatchBuilder.cpp
+//***************************************************************************************
+
+#include "MeshBatchBuilder.h"
+#include <algorithm>
+#include "MeshBounds.h"
+#include "MeshOptimizer.h"
+
+std::string LodName(const std::string& name, int lod)
+{
+	return lod == 0 ? name : name + "_lod" + std::to_string(lod);
+}
+
+std::vector<const SubmeshGeometry*> GetLodChain(const MeshGeometry& geo, const std::string& name)
+{
+	std::vector<const SubmeshGeometry*> chain;
+	for(int lod = 0; ; ++lod)
+	{
+		auto it = geo.DrawArgs.find(LodName(name, lod));
+		if(it == geo.DrawArgs.end())
+			break;
+		chain.push_back(&it->second);
+	}
+	return chain;
+}
+
+MeshBatchBuilder::MeshBatchBuilder(UINT vertexByteStride, VertexWriter writeVertices)
+{
+	mVertexByteStride = vertexByteStride;
+	mWriteVertices = writeVertices;
+}
+
+void MeshBatchBuilder::Add(const std::string& name, GeometryGenerator::MeshData&& mesh)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Mesh = std::move(mesh);
+	mEntries.push_back(std::move(entry));
+}
+
+void MeshBatchBuilder::Add(const std::string& name, MeshGenerator generator)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Generator = std::move(generator);
+	mEntries.push_back(std::move(entry));
+}
+
+void MeshBatchBuilder::Add(const std::string& name, const std::string& cacheKey, MeshGenerator generator)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Generator = std::move(generator);
+	entry.CacheKey = cacheKey;
+	mEntries.push_back(std::move(entry));
+}
+
+void MeshBatchBuilder::Add(const std::string& name, const std::string& cacheKey, MeshGenerator generator,
+	const std::vector<float>& lodTriangleRatios)
+{
+	Add(name, cacheKey, std::move(generator));
+	mEntries.back().LodTriangleRatios = lodTriangleRatios;
+}
+
+std::unique_ptr<MeshGeometry> MeshBatchBuilder::Build(const std::string& name, ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList, TaskScheduler* scheduler)
+{
+	std::uint64_t cacheKey = 0;
+	const bool useCache = ComputeCacheKey(cacheKey);
+	if(useCache)
+	{
+		std::unique_ptr<MeshGeometry> cached = LoadCache(name, cacheKey, device, cmdList);
+		if(cached != nullptr)
+		{
+			mEntries.clear();
+			return cached;
+		}
+	}
+
+	SerialTaskScheduler serialScheduler;
+	if(scheduler == nullptr)
+		scheduler = &serialScheduler;
+
+	//
+	// Generate every mesh and simplify those that asked for levels of detail; they are
+	// independent.
+	//
+
+	scheduler->ParallelFor(0, (int)mEntries.size(), 1, [this](int first, int last)
+	{
+		GeometryGenerator geoGen;
+		for(int m = first; m < last; ++m)
+		{
+			Entry& entry = mEntries[m];
+			if(entry.Generator)
+				entry.Mesh = entry.Generator(geoGen);
+
+			if(!entry.LodTriangleRatios.empty())
+			{
+				entry.Lods = BuildLodChain(entry.Mesh,
+					entry.LodTriangleRatios.data(), entry.LodTriangleRatios.size());
+			}
+		}
+	});
+
+	// Every simplified level becomes a mesh of its own, right after its original.
+	if(std::any_of(mEntries.begin(), mEntries.end(), [](const Entry& e) { return !e.Lods.empty(); }))
+	{
+		std::vector<Entry> expanded;
+		for(Entry& entry : mEntries)
+		{
+			const std::string name = entry.Name;
+			std::vector<MeshLod> lods = std::move(entry.Lods);
+			expanded.push_back(std::move(entry));
+
+			for(size_t lod = 1; lod < lods.size(); ++lod)
+			{
+				Entry level;
+				level.Name = LodName(name, (int)lod);
+				level.Mesh = std::move(lods[lod].Mesh);
+				level.LodError = lods[lod].Error;
+				expanded.push_back(std::move(level));
+			}
+		}
+		mEntries.swap(expanded);
+	}
+
+	const int meshCount = (int)mEntries.size();
+
+	if(mOptimizeMeshes)
+	{
+		scheduler->ParallelFor(0, meshCount, 1, [this](int first, int last)
+		{
+			for(int m = first; m < last; ++m)
+				OptimizeMesh(mEntries[m].Mesh);
+		});
+	}
+
+	//
+	// Lay the meshes out back to back.
+	//
+
+	UINT vertexCount = 0;
+	UINT indexCount = 0;
+	UINT indexStride = 2;
+	for(Entry& entry : mEntries)
+	{
+		entry.BaseVertex = vertexCount;
+		entry.StartIndex = indexCount;
+
+		vertexCount += (UINT)entry.Mesh.Vertices.size();
+		indexCount += (UINT)entry.Mesh.Indices32.size();
+
+		// Indices are relative to each mesh's BaseVertexLocation, so only the largest
+		// mesh decides the width.
+		if(entry.Mesh.IndexStride() > indexStride)
+			indexStride = entry.Mesh.IndexStride();
+	}
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = name;
+
+	ThrowIfFailed(D3DCreateBlob(vertexCount*mVertexByteStride, &geo->VertexBufferCPU));
+	ThrowIfFailed(D3DCreateBlob(indexCount*indexStride, &geo->IndexBufferCPU));
+
+	BYTE* vertices = (BYTE*)geo->VertexBufferCPU->GetBufferPointer();
+	BYTE* indices = (BYTE*)geo->IndexBufferCPU->GetBufferPointer();
+
+	//
+	// Every mesh fills its own ranges of the two buffers, and takes its bounds while
+	// its vertices are in cache.
+	//
+
+	scheduler->ParallelFor(0, meshCount, 1, [&](int first, int last)
+	{
+		for(int m = first; m < last; ++m)
+		{
+			Entry& entry = mEntries[m];
+
+			mWriteVertices(entry.Mesh.Vertices.data(), entry.Mesh.Vertices.size(),
+				vertices + (size_t)entry.BaseVertex*mVertexByteStride);
+			entry.Mesh.WriteIndices(indices + (size_t)entry.StartIndex*indexStride, indexStride);
+
+			entry.Bounds = ComputeBoundingBox(entry.Mesh);
+			if(mComputeBoundingSpheres)
+				entry.Sphere = ComputeBoundingSphere(entry.Mesh, entry.Bounds);
+		}
+	});
+
+	Upload(*geo, device, cmdList, indexStride);
+
+	for(const Entry& entry : mEntries)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)entry.Mesh.Indices32.size();
+		submesh.StartIndexLocation = entry.StartIndex;
+		submesh.BaseVertexLocation = (INT)entry.BaseVertex;
+		submesh.Bounds = entry.Bounds;
+		submesh.Sphere = entry.Sphere;
+		submesh.LodError = entry.LodError;
+
+		geo->DrawArgs[entry.Name] = submesh;
+	}
+
+	if(useCache)
+		SaveCache(*geo, cacheKey, indexStride);
+
+	mEntries.clear();
+
+	return geo;
+}
+
+bool MeshBatchBuilder::ComputeCacheKey(std::uint64_t& key)const
+{
+	if(mCacheFile.empty() || mEntries.empty())
+		return false;
+
+	MeshCacheKey hash;
+	hash.Add(GeometryGenerator::OutputRevision);
+	hash.Add(mVertexByteStride);
+	hash.Add((std::uint32_t)sizeof(GeometryGenerator::Vertex));
+	hash.Add((std::uint32_t)mOptimizeMeshes);
+	hash.Add((std::uint32_t)mComputeBoundingSpheres);
+
+	for(const Entry& entry : mEntries)
+	{
+		// A mesh without a key (including any added as MeshData) can't be looked up.
+		if(entry.CacheKey.empty())
+			return false;
+
+		hash.Add(entry.Name);
+		hash.Add(entry.CacheKey);
+
+		hash.Add((std::uint32_t)entry.LodTriangleRatios.size());
+		if(!entry.LodTriangleRatios.empty())
+			hash.Add(entry.LodTriangleRatios.data(), entry.LodTriangleRatios.size()*sizeof(float));
+	}
+
+	key = hash.Value();
+	return true;
+}
+
+std::unique_ptr<MeshGeometry> MeshBatchBuilder::LoadCache(const std::string& name, std::uint64_t key,
+	ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)
+{
+	MappedMeshCache cache;
+	if(!cache.Open(mCacheFile, key))
+		return nullptr;
+
+	// Every mesh is followed by its simplified levels.
+	size_t submeshCount = 0;
+	for(const Entry& entry : mEntries)
+		submeshCount += 1 + entry.LodTriangleRatios.size();
+
+	const MeshCacheContents& contents = cache.Contents();
+	if(contents.VertexByteStride != mVertexByteStride || contents.Submeshes.size() != submeshCount)
+		return nullptr;
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = name;
+
+	ThrowIfFailed(D3DCreateBlob(contents.VertexBufferByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), contents.Vertices, contents.VertexBufferByteSize);
+
+	ThrowIfFailed(D3DCreateBlob(contents.IndexBufferByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), contents.Indices, contents.IndexBufferByteSize);
+
+	Upload(*geo, device, cmdList, contents.IndexStride);
+
+	for(const MeshCacheSubmesh& cached : contents.Submeshes)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = cached.IndexCount;
+		submesh.StartIndexLocation = cached.StartIndexLocation;
+		submesh.BaseVertexLocation = cached.BaseVertexLocation;
+		submesh.Bounds = cached.Bounds;
+		submesh.Sphere = cached.Sphere;
+		submesh.LodError = cached.LodError;
+
+		geo->DrawArgs[cached.Name] = submesh;
+	}
+
+	return geo;
+}
+
+void MeshBatchBuilder::SaveCache(const MeshGeometry& geo, std::uint64_t key, UINT indexStride)const
+{
+	MeshCacheContents contents;
+	contents.Key = key;
+	contents.VertexByteStride = mVertexByteStride;
+	contents.IndexStride = indexStride;
+	contents.Vertices = geo.VertexBufferCPU->GetBufferPointer();
+	contents.VertexBufferByteSize = geo.VertexBufferByteSize;
+	contents.Indices = geo.IndexBufferCPU->GetBufferPointer();
+	contents.IndexBufferByteSize = geo.IndexBufferByteSize;
+
+	contents.Submeshes.resize(mEntries.size());
+	for(size_t e = 0; e < mEntries.size(); ++e)
+	{
+		const Entry& entry = mEntries[e];
+		const SubmeshGeometry& submesh = geo.DrawArgs.at(entry.Name);
+
+		MeshCacheSubmesh& cached = contents.Submeshes[e];
+		cached.Name = entry.Name;
+		cached.IndexCount = submesh.IndexCount;
+		cached.StartIndexLocation = submesh.StartIndexLocation;
+		cached.BaseVertexLocation = submesh.BaseVertexLocation;
+		cached.Bounds = submesh.Bounds;
+		cached.Sphere = submesh.Sphere;
+		cached.LodError = submesh.LodError;
+	}
+
+	// A cache that can't be written only costs the next start its head start.
+	WriteMeshCache(mCacheFile, contents);
+}
+
+void MeshBatchBuilder::Upload(MeshGeometry& geo, ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList, UINT indexStride)const
+{
+	const UINT vbByteSize = (UINT)geo.VertexBufferCPU->GetBufferSize();
+	const UINT ibByteSize = (UINT)geo.IndexBufferCPU->GetBufferSize();
+
+	if(device != nullptr)
+	{
+		geo.VertexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList,
+			geo.VertexBufferCPU->GetBufferPointer(), vbByteSize, geo.VertexBufferUploader);
+
+		geo.IndexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList,
+			geo.IndexBufferCPU->GetBufferPointer(), ibByteSize, geo.IndexBufferUploader);
+	}
+
+	geo.VertexByteStride = mVertexByteStride;
+	geo.VertexBufferByteSize = vbByteSize;
+	geo.IndexFormat = indexStride == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	geo.IndexBufferByteSize = ibByteSize;
+}
@@ -0,0 +1,145 @@
+//***************************************************************************************
+// MeshBatchBuilder.h
+//
+// Packs any number of GeometryGenerator meshes into one MeshGeometry: a single vertex
+// buffer, a single index buffer and one DrawArgs entry per mesh, with the offsets
+// worked out here instead of by hand.
+//
+//   MeshBatchBuilder builder(sizeof(Vertex), WriteVertices);
+//   builder.Add("box", [](GeometryGenerator& g) { return g.CreateBox(1.5f, 0.5f, 1.5f, 3); });
+//   builder.Add("terrain", std::move(terrainMesh));
+//   mGeometries["shapeGeo"] = builder.Build("shapeGeo", device, cmdList, scheduler);
+//
+// Build runs the generators (and the mesh optimizer) in parallel, sizes both buffers
+// once, and then every mesh writes its own vertex and index ranges in parallel, straight
+// into the CPU copies that are also uploaded.  The same parallel pass fills in each
+// submesh's Bounds (and, on request, its bounding Sphere) from the final positions.
+//
+// With a cache file set and a cache key on every mesh, the finished batch is saved to
+// that file (see MeshCache.h) and later builds with the same keys map it instead of
+// running any generator:
+//
+//   builder.SetCacheFile(L"shapeGeo.meshcache");
+//   MESH_BATCH_ADD(builder, "box", CreateBox(1.5f, 0.5f, 1.5f, 3));
+//
+// A mesh can also bring a chain of simplified levels of detail (see MeshSimplifier.h),
+// stored as extra submeshes named by LodName and collected again with GetLodChain.
+//***************************************************************************************
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "d3dUtil.h"
+#include "GeometryGenerator.h"
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+#include "TaskScheduler.h"
+
+// Adds geoGen.call under name, keyed for the cache by the text of the call.  Only for
+// calls whose arguments are literals; otherwise use Add with a key that spells out
+// the argument values.
+#define MESH_BATCH_ADD(builder, name, call) \
+	(builder).Add(name, #call, [](GeometryGenerator& geoGen) { return geoGen.call; })
+
+// As MESH_BATCH_ADD, followed by simplified levels at the given triangle ratios.
+#define MESH_BATCH_ADD_LODS(builder, name, call, lodTriangleRatios) \
+	(builder).Add(name, #call, [](GeometryGenerator& geoGen) { return geoGen.call; }, lodTriangleRatios)
+
+// DrawArgs name of level of detail lod of the mesh added as name; level 0 is name.
+std::string LodName(const std::string& name, int lod);
+
+// The levels of detail of name in geo, finest first; just name if it has none.
+std::vector<const SubmeshGeometry*> GetLodChain(const MeshGeometry& geo, const std::string& name);
+
+class MeshBatchBuilder
+{
+public:
+	// Converts count generator vertices to the batch's vertex format at dst.
+	typedef void (*VertexWriter)(const GeometryGenerator::Vertex* src, size_t count, void* dst);
+
+	// Creates one mesh; called from Build, possibly on a worker thread.
+	typedef std::function<GeometryGenerator::MeshData(GeometryGenerator& geoGen)> MeshGenerator;
+
+	MeshBatchBuilder(UINT vertexByteStride, VertexWriter writeVertices);
+	MeshBatchBuilder(const MeshBatchBuilder& rhs) = delete;
+	MeshBatchBuilder& operator=(const MeshBatchBuilder& rhs) = delete;
+
+	// Adds a mesh under its DrawArgs name.  Meshes are laid out in the order added.
+	void Add(const std::string& name, GeometryGenerator::MeshData&& mesh);
+	void Add(const std::string& name, MeshGenerator generator);
+
+	// As above, with a key that identifies the generator and all of its parameters.
+	// Two generators that can give different meshes must never share a key.
+	void Add(const std::string& name, const std::string& cacheKey, MeshGenerator generator);
+
+	// As above, and simplifies the mesh to each fraction of its triangle count in
+	// lodTriangleRatios (decreasing), adding each level as LodName(name, 1), 2, ...
+	void Add(const std::string& name, const std::string& cacheKey, MeshGenerator generator,
+		const std::vector<float>& lodTriangleRatios);
+
+	int MeshCount()const { return (int)mEntries.size(); }
+
+	// Whether Build runs OptimizeMesh on every mesh (on by default).
+	void SetOptimizeMeshes(bool optimize) { mOptimizeMeshes = optimize; }
+
+	// Whether Build also fills in SubmeshGeometry::Sphere (off by default); Bounds is
+	// always filled in.
+	void SetComputeBoundingSpheres(bool compute) { mComputeBoundingSpheres = compute; }
+
+	// File Build loads the batch from when it is up to date, and saves it to when not.
+	// Only used if every mesh was added with a cache key.  Use one file per vertex
+	// format: the key covers the stride but not what the VertexWriter does.  The key
+	// covers the arguments, not the generator code, so a file made by older code is
+	// only detected as stale through GeometryGenerator::OutputRevision; bump it along
+	// with any change to what the generators produce.
+	void SetCacheFile(const std::wstring& path) { mCacheFile = path; }
+
+	///<summary>
+	/// Builds the geometry, or loads it from the cache file when that is up to date,
+	/// and records the uploads on cmdList; keep the returned
+	/// MeshGeometry (and its upload buffers) alive until the list has executed.  The
+	/// index format is the narrowest that addresses the largest mesh.  A null scheduler
+	/// builds serially.  A null device uploads nothing and fills in only the CPU copies,
+	/// which is how GeometryBench checks the builder without a GPU.  The builder is
+	/// empty afterwards and can be reused.
+	///</summary>
+	std::unique_ptr<MeshGeometry> Build(const std::string& name, ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList, TaskScheduler* scheduler = nullptr);
+
+private:
+	struct Entry
+	{
+		std::string Name;
+		GeometryGenerator::MeshData Mesh;
+		MeshGenerator Generator;
+		std::string CacheKey;
+		std::vector<float> LodTriangleRatios;
+		std::vector<MeshLod> Lods;
+		float LodError = 0.0f;
+
+		UINT BaseVertex = 0;
+		UINT StartIndex = 0;
+
+		DirectX::BoundingBox Bounds;
+		DirectX::BoundingSphere Sphere;
+	};
+
+private:
+	bool ComputeCacheKey(std::uint64_t& key)const;
+	std::unique_ptr<MeshGeometry> LoadCache(const std::string& name, std::uint64_t key,
+		ID3D12Device* device, ID3D12GraphicsCommandList* cmdList);
+	void SaveCache(const MeshGeometry& geo, std::uint64_t key, UINT indexStride)const;
+	void Upload(MeshGeometry& geo, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, UINT indexStride)const;
+
+private:
+	UINT mVertexByteStride = 0;
+	VertexWriter mWriteVertices = nullptr;
+	bool mOptimizeMeshes = true;
+	bool mComputeBoundingSpheres = false;
+	std::wstring mCacheFile;
+
+	std::vector<Entry> mEntries;
+};
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// MeshBounds.cpp
+//***************************************************************************************
+
+#include "MeshBounds.h"
+
+using namespace DirectX;
+
+namespace
+{
+	inline XMVECTOR LoadPosition(const char* base, std::size_t i, std::size_t byteStride)
+	{
+		return XMLoadFloat3((const XMFLOAT3*)(base + i*byteStride));
+	}
+
+	inline const XMFLOAT3* FirstPosition(const GeometryGenerator::MeshData& mesh)
+	{
+		return mesh.Vertices.empty() ? nullptr : &mesh.Vertices[0].Position;
+	}
+}
+
+BoundingBox ComputeBoundingBox(const XMFLOAT3* positions, std::size_t count, std::size_t byteStride)
+{
+	BoundingBox box(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	if(count == 0)
+		return box;
+
+	const char* base = (const char*)positions;
+
+	// Four positions per iteration, each into its own pair of accumulators.
+	XMVECTOR vMin0 = LoadPosition(base, 0, byteStride);
+	XMVECTOR vMax0 = vMin0;
+	XMVECTOR vMin1 = vMin0, vMax1 = vMin0;
+	XMVECTOR vMin2 = vMin0, vMax2 = vMin0;
+	XMVECTOR vMin3 = vMin0, vMax3 = vMin0;
+
+	std::size_t i = 1;
+	for(; i + 4 <= count; i += 4)
+	{
+		XMVECTOR p0 = LoadPosition(base, i + 0, byteStride);
+		XMVECTOR p1 = LoadPosition(base, i + 1, byteStride);
+		XMVECTOR p2 = LoadPosition(base, i + 2, byteStride);
+		XMVECTOR p3 = LoadPosition(base, i + 3, byteStride);
+
+		vMin0 = XMVectorMin(vMin0, p0);
+		vMax0 = XMVectorMax(vMax0, p0);
+		vMin1 = XMVectorMin(vMin1, p1);
+		vMax1 = XMVectorMax(vMax1, p1);
+		vMin2 = XMVectorMin(vMin2, p2);
+		vMax2 = XMVectorMax(vMax2, p2);
+		vMin3 = XMVectorMin(vMin3, p3);
+		vMax3 = XMVectorMax(vMax3, p3);
+	}
+
+	for(; i < count; ++i)
+	{
+		XMVECTOR p = LoadPosition(base, i, byteStride);
+		vMin0 = XMVectorMin(vMin0, p);
+		vMax0 = XMVectorMax(vMax0, p);
+	}
+
+	XMVECTOR vMin = XMVectorMin(XMVectorMin(vMin0, vMin1), XMVectorMin(vMin2, vMin3));
+	XMVECTOR vMax = XMVectorMax(XMVectorMax(vMax0, vMax1), XMVectorMax(vMax2, vMax3));
+
+	XMStoreFloat3(&box.Center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+	XMStoreFloat3(&box.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+
+	return box;
+}
+
+BoundingSphere ComputeBoundingSphere(const XMFLOAT3* positions, std::size_t count,
+	std::size_t byteStride, const BoundingBox& box)
+{
+	BoundingSphere sphere(box.Center, 0.0f);
+	if(count == 0)
+		return sphere;
+
+	const char* base = (const char*)positions;
+	const XMVECTOR center = XMLoadFloat3(&box.Center);
+
+	// Largest squared distance from the center, again over four accumulators.
+	XMVECTOR d0 = XMVectorZero();
+	XMVECTOR d1 = XMVectorZero();
+	XMVECTOR d2 = XMVectorZero();
+	XMVECTOR d3 = XMVectorZero();
+
+	std::size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		d0 = XMVectorMax(d0, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, i + 0, byteStride), center)));
+		d1 = XMVectorMax(d1, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, i + 1, byteStride), center)));
+		d2 = XMVectorMax(d2, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, i + 2, byteStride), center)));
+		d3 = XMVectorMax(d3, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, i + 3, byteStride), center)));
+	}
+
+	for(; i < count; ++i)
+		d0 = XMVectorMax(d0, XMVector3LengthSq(XMVectorSubtract(LoadPosition(base, i, byteStride), center)));
+
+	XMVECTOR d = XMVectorMax(XMVectorMax(d0, d1), XMVectorMax(d2, d3));
+	sphere.Radius = sqrtf(XMVectorGetX(d));
+
+	return sphere;
+}
+
+BoundingBox ComputeBoundingBox(const GeometryGenerator::MeshData& mesh)
+{
+	return ComputeBoundingBox(FirstPosition(mesh), mesh.Vertices.size(),
+		sizeof(GeometryGenerator::Vertex));
+}
+
+BoundingSphere ComputeBoundingSphere(const GeometryGenerator::MeshData& mesh, const BoundingBox& box)
+{
+	return ComputeBoundingSphere(FirstPosition(mesh), mesh.Vertices.size(),
+		sizeof(GeometryGenerator::Vertex), box);
+}
@@ -0,0 +1,32 @@
+//***************************************************************************************
+// MeshBounds.h
+//
+// Tight bounding volumes of vertex positions, for SubmeshGeometry::Bounds.
+//
+// Positions are read with a byte stride, so they can be taken straight out of any
+// interleaved vertex array (GeometryGenerator::Vertex or an app's own Vertex) without
+// a copy.  The reductions run on XMVECTORs with several independent accumulators, so
+// the min/max chains overlap instead of waiting on one another.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <DirectXCollision.h>
+#include "GeometryGenerator.h"
+
+// Axis-aligned box around count positions.  An empty range gives a zero-sized box at
+// the origin.
+DirectX::BoundingBox ComputeBoundingBox(const DirectX::XMFLOAT3* positions, std::size_t count,
+	std::size_t byteStride = sizeof(DirectX::XMFLOAT3));
+
+///<summary>
+/// Sphere centered on box that just contains the positions.  It is never larger than
+/// the sphere around the box itself, and usually a good deal tighter for round meshes.
+/// box should come from ComputeBoundingBox over the same positions.
+///</summary>
+DirectX::BoundingSphere ComputeBoundingSphere(const DirectX::XMFLOAT3* positions, std::size_t count,
+	std::size_t byteStride, const DirectX::BoundingBox& box);
+
+DirectX::BoundingBox ComputeBoundingBox(const GeometryGenerator::MeshData& mesh);
+DirectX::BoundingSphere ComputeBoundingSphere(const GeometryGenerator::MeshData& mesh, const DirectX::BoundingBox& box);
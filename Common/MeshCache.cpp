@@ -0,0 +1,326 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// "MSHC" read as a little-endian uint32.
+	const std::uint32_t MeshCacheMagic = 0x4348534D;
+
+	std::uint64_t AlignUp(std::uint64_t offset)
+	{
+		return (offset + MeshCacheAlignment - 1) & ~(std::uint64_t)(MeshCacheAlignment - 1);
+	}
+
+	void WritePadding(std::ofstream& fout, std::uint64_t from, std::uint64_t to)
+	{
+		static const char zeros[MeshCacheAlignment] = {};
+		fout.write(zeros, (std::streamsize)(to - from));
+	}
+
+#if !defined(_WIN32)
+	// Cache file names are plain ASCII; anything else is not worth a locale here.
+	std::string NarrowPath(const std::wstring& path)
+	{
+		return std::string(path.begin(), path.end());
+	}
+#endif
+
+	bool OpenForWrite(std::ofstream& fout, const std::wstring& path)
+	{
+#if defined(_WIN32)
+		fout.open(path.c_str(), std::ios::binary | std::ios::trunc);
+#else
+		fout.open(NarrowPath(path).c_str(), std::ios::binary | std::ios::trunc);
+#endif
+		return fout.is_open();
+	}
+
+	bool ReplaceFile(const std::wstring& from, const std::wstring& to)
+	{
+#if defined(_WIN32)
+		return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(NarrowPath(from).c_str(), NarrowPath(to).c_str()) == 0;
+#endif
+	}
+
+	void RemoveFile(const std::wstring& path)
+	{
+#if defined(_WIN32)
+		DeleteFileW(path.c_str());
+#else
+		std::remove(NarrowPath(path).c_str());
+#endif
+	}
+
+	// Whether [offset, offset + byteSize) lies inside a file of fileSize bytes.
+	bool InRange(std::uint64_t offset, std::uint64_t byteSize, std::uint64_t fileSize)
+	{
+		return offset <= fileSize && byteSize <= fileSize - offset;
+	}
+}
+
+void MeshCacheKey::Add(const void* data, std::size_t byteSize)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for(std::size_t i = 0; i < byteSize; ++i)
+	{
+		mHash ^= bytes[i];
+		mHash *= 1099511628211ull;
+	}
+}
+
+void MeshCacheKey::Add(const std::string& text)
+{
+	// The length first, so that ("ab", "c") and ("a", "bc") differ.
+	Add((std::uint32_t)text.size());
+	Add(text.data(), text.size());
+}
+
+void MeshCacheKey::Add(std::uint32_t value)
+{
+	Add(&value, sizeof(value));
+}
+
+bool WriteMeshCache(const std::wstring& path, const MeshCacheContents& contents)
+{
+	//
+	// Lay the file out.
+	//
+
+	std::string names;
+	std::vector<MeshCacheFileSubmesh> submeshes(contents.Submeshes.size());
+	for(std::size_t s = 0; s < submeshes.size(); ++s)
+	{
+		const MeshCacheSubmesh& src = contents.Submeshes[s];
+		MeshCacheFileSubmesh& dst = submeshes[s];
+
+		dst.NameOffset = (std::uint32_t)names.size();
+		dst.NameLength = (std::uint32_t)src.Name.size();
+		names += src.Name;
+
+		dst.IndexCount = src.IndexCount;
+		dst.StartIndexLocation = src.StartIndexLocation;
+		dst.BaseVertexLocation = src.BaseVertexLocation;
+		dst.BoundsCenter = src.Bounds.Center;
+		dst.BoundsExtents = src.Bounds.Extents;
+		dst.SphereCenter = src.Sphere.Center;
+		dst.SphereRadius = src.Sphere.Radius;
+		dst.LodError = src.LodError;
+	}
+
+	const std::uint64_t tableEnd = sizeof(MeshCacheHeader) +
+		submeshes.size()*sizeof(MeshCacheFileSubmesh) + names.size();
+
+	MeshCacheHeader header = {};
+	header.Magic = MeshCacheMagic;
+	header.Version = MeshCacheVersion;
+	header.Key = contents.Key;
+	header.VertexByteStride = contents.VertexByteStride;
+	header.IndexStride = contents.IndexStride;
+	header.SubmeshCount = (std::uint32_t)submeshes.size();
+	header.NameByteSize = (std::uint32_t)names.size();
+	header.VertexBufferOffset = AlignUp(tableEnd);
+	header.VertexBufferByteSize = contents.VertexBufferByteSize;
+	header.IndexBufferOffset = AlignUp(header.VertexBufferOffset + contents.VertexBufferByteSize);
+	header.IndexBufferByteSize = contents.IndexBufferByteSize;
+	header.FileSize = header.IndexBufferOffset + contents.IndexBufferByteSize;
+
+	//
+	// Write it next to the destination and move it into place when complete, so a
+	// crash or a full disk never leaves a truncated file under the real name.
+	//
+
+	const std::wstring tempPath = path + L".tmp";
+	{
+		std::ofstream fout;
+		if(!OpenForWrite(fout, tempPath))
+			return false;
+
+		fout.write((const char*)&header, sizeof(header));
+		fout.write((const char*)submeshes.data(), (std::streamsize)(submeshes.size()*sizeof(MeshCacheFileSubmesh)));
+		fout.write(names.data(), (std::streamsize)names.size());
+
+		WritePadding(fout, tableEnd, header.VertexBufferOffset);
+		fout.write((const char*)contents.Vertices, contents.VertexBufferByteSize);
+
+		WritePadding(fout, header.VertexBufferOffset + contents.VertexBufferByteSize, header.IndexBufferOffset);
+		fout.write((const char*)contents.Indices, contents.IndexBufferByteSize);
+
+		fout.close();
+		if(fout.fail())
+		{
+			RemoveFile(tempPath);
+			return false;
+		}
+	}
+
+	if(!ReplaceFile(tempPath, path))
+	{
+		RemoveFile(tempPath);
+		return false;
+	}
+
+	return true;
+}
+
+bool ParseMeshCache(const void* data, std::size_t size, std::uint64_t key, MeshCacheContents& contents)
+{
+	if(size < sizeof(MeshCacheHeader))
+		return false;
+
+	const char* bytes = (const char*)data;
+	const MeshCacheHeader& header = *(const MeshCacheHeader*)bytes;
+
+	if(header.Magic != MeshCacheMagic || header.Version != MeshCacheVersion ||
+		header.Key != key || header.FileSize != size)
+		return false;
+
+	if(header.VertexByteStride == 0 || (header.IndexStride != 2 && header.IndexStride != 4))
+		return false;
+
+	const std::uint64_t tableByteSize = (std::uint64_t)header.SubmeshCount*sizeof(MeshCacheFileSubmesh);
+	if(!InRange(sizeof(MeshCacheHeader), tableByteSize + header.NameByteSize, size))
+		return false;
+
+	if(header.VertexBufferOffset % MeshCacheAlignment != 0 || header.IndexBufferOffset % MeshCacheAlignment != 0 ||
+		!InRange(header.VertexBufferOffset, header.VertexBufferByteSize, size) ||
+		!InRange(header.IndexBufferOffset, header.IndexBufferByteSize, size) ||
+		header.VertexBufferByteSize % header.VertexByteStride != 0 ||
+		header.IndexBufferByteSize % header.IndexStride != 0)
+		return false;
+
+	const std::uint64_t vertexCount = header.VertexBufferByteSize / header.VertexByteStride;
+	const std::uint64_t indexCount = header.IndexBufferByteSize / header.IndexStride;
+
+	const MeshCacheFileSubmesh* submeshes = (const MeshCacheFileSubmesh*)(bytes + sizeof(MeshCacheHeader));
+	const char* names = bytes + sizeof(MeshCacheHeader) + tableByteSize;
+
+	std::vector<MeshCacheSubmesh> parsed(header.SubmeshCount);
+	for(std::uint32_t s = 0; s < header.SubmeshCount; ++s)
+	{
+		const MeshCacheFileSubmesh& src = submeshes[s];
+
+		if(!InRange(src.NameOffset, src.NameLength, header.NameByteSize) ||
+			!InRange(src.StartIndexLocation, src.IndexCount, indexCount) ||
+			src.BaseVertexLocation < 0 || (std::uint64_t)src.BaseVertexLocation > vertexCount)
+			return false;
+
+		MeshCacheSubmesh& dst = parsed[s];
+		dst.Name.assign(names + src.NameOffset, src.NameLength);
+		dst.IndexCount = src.IndexCount;
+		dst.StartIndexLocation = src.StartIndexLocation;
+		dst.BaseVertexLocation = src.BaseVertexLocation;
+		dst.Bounds = BoundingBox(src.BoundsCenter, src.BoundsExtents);
+		dst.Sphere = BoundingSphere(src.SphereCenter, src.SphereRadius);
+		dst.LodError = src.LodError;
+	}
+
+	contents.Key = header.Key;
+	contents.VertexByteStride = header.VertexByteStride;
+	contents.IndexStride = header.IndexStride;
+	contents.Vertices = bytes + header.VertexBufferOffset;
+	contents.VertexBufferByteSize = header.VertexBufferByteSize;
+	contents.Indices = bytes + header.IndexBufferOffset;
+	contents.IndexBufferByteSize = header.IndexBufferByteSize;
+	contents.Submeshes.swap(parsed);
+
+	return true;
+}
+
+MappedMeshCache::~MappedMeshCache()
+{
+	Close();
+}
+
+bool MappedMeshCache::Open(const std::wstring& path, std::uint64_t key)
+{
+	Close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0 || (std::uint64_t)fileSize.QuadPart > SIZE_MAX)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// The view keeps the mapping, and the mapping the file, open.
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if(mapping == nullptr)
+		return false;
+
+	mView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(mView == nullptr)
+		return false;
+
+	mSize = (std::size_t)fileSize.QuadPart;
+#else
+	int file = open(NarrowPath(path).c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+
+	struct stat status;
+	if(fstat(file, &status) != 0 || status.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (std::size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if(view == MAP_FAILED)
+		return false;
+
+	mView = view;
+	mSize = (std::size_t)status.st_size;
+#endif
+
+	if(!ParseMeshCache(mView, mSize, key, mContents))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedMeshCache::Close()
+{
+	if(mView != nullptr)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(mView);
+#else
+		munmap(mView, mSize);
+#endif
+	}
+
+	mView = nullptr;
+	mSize = 0;
+	mContents = MeshCacheContents();
+}
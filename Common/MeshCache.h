@@ -0,0 +1,154 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// A compact binary file holding one finished mesh batch, so generated geometry can be
+// saved once and memory-mapped on later runs instead of being generated again:
+//
+//   MeshCacheHeader
+//   MeshCacheFileSubmesh[SubmeshCount]
+//   submesh names (not null terminated)
+//   vertex buffer, aligned to MeshCacheAlignment
+//   index buffer, aligned to MeshCacheAlignment
+//
+// The header carries a format version and a 64-bit key that identifies what produced
+// the contents (see MeshCacheKey).  A file whose version, key or layout does not check
+// out is treated as missing.  Data is stored in the machine's byte order.
+//
+// Only standard C++ and the OS file mapping calls are used, so this builds without
+// Direct3D; MeshBatchBuilder turns the contents into a MeshGeometry.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXCollision.h>
+
+// Bump when the file layout changes.
+const std::uint32_t MeshCacheVersion = 2;
+
+// The vertex and index buffers start on a boundary of this many bytes.
+const std::uint32_t MeshCacheAlignment = 64;
+
+#pragma pack(push, 4)
+
+struct MeshCacheHeader
+{
+	std::uint32_t Magic;
+	std::uint32_t Version;
+	std::uint64_t Key;
+	std::uint64_t FileSize;
+
+	std::uint32_t VertexByteStride;
+	std::uint32_t IndexStride;
+	std::uint32_t SubmeshCount;
+	std::uint32_t NameByteSize;
+
+	std::uint64_t VertexBufferOffset;
+	std::uint64_t IndexBufferOffset;
+	std::uint32_t VertexBufferByteSize;
+	std::uint32_t IndexBufferByteSize;
+};
+
+struct MeshCacheFileSubmesh
+{
+	std::uint32_t NameOffset;
+	std::uint32_t NameLength;
+
+	std::uint32_t IndexCount;
+	std::uint32_t StartIndexLocation;
+	std::int32_t BaseVertexLocation;
+
+	DirectX::XMFLOAT3 BoundsCenter;
+	DirectX::XMFLOAT3 BoundsExtents;
+	DirectX::XMFLOAT3 SphereCenter;
+	float SphereRadius;
+
+	float LodError;
+};
+
+#pragma pack(pop)
+
+struct MeshCacheSubmesh
+{
+	std::string Name;
+
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+
+	DirectX::BoundingBox Bounds;
+	DirectX::BoundingSphere Sphere;
+
+	float LodError = 0.0f;
+};
+
+// Everything a cache file holds.  The buffers point into memory owned by whoever filled
+// this in: the caller when writing, the MappedMeshCache when reading.
+struct MeshCacheContents
+{
+	std::uint64_t Key = 0;
+
+	std::uint32_t VertexByteStride = 0;
+	std::uint32_t IndexStride = 0;
+
+	const void* Vertices = nullptr;
+	std::uint32_t VertexBufferByteSize = 0;
+
+	const void* Indices = nullptr;
+	std::uint32_t IndexBufferByteSize = 0;
+
+	std::vector<MeshCacheSubmesh> Submeshes;
+};
+
+// 64-bit FNV-1a over everything that decides a cache file's contents.
+class MeshCacheKey
+{
+public:
+	void Add(const void* data, std::size_t byteSize);
+	void Add(const std::string& text);
+	void Add(std::uint32_t value);
+
+	std::uint64_t Value()const { return mHash; }
+
+private:
+	std::uint64_t mHash = 14695981039346656037ull;
+};
+
+///<summary>
+/// Writes contents to path, replacing any existing file only once the new one is
+/// complete.  Returns false if the file could not be written; a cache is only an
+/// optimization, so callers are free to carry on.
+///</summary>
+bool WriteMeshCache(const std::wstring& path, const MeshCacheContents& contents);
+
+///<summary>
+/// Checks that the size bytes at data hold a cache file for key, and if so fills in
+/// contents to point into data.  Every offset and range is validated, so a truncated
+/// or corrupt file is rejected rather than read out of bounds.
+///</summary>
+bool ParseMeshCache(const void* data, std::size_t size, std::uint64_t key, MeshCacheContents& contents);
+
+// A cache file mapped read-only into memory for as long as this object lives.
+class MappedMeshCache
+{
+public:
+	MappedMeshCache() = default;
+	MappedMeshCache(const MappedMeshCache& rhs) = delete;
+	MappedMeshCache& operator=(const MappedMeshCache& rhs) = delete;
+	~MappedMeshCache();
+
+	// Maps path and parses it against key.  Returns false, with nothing left mapped,
+	// if the file is missing, stale or malformed.
+	bool Open(const std::wstring& path, std::uint64_t key);
+	void Close();
+
+	const MeshCacheContents& Contents()const { return mContents; }
+
+private:
+	void* mView = nullptr;
+	std::size_t mSize = 0;
+	MeshCacheContents mContents;
+};
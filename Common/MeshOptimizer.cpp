@@ -0,0 +1,321 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	stats.TriangleCount = (std::uint32_t)(indexCount / 3);
+
+	const std::size_t usedCount = (std::size_t)stats.TriangleCount*3;
+
+	// A FIFO cache only moves on a miss, so the miss count is its clock: an entry
+	// added at miss m is still cached until miss m + cacheSize.
+	const std::uint32_t NotCached = ~0u;
+	std::vector<std::uint32_t> addedAt(vertexCount, NotCached);
+	std::vector<bool> referenced(vertexCount, false);
+
+	for(std::size_t k = 0; k < usedCount; ++k)
+	{
+		const std::uint32_t v = indices[k];
+		assert(v < vertexCount);
+
+		if(!referenced[v])
+		{
+			referenced[v] = true;
+			++stats.VertexCount;
+		}
+
+		if(addedAt[v] == NotCached || stats.TransformCount - addedAt[v] >= cacheSize)
+		{
+			addedAt[v] = stats.TransformCount;
+			++stats.TransformCount;
+		}
+	}
+
+	if(stats.TriangleCount > 0)
+	{
+		stats.Acmr = (float)stats.TransformCount / stats.TriangleCount;
+		stats.Atvr = (float)stats.TransformCount / stats.VertexCount;
+	}
+
+	return stats;
+}
+
+VertexCacheStats AnalyzeVertexCache(const GeometryGenerator::MeshData& mesh, std::uint32_t cacheSize)
+{
+	return AnalyzeVertexCache(mesh.Indices32.data(), mesh.Indices32.size(),
+		(std::uint32_t)mesh.Vertices.size(), cacheSize);
+}
+
+std::vector<std::uint32_t> OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize)
+{
+	std::vector<std::uint32_t> clusters;
+
+	const std::uint32_t triCount = (std::uint32_t)(indexCount / 3);
+	if(triCount == 0)
+		return clusters;
+
+	//
+	// Vertex -> triangle adjacency, and the number of triangles still to be emitted
+	// around each vertex.
+	//
+
+	std::vector<std::uint32_t> live(vertexCount, 0);
+	for(std::uint32_t k = 0; k < triCount*3; ++k)
+	{
+		assert(indices[k] < vertexCount);
+		++live[indices[k]];
+	}
+
+	std::vector<std::uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + live[v];
+
+	std::vector<std::uint32_t> adjacency(triCount*3);
+	{
+		std::vector<std::uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for(std::uint32_t k = 0; k < triCount*3; ++k)
+			adjacency[cursor[indices[k]]++] = k / 3;
+	}
+
+	//
+	// Tipsify.  Fan around one vertex at a time, emitting all its remaining triangles,
+	// then continue from the neighbour that will still be in the cache after its own
+	// fan.  Time stamps count cache insertions; a vertex is cached while
+	// time - stamp <= cacheSize.
+	//
+
+	std::vector<std::uint32_t> timeStamps(vertexCount, 0);
+	std::vector<bool> emitted(triCount, false);
+	std::vector<std::uint32_t> deadEnds;
+	std::vector<std::uint32_t> candidates;
+	std::vector<std::uint32_t> output;
+	deadEnds.reserve(triCount*3);
+	output.reserve(triCount*3);
+
+	std::uint32_t time = cacheSize + 1;
+	std::uint32_t scan = 0;
+
+	// Most recently used vertex that still has triangles, else the next one in
+	// index order.  Either way the cache is (mostly) cold, so a cluster starts here.
+	auto skipDeadEnd = [&]() -> std::int64_t
+	{
+		while(!deadEnds.empty())
+		{
+			std::uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if(live[v] > 0)
+				return v;
+		}
+
+		for(; scan < vertexCount; ++scan)
+		{
+			if(live[scan] > 0)
+				return scan;
+		}
+
+		return -1;
+	};
+
+	std::int64_t fan = skipDeadEnd();
+	clusters.push_back(0);
+
+	while(fan >= 0)
+	{
+		candidates.clear();
+
+		for(std::uint32_t a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; ++a)
+		{
+			const std::uint32_t t = adjacency[a];
+			if(emitted[t])
+				continue;
+
+			for(std::uint32_t c = 0; c < 3; ++c)
+			{
+				const std::uint32_t v = indices[t*3 + c];
+
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+
+				if(time - timeStamps[v] > cacheSize)
+					timeStamps[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// Prefer the candidate that has been in the cache longest but will survive
+		// emitting its own fan (each new triangle adds at most two vertices).
+		std::int64_t next = -1;
+		std::int64_t bestPriority = -1;
+		for(std::uint32_t v : candidates)
+		{
+			if(live[v] == 0)
+				continue;
+
+			std::int64_t priority = 0;
+			if(time - timeStamps[v] + 2*live[v] <= cacheSize)
+				priority = time - timeStamps[v];
+
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if(next < 0)
+		{
+			next = skipDeadEnd();
+			if(next >= 0)
+				clusters.push_back((std::uint32_t)(output.size() / 3));
+		}
+
+		fan = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+
+	return clusters;
+}
+
+void OptimizeOverdraw(GeometryGenerator::MeshData& mesh, const std::vector<std::uint32_t>& clusters)
+{
+	const std::uint32_t triCount = (std::uint32_t)(mesh.Indices32.size() / 3);
+	if(clusters.size() < 2 || triCount == 0)
+		return;
+
+	const std::uint32_t* indices = mesh.Indices32.data();
+	const std::size_t clusterCount = clusters.size();
+
+	auto clusterEnd = [&](std::size_t c)
+	{
+		return c + 1 < clusterCount ? clusters[c + 1] : triCount;
+	};
+
+	// Area-weighted centroid and normal of each cluster, and of the whole mesh.
+	std::vector<XMFLOAT3> centroids(clusterCount);
+	std::vector<XMFLOAT3> normals(clusterCount);
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+
+	for(std::size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for(std::uint32_t t = clusters[c]; t < clusterEnd(c); ++t)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&mesh.Vertices[indices[t*3+0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&mesh.Vertices[indices[t*3+1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&mesh.Vertices[indices[t*3+2]].Position);
+
+			// Twice the area, pointing out of the front (clockwise) face.
+			XMVECTOR n = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+			float a = XMVectorGetX(XMVector3Length(n));
+
+			normal = XMVectorAdd(normal, n);
+			centroid = XMVectorAdd(centroid, XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), a / 3.0f));
+			area += a;
+		}
+
+		meshCentroid = XMVectorAdd(meshCentroid, centroid);
+		meshArea += area;
+
+		if(area > 0.0f)
+			centroid = XMVectorScale(centroid, 1.0f / area);
+
+		XMStoreFloat3(&centroids[c], centroid);
+		XMStoreFloat3(&normals[c], normal);
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid = XMVectorScale(meshCentroid, 1.0f / meshArea);
+
+	// Clusters that sit out along their own normal occlude the rest more often than
+	// they are occluded, so they go first.
+	std::vector<float> keys(clusterCount);
+	for(std::size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&centroids[c]), meshCentroid);
+		XMVECTOR normal = XMVector3Normalize(XMLoadFloat3(&normals[c]));
+		keys[c] = XMVectorGetX(XMVector3Dot(offset, normal));
+	}
+
+	std::vector<std::uint32_t> order(clusterCount);
+	for(std::size_t c = 0; c < clusterCount; ++c)
+		order[c] = (std::uint32_t)c;
+
+	std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		return keys[a] > keys[b];
+	});
+
+	std::vector<std::uint32_t> reordered;
+	reordered.reserve(mesh.Indices32.size());
+	for(std::uint32_t c : order)
+		reordered.insert(reordered.end(), indices + clusters[c]*3, indices + clusterEnd(c)*3);
+
+	// Any trailing partial triangle stays at the end.
+	reordered.insert(reordered.end(), mesh.Indices32.begin() + triCount*3, mesh.Indices32.end());
+
+	mesh.Indices32.swap(reordered);
+}
+
+void OptimizeVertexFetch(GeometryGenerator::MeshData& mesh)
+{
+	const std::uint32_t vertexCount = (std::uint32_t)mesh.Vertices.size();
+	const std::uint32_t Unassigned = ~0u;
+
+	std::vector<std::uint32_t> remap(vertexCount, Unassigned);
+	std::uint32_t next = 0;
+
+	for(std::uint32_t& index : mesh.Indices32)
+	{
+		// Only a trailing partial triangle, which is never drawn, can be out of range.
+		if(index >= vertexCount)
+			continue;
+
+		if(remap[index] == Unassigned)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+	{
+		if(remap[v] == Unassigned)
+			remap[v] = next++;
+	}
+
+	std::vector<GeometryGenerator::Vertex> vertices(vertexCount);
+	for(std::uint32_t v = 0; v < vertexCount; ++v)
+		vertices[remap[v]] = mesh.Vertices[v];
+
+	mesh.Vertices.swap(vertices);
+}
+
+MeshOptimizeReport OptimizeMesh(GeometryGenerator::MeshData& mesh, std::uint32_t cacheSize)
+{
+	MeshOptimizeReport report;
+	report.Before = AnalyzeVertexCache(mesh, cacheSize);
+
+	std::vector<std::uint32_t> clusters = OptimizeVertexCache(mesh.Indices32.data(), mesh.Indices32.size(),
+		(std::uint32_t)mesh.Vertices.size(), cacheSize);
+	OptimizeOverdraw(mesh, clusters);
+	OptimizeVertexFetch(mesh);
+
+	report.After = AnalyzeVertexCache(mesh, cacheSize);
+	return report;
+}
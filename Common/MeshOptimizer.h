@@ -0,0 +1,86 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// CPU-side reordering of indexed triangle lists for the GPU, applied to a MeshData
+// before it is uploaded:
+//
+//   OptimizeVertexCache - Tipsify triangle order (Sander, Nehab and Barczak 2007) so
+//                         the post-transform cache re-uses recently shaded vertices.
+//   OptimizeOverdraw    - reorders the clusters Tipsify leaves behind so that those
+//                         facing away from the mesh center draw first, leaving the order
+//                         inside each cluster (and so the cache behaviour) alone.
+//   OptimizeVertexFetch - renumbers vertices in first-use order so the vertex fetch
+//                         walks the vertex buffer front to back.
+//   AnalyzeVertexCache  - ACMR / ATVR of a FIFO cache simulation, to measure the above.
+//
+// OptimizeMesh runs the three passes in that order.  Only standard C++ is used, so
+// everything here runs and can be checked without a GPU.
+//
+// The passes rewrite Indices32 (and OptimizeVertexFetch the vertex order), so run them
+// before the first call to MeshData::GetIndices16(), which caches its conversion.
+//
+// Every index of a whole triangle must be below the vertex count; the passes index
+// per-vertex tables with them and only check that in debug builds.  A trailing partial
+// triangle, which is never drawn, may hold anything.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+struct VertexCacheStats
+{
+	std::uint32_t TriangleCount = 0;
+
+	// Distinct vertices the triangles reference.
+	std::uint32_t VertexCount = 0;
+
+	// Cache misses, i.e. vertex shader invocations.
+	std::uint32_t TransformCount = 0;
+
+	// Average cache miss ratio: transforms per triangle.  3 is the worst case; a large
+	// regular mesh can approach 0.5.
+	float Acmr = 0.0f;
+
+	// Average transform to vertex ratio: transforms per referenced vertex.  1 is ideal.
+	float Atvr = 0.0f;
+};
+
+struct MeshOptimizeReport
+{
+	VertexCacheStats Before;
+	VertexCacheStats After;
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the triangle list.
+// Trailing indices that do not form a whole triangle are ignored.
+VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize = 16);
+VertexCacheStats AnalyzeVertexCache(const GeometryGenerator::MeshData& mesh, std::uint32_t cacheSize = 16);
+
+///<summary>
+/// Reorders the triangles in place with Tipsify for a cache of cacheSize entries and
+/// returns the first triangle of each cluster: the points where the walk hit a dead
+/// end and had to jump to a vertex that is not in the cache.  The first cluster always
+/// starts at 0.  Trailing indices that do not form a whole triangle are left in place.
+///</summary>
+std::vector<std::uint32_t> OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount,
+	std::uint32_t vertexCount, std::uint32_t cacheSize = 16);
+
+///<summary>
+/// Reorders the clusters returned by OptimizeVertexCache, outward-facing first, so
+/// the far side of a convex-ish mesh is more often rejected by the depth test.
+///</summary>
+void OptimizeOverdraw(GeometryGenerator::MeshData& mesh, const std::vector<std::uint32_t>& clusters);
+
+///<summary>
+/// Renumbers the vertices in the order the index buffer first uses them.  Vertices no
+/// triangle references keep their relative order after all the referenced ones.
+///</summary>
+void OptimizeVertexFetch(GeometryGenerator::MeshData& mesh);
+
+// All three passes, with the cache statistics before and after.
+MeshOptimizeReport OptimizeMesh(GeometryGenerator::MeshData& mesh, std::uint32_t cacheSize = 16);
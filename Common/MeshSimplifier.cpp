@@ -0,0 +1,668 @@
+//***************************************************************************************
+// MeshSimplifier.cpp
+//***************************************************************************************
+
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <unordered_map>
+
+using namespace DirectX;
+
+namespace
+{
+	// Open borders are held in place by planes through each border edge, perpendicular
+	// to its triangle, weighted this much more than the surface per unit of length^2.
+	const double BorderWeight = 10.0;
+
+	// Positions closer than this fraction of the mesh's largest extent are welded.
+	const float WeldTolerance = 1e-5f;
+
+	const std::uint32_t NoVertex = ~0u;
+
+	// Sum of weighted squared distances to a set of planes:
+	// Q(x) = x^T A x + 2 b.x + c, with the total weight kept to normalize the error.
+	struct Quadric
+	{
+		double A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+		double B0 = 0.0, B1 = 0.0, B2 = 0.0;
+		double C = 0.0;
+		double Weight = 0.0;
+
+		// Plane n.x + d = 0 with unit normal n.
+		void AddPlane(double nx, double ny, double nz, double d, double w)
+		{
+			A00 += w*nx*nx; A01 += w*nx*ny; A02 += w*nx*nz;
+			A11 += w*ny*ny; A12 += w*ny*nz; A22 += w*nz*nz;
+			B0 += w*nx*d; B1 += w*ny*d; B2 += w*nz*d;
+			C += w*d*d;
+			Weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			A00 += q.A00; A01 += q.A01; A02 += q.A02;
+			A11 += q.A11; A12 += q.A12; A22 += q.A22;
+			B0 += q.B0; B1 += q.B1; B2 += q.B2;
+			C += q.C;
+			Weight += q.Weight;
+		}
+
+		double Evaluate(const XMFLOAT3& p)const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			return A00*x*x + A11*y*y + A22*z*z + 2.0*(A01*x*y + A02*x*z + A12*y*z) +
+				2.0*(B0*x + B1*y + B2*z) + C;
+		}
+	};
+
+	struct Double3
+	{
+		double X, Y, Z;
+	};
+
+	Double3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return { (double)a.x - b.x, (double)a.y - b.y, (double)a.z - b.z };
+	}
+
+	Double3 Cross(const Double3& a, const Double3& b)
+	{
+		return { a.Y*b.Z - a.Z*b.Y, a.Z*b.X - a.X*b.Z, a.X*b.Y - a.Y*b.X };
+	}
+
+	double Dot(const Double3& a, const Double3& b)
+	{
+		return a.X*b.X + a.Y*b.Y + a.Z*b.Z;
+	}
+
+	// Twice the area, along the triangle's normal.
+	Double3 TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+	{
+		return Cross(Subtract(p1, p0), Subtract(p2, p0));
+	}
+
+	std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+	{
+		return a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+	}
+
+	struct Collapse
+	{
+		std::uint32_t From;
+		std::uint32_t To;
+		float Error;
+	};
+
+	///<summary>
+	/// Progressive simplifier over one source mesh.  Works on welded positions: each
+	/// distinct position has one quadric, and a collapse moves all the vertices at the
+	/// removed position onto their counterparts at the kept one.
+	///
+	/// Each pass picks the cheapest collapses that do not touch one another, so the
+	/// adjacency built at the start of the pass stays valid while they are applied.
+	///</summary>
+	class QuadricSimplifier
+	{
+	public:
+		explicit QuadricSimplifier(const GeometryGenerator::MeshData& mesh);
+
+		void Simplify(std::uint32_t targetTriangleCount);
+
+		std::uint32_t TriangleCount()const { return (std::uint32_t)(mIndices.size() / 3); }
+		float Error()const { return mError; }
+
+		void Extract(GeometryGenerator::MeshData& mesh)const;
+
+	private:
+		bool RunPass(std::uint32_t targetTriangleCount);
+		std::uint32_t TryCollapse(std::uint32_t from, std::uint32_t to);
+
+		std::uint32_t Corner(std::uint32_t t, std::uint32_t position)const;
+
+	private:
+		const std::vector<GeometryGenerator::Vertex>& mVertices;
+
+		// Per vertex.
+		std::vector<std::uint32_t> mPositionIds;
+		std::vector<std::uint32_t> mRemap;
+
+		// Per welded position.
+		std::vector<XMFLOAT3> mPositions;
+		std::vector<Quadric> mQuadrics;
+		std::vector<bool> mLocked;
+
+		// Position -> triangle adjacency for the current pass.
+		std::vector<std::uint32_t> mAdjacencyOffsets;
+		std::vector<std::uint32_t> mAdjacency;
+
+		// Position edges of the current pass, sorted, and how many triangles use each.
+		std::vector<std::uint64_t> mEdges;
+		std::vector<std::uint32_t> mEdgeUses;
+		std::vector<bool> mBorder;
+
+		// Scratch space for TryCollapse.
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> mPairs;
+		std::vector<std::uint32_t> mFromNeighbours;
+		std::vector<std::uint32_t> mToNeighbours;
+
+		std::vector<std::uint32_t> mIndices;
+		float mError = 0.0f;
+	};
+
+	QuadricSimplifier::QuadricSimplifier(const GeometryGenerator::MeshData& mesh) :
+		mVertices(mesh.Vertices)
+	{
+		const std::uint32_t vertexCount = (std::uint32_t)mVertices.size();
+		const std::size_t triCount = mesh.Indices32.size() / 3;
+
+		mIndices.assign(mesh.Indices32.begin(), mesh.Indices32.begin() + triCount*3);
+		mRemap.assign(vertexCount, NoVertex);
+
+		//
+		// Weld vertices that share a position.  Generators compute the two sides of a
+		// texture seam separately (cos(0) and cos(2*pi), say), so positions within a
+		// tiny fraction of the mesh size count as the same; otherwise every seam would
+		// look like an open border.  Candidates are found through a hash of grid cells
+		// one tolerance wide, checking the 27 cells around each vertex.
+		//
+
+		XMFLOAT3 vMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 vMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for(const GeometryGenerator::Vertex& vertex : mVertices)
+		{
+			const XMFLOAT3& p = vertex.Position;
+			vMin = XMFLOAT3(std::min(vMin.x, p.x), std::min(vMin.y, p.y), std::min(vMin.z, p.z));
+			vMax = XMFLOAT3(std::max(vMax.x, p.x), std::max(vMax.y, p.y), std::max(vMax.z, p.z));
+		}
+
+		const float extent = std::max(std::max(vMax.x - vMin.x, vMax.y - vMin.y), vMax.z - vMin.z);
+		const float tolerance = std::max(extent*WeldTolerance, FLT_MIN);
+
+		auto cellOf = [&](float x, float minimum) { return (std::int64_t)std::floor((x - minimum) / tolerance); };
+		auto cellKey = [](std::int64_t x, std::int64_t y, std::int64_t z)
+		{
+			return ((std::uint64_t)(x & 0x1FFFFF) << 42) | ((std::uint64_t)(y & 0x1FFFFF) << 21) | (std::uint64_t)(z & 0x1FFFFF);
+		};
+
+		// Cell -> first position in it; further ones are chained through nextInCell.
+		std::unordered_map<std::uint64_t, std::uint32_t> cells;
+		std::vector<std::uint32_t> nextInCell;
+
+		mPositionIds.resize(vertexCount);
+		for(std::uint32_t v = 0; v < vertexCount; ++v)
+		{
+			const XMFLOAT3& p = mVertices[v].Position;
+			const std::int64_t cx = cellOf(p.x, vMin.x);
+			const std::int64_t cy = cellOf(p.y, vMin.y);
+			const std::int64_t cz = cellOf(p.z, vMin.z);
+
+			std::uint32_t id = NoVertex;
+			for(std::int64_t dx = -1; dx <= 1 && id == NoVertex; ++dx)
+			for(std::int64_t dy = -1; dy <= 1 && id == NoVertex; ++dy)
+			for(std::int64_t dz = -1; dz <= 1 && id == NoVertex; ++dz)
+			{
+				auto cell = cells.find(cellKey(cx + dx, cy + dy, cz + dz));
+				if(cell == cells.end())
+					continue;
+
+				for(std::uint32_t q = cell->second; q != NoVertex; q = nextInCell[q])
+				{
+					const Double3 d = Subtract(mPositions[q], p);
+					if(Dot(d, d) <= (double)tolerance*tolerance)
+					{
+						id = q;
+						break;
+					}
+				}
+			}
+
+			if(id == NoVertex)
+			{
+				id = (std::uint32_t)mPositions.size();
+				mPositions.push_back(p);
+
+				auto inserted = cells.insert(std::make_pair(cellKey(cx, cy, cz), id));
+				nextInCell.push_back(inserted.second ? NoVertex : inserted.first->second);
+				inserted.first->second = id;
+			}
+
+			mPositionIds[v] = id;
+		}
+
+		// Triangles that welded into a line or a point have nothing to collapse.
+		std::size_t write = 0;
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			const std::uint32_t p0 = mPositionIds[mIndices[t*3+0]];
+			const std::uint32_t p1 = mPositionIds[mIndices[t*3+1]];
+			const std::uint32_t p2 = mPositionIds[mIndices[t*3+2]];
+			if(p0 == p1 || p1 == p2 || p0 == p2)
+				continue;
+
+			mIndices[write++] = mIndices[t*3+0];
+			mIndices[write++] = mIndices[t*3+1];
+			mIndices[write++] = mIndices[t*3+2];
+		}
+		mIndices.resize(write);
+
+		//
+		// Plane quadrics of the original surface, weighted by triangle area.
+		//
+
+		mQuadrics.resize(mPositions.size());
+
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> edgeTriangles;
+		edgeTriangles.reserve(mIndices.size());
+
+		for(std::uint32_t t = 0; t < TriangleCount(); ++t)
+		{
+			const std::uint32_t p[3] = { mPositionIds[mIndices[t*3+0]], mPositionIds[mIndices[t*3+1]], mPositionIds[mIndices[t*3+2]] };
+
+			Double3 n = TriangleNormal(mPositions[p[0]], mPositions[p[1]], mPositions[p[2]]);
+			const double length = std::sqrt(Dot(n, n));
+			if(length == 0.0)
+				continue;
+
+			n = { n.X / length, n.Y / length, n.Z / length };
+			const XMFLOAT3& p0 = mPositions[p[0]];
+			const double d = -(n.X*p0.x + n.Y*p0.y + n.Z*p0.z);
+
+			for(std::uint32_t c = 0; c < 3; ++c)
+			{
+				mQuadrics[p[c]].AddPlane(n.X, n.Y, n.Z, d, 0.5*length);
+				edgeTriangles.push_back(std::make_pair(EdgeKey(p[c], p[(c + 1) % 3]), t));
+			}
+		}
+
+		//
+		// Border planes on every edge that only one triangle uses.
+		//
+
+		std::sort(edgeTriangles.begin(), edgeTriangles.end());
+		for(std::size_t e = 0; e < edgeTriangles.size(); ++e)
+		{
+			const std::uint64_t key = edgeTriangles[e].first;
+			const bool shared = (e > 0 && edgeTriangles[e - 1].first == key) ||
+				(e + 1 < edgeTriangles.size() && edgeTriangles[e + 1].first == key);
+			if(shared)
+				continue;
+
+			const std::uint32_t t = edgeTriangles[e].second;
+			const std::uint32_t a = (std::uint32_t)(key >> 32);
+			const std::uint32_t b = (std::uint32_t)key;
+
+			const Double3 n = TriangleNormal(mPositions[mPositionIds[mIndices[t*3+0]]],
+				mPositions[mPositionIds[mIndices[t*3+1]]], mPositions[mPositionIds[mIndices[t*3+2]]]);
+			const Double3 edge = Subtract(mPositions[b], mPositions[a]);
+
+			Double3 m = Cross(edge, n);
+			const double length = std::sqrt(Dot(m, m));
+			if(length == 0.0)
+				continue;
+
+			m = { m.X / length, m.Y / length, m.Z / length };
+			const XMFLOAT3& pa = mPositions[a];
+			const double d = -(m.X*pa.x + m.Y*pa.y + m.Z*pa.z);
+			const double w = BorderWeight*Dot(edge, edge);
+
+			mQuadrics[a].AddPlane(m.X, m.Y, m.Z, d, w);
+			mQuadrics[b].AddPlane(m.X, m.Y, m.Z, d, w);
+		}
+	}
+
+	void QuadricSimplifier::Simplify(std::uint32_t targetTriangleCount)
+	{
+		while(TriangleCount() > targetTriangleCount && RunPass(targetTriangleCount))
+		{
+		}
+	}
+
+	bool QuadricSimplifier::RunPass(std::uint32_t targetTriangleCount)
+	{
+		const std::uint32_t positionCount = (std::uint32_t)mPositions.size();
+		const std::uint32_t triCount = TriangleCount();
+
+		//
+		// Position -> triangle adjacency, and the edges with their use counts.
+		//
+
+		mAdjacencyOffsets.assign(positionCount + 1, 0);
+		for(std::uint32_t index : mIndices)
+			++mAdjacencyOffsets[mPositionIds[index] + 1];
+		for(std::uint32_t p = 0; p < positionCount; ++p)
+			mAdjacencyOffsets[p + 1] += mAdjacencyOffsets[p];
+
+		mAdjacency.resize(mIndices.size());
+		{
+			std::vector<std::uint32_t> cursor(mAdjacencyOffsets.begin(), mAdjacencyOffsets.end() - 1);
+			for(std::uint32_t k = 0; k < (std::uint32_t)mIndices.size(); ++k)
+				mAdjacency[cursor[mPositionIds[mIndices[k]]]++] = k / 3;
+		}
+
+		std::vector<std::uint64_t> edges(mIndices.size());
+		for(std::uint32_t t = 0; t < triCount; ++t)
+		{
+			for(std::uint32_t c = 0; c < 3; ++c)
+				edges[t*3 + c] = EdgeKey(mPositionIds[mIndices[t*3 + c]], mPositionIds[mIndices[t*3 + (c + 1) % 3]]);
+		}
+		std::sort(edges.begin(), edges.end());
+
+		mEdges.clear();
+		mEdgeUses.clear();
+		for(std::uint64_t key : edges)
+		{
+			if(!mEdges.empty() && mEdges.back() == key)
+				++mEdgeUses.back();
+			else
+			{
+				mEdges.push_back(key);
+				mEdgeUses.push_back(1);
+			}
+		}
+
+		// Edges used once are open borders; edges used more than twice are treated the
+		// same, which keeps non-manifold junctions where they are.
+		mBorder.assign(positionCount, false);
+		for(std::size_t e = 0; e < mEdges.size(); ++e)
+		{
+			if(mEdgeUses[e] != 2)
+			{
+				mBorder[(std::uint32_t)(mEdges[e] >> 32)] = true;
+				mBorder[(std::uint32_t)mEdges[e]] = true;
+			}
+		}
+
+		//
+		// Candidate collapses, both directions of every edge, cheapest first.  A border
+		// position may only move along a border edge.
+		//
+
+		std::vector<Collapse> candidates;
+		candidates.reserve(mEdges.size()*2);
+		for(std::size_t e = 0; e < mEdges.size(); ++e)
+		{
+			const std::uint32_t a = (std::uint32_t)(mEdges[e] >> 32);
+			const std::uint32_t b = (std::uint32_t)mEdges[e];
+			const bool borderEdge = mEdgeUses[e] == 1;
+
+			const std::uint32_t ends[2][2] = { { a, b }, { b, a } };
+			for(const auto& end : ends)
+			{
+				const std::uint32_t from = end[0];
+				const std::uint32_t to = end[1];
+				if(mBorder[from] && !borderEdge)
+					continue;
+
+				const Quadric& q0 = mQuadrics[from];
+				const Quadric& q1 = mQuadrics[to];
+				const double sum = q0.Evaluate(mPositions[to]) + q1.Evaluate(mPositions[to]);
+				const double weight = q0.Weight + q1.Weight;
+
+				Collapse collapse;
+				collapse.From = from;
+				collapse.To = to;
+				collapse.Error = (sum > 0.0 && weight > 0.0) ? (float)std::sqrt(sum / weight) : 0.0f;
+				candidates.push_back(collapse);
+			}
+		}
+
+		if(candidates.empty())
+			return false;
+
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b)
+		{
+			return a.Error < b.Error;
+		});
+
+		// A collapse usually removes two triangles.  Stay within 1.5 times the error of
+		// the collapse that would meet the goal on its own, so one pass doesn't spend
+		// collapses on expensive edges while cheap ones are only blocked by locks.
+		const std::size_t goal = std::max<std::size_t>((triCount - targetTriangleCount) / 2, 1);
+		const float errorLimit = candidates[std::min(goal, candidates.size() - 1)].Error*1.5f;
+
+		//
+		// Apply the non-overlapping ones.
+		//
+
+		mLocked.assign(positionCount, false);
+		std::uint32_t removed = 0;
+		bool collapsed = false;
+
+		for(const Collapse& collapse : candidates)
+		{
+			if(collapse.Error > errorLimit || triCount - removed <= targetTriangleCount)
+				break;
+
+			if(mLocked[collapse.From] || mLocked[collapse.To])
+				continue;
+
+			const std::uint32_t count = TryCollapse(collapse.From, collapse.To);
+			if(count == 0)
+				continue;
+
+			removed += count;
+			collapsed = true;
+			if(collapse.Error > mError)
+				mError = collapse.Error;
+
+			// Everything that shares a triangle with either end has changed.
+			for(std::uint32_t p : { collapse.From, collapse.To })
+			{
+				for(std::uint32_t a = mAdjacencyOffsets[p]; a < mAdjacencyOffsets[p + 1]; ++a)
+				{
+					const std::uint32_t t = mAdjacency[a];
+					for(std::uint32_t c = 0; c < 3; ++c)
+						mLocked[mPositionIds[mIndices[t*3 + c]]] = true;
+				}
+			}
+		}
+
+		if(!collapsed)
+			return false;
+
+		//
+		// Move the collapsed vertices and drop the triangles that became degenerate.
+		//
+
+		std::size_t write = 0;
+		for(std::size_t t = 0; t < mIndices.size() / 3; ++t)
+		{
+			std::uint32_t v[3];
+			for(std::uint32_t c = 0; c < 3; ++c)
+			{
+				v[c] = mIndices[t*3 + c];
+				if(mRemap[v[c]] != NoVertex)
+					v[c] = mRemap[v[c]];
+			}
+
+			const std::uint32_t p0 = mPositionIds[v[0]];
+			const std::uint32_t p1 = mPositionIds[v[1]];
+			const std::uint32_t p2 = mPositionIds[v[2]];
+			if(p0 == p1 || p1 == p2 || p0 == p2)
+				continue;
+
+			mIndices[write++] = v[0];
+			mIndices[write++] = v[1];
+			mIndices[write++] = v[2];
+		}
+		mIndices.resize(write);
+
+		for(std::uint32_t& r : mRemap)
+			r = NoVertex;
+
+		return true;
+	}
+
+	std::uint32_t QuadricSimplifier::Corner(std::uint32_t t, std::uint32_t position)const
+	{
+		for(std::uint32_t c = 0; c < 3; ++c)
+		{
+			if(mPositionIds[mIndices[t*3 + c]] == position)
+				return c;
+		}
+		return 3;
+	}
+
+	std::uint32_t QuadricSimplifier::TryCollapse(std::uint32_t from, std::uint32_t to)
+	{
+		//
+		// Pair every vertex at from with the vertex at to it shares a collapsing
+		// triangle with.  A vertex paired with two different ones sits on a seam the
+		// edge crosses, and one with no partner belongs to faces the edge isn't on; in
+		// both cases moving it would tear the surface.
+		//
+
+		mPairs.clear();
+		std::uint32_t collapsing = 0;
+
+		for(std::uint32_t a = mAdjacencyOffsets[from]; a < mAdjacencyOffsets[from + 1]; ++a)
+		{
+			const std::uint32_t t = mAdjacency[a];
+			const std::uint32_t cTo = Corner(t, to);
+			if(cTo == 3)
+				continue;
+
+			mPairs.push_back(std::make_pair(mIndices[t*3 + Corner(t, from)], mIndices[t*3 + cTo]));
+			++collapsing;
+		}
+
+		if(collapsing == 0)
+			return 0;
+
+		//
+		// Link condition: the only positions next to both ends may be the far corners
+		// of the collapsing triangles.  Any other shared neighbour would end up with two
+		// edges to the same position, which pinches the surface into a non-manifold
+		// edge.
+		//
+
+		auto gatherNeighbours = [this](std::uint32_t p, std::vector<std::uint32_t>& neighbours)
+		{
+			neighbours.clear();
+			for(std::uint32_t a = mAdjacencyOffsets[p]; a < mAdjacencyOffsets[p + 1]; ++a)
+			{
+				const std::uint32_t t = mAdjacency[a];
+				for(std::uint32_t c = 0; c < 3; ++c)
+				{
+					const std::uint32_t q = mPositionIds[mIndices[t*3 + c]];
+					if(q != p)
+						neighbours.push_back(q);
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		};
+
+		gatherNeighbours(from, mFromNeighbours);
+		gatherNeighbours(to, mToNeighbours);
+
+		std::uint32_t shared = 0;
+		for(std::uint32_t q : mFromNeighbours)
+		{
+			if(q != to && std::binary_search(mToNeighbours.begin(), mToNeighbours.end(), q))
+				++shared;
+		}
+
+		if(shared != collapsing)
+			return 0;
+
+		std::sort(mPairs.begin(), mPairs.end());
+		for(std::size_t k = 1; k < mPairs.size(); ++k)
+		{
+			if(mPairs[k].first == mPairs[k - 1].first && mPairs[k].second != mPairs[k - 1].second)
+				return 0;
+		}
+
+		auto partner = [this](std::uint32_t v)
+		{
+			auto it = std::lower_bound(mPairs.begin(), mPairs.end(), std::make_pair(v, 0u));
+			return (it != mPairs.end() && it->first == v) ? it->second : NoVertex;
+		};
+
+		//
+		// The triangles that remain must keep their facing.
+		//
+
+		for(std::uint32_t a = mAdjacencyOffsets[from]; a < mAdjacencyOffsets[from + 1]; ++a)
+		{
+			const std::uint32_t t = mAdjacency[a];
+			if(Corner(t, to) != 3)
+				continue;
+
+			const std::uint32_t cFrom = Corner(t, from);
+			if(partner(mIndices[t*3 + cFrom]) == NoVertex)
+				return 0;
+
+			const XMFLOAT3* p[3];
+			for(std::uint32_t c = 0; c < 3; ++c)
+				p[c] = &mPositions[mPositionIds[mIndices[t*3 + c]]];
+
+			const Double3 before = TriangleNormal(*p[0], *p[1], *p[2]);
+			p[cFrom] = &mPositions[to];
+			const Double3 after = TriangleNormal(*p[0], *p[1], *p[2]);
+
+			if(Dot(before, after) <= 1e-3*std::sqrt(Dot(before, before)*Dot(after, after)))
+				return 0;
+		}
+
+		for(const auto& pair : mPairs)
+			mRemap[pair.first] = pair.second;
+
+		mQuadrics[to].Add(mQuadrics[from]);
+
+		return collapsing;
+	}
+
+	void QuadricSimplifier::Extract(GeometryGenerator::MeshData& mesh)const
+	{
+		std::vector<std::uint32_t> newIndex(mVertices.size(), NoVertex);
+		for(std::uint32_t v : mIndices)
+			newIndex[v] = 0;
+
+		mesh.Vertices.clear();
+		for(std::uint32_t v = 0; v < (std::uint32_t)mVertices.size(); ++v)
+		{
+			if(newIndex[v] != NoVertex)
+			{
+				newIndex[v] = (std::uint32_t)mesh.Vertices.size();
+				mesh.Vertices.push_back(mVertices[v]);
+			}
+		}
+
+		mesh.Indices32.resize(mIndices.size());
+		for(std::size_t k = 0; k < mIndices.size(); ++k)
+			mesh.Indices32[k] = newIndex[mIndices[k]];
+	}
+}
+
+std::vector<MeshLod> BuildLodChain(const GeometryGenerator::MeshData& mesh,
+	const float* triangleRatios, std::size_t ratioCount)
+{
+	std::vector<MeshLod> lods(ratioCount + 1);
+	lods[0].Mesh = mesh;
+
+	QuadricSimplifier simplifier(mesh);
+	const std::uint32_t triCount = simplifier.TriangleCount();
+
+	for(std::size_t l = 0; l < ratioCount; ++l)
+	{
+		simplifier.Simplify((std::uint32_t)(triangleRatios[l]*triCount));
+		simplifier.Extract(lods[l + 1].Mesh);
+		lods[l + 1].Error = simplifier.Error();
+	}
+
+	return lods;
+}
+
+float SimplifyMesh(GeometryGenerator::MeshData& mesh, std::uint32_t targetTriangleCount)
+{
+	GeometryGenerator::MeshData simplified;
+
+	QuadricSimplifier simplifier(mesh);
+	simplifier.Simplify(targetTriangleCount);
+	simplifier.Extract(simplified);
+
+	mesh = std::move(simplified);
+	return simplifier.Error();
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// MeshSimplifier.h
+//
+// Level of detail chains for indexed triangle lists by quadric edge collapse (Garland
+// and Heckbert 1997).  Every vertex position carries the sum of the squared distances
+// to the planes of its original triangles; collapsing an edge adds the two sums, and
+// the cost of the collapse is that sum evaluated at the surviving position.
+//
+// Collapses are half-edge collapses onto an existing vertex, so vertices are never
+// moved or blended and their normals, tangents and texture coordinates stay exact.
+// Vertices duplicated along texture seams or hard edges are collapsed together with
+// their twins, or not at all, so seams stay closed and creases stay sharp.  Open
+// borders only collapse along themselves, and no collapse may flip a triangle.
+//
+// Error values are distances in the mesh's own units, measured against the original
+// mesh rather than the previous level, so a renderer can compare them directly with
+// what a pixel covers at the object's distance (see ProjectedLodError).
+//
+// Only standard C++ is used, so everything here runs and can be checked without a GPU.
+//***************************************************************************************
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+struct MeshLod
+{
+	GeometryGenerator::MeshData Mesh;
+
+	// Area-weighted RMS distance from the moved surface to the original planes, at
+	// the worst collapse so far.  0 for the unsimplified mesh.
+	float Error = 0.0f;
+};
+
+///<summary>
+/// Builds mesh followed by one simplified level per entry of triangleRatios, each a
+/// fraction of the original triangle count (so decreasing, e.g. 0.5, 0.25, 0.125).
+/// A level stops short of its target when no further collapse is allowed; it is kept
+/// even then, with its actual triangle count.  In the simplified levels unreferenced
+/// vertices are dropped, the rest keep their relative order, and any trailing partial
+/// triangle is gone.
+///</summary>
+std::vector<MeshLod> BuildLodChain(const GeometryGenerator::MeshData& mesh,
+	const float* triangleRatios, std::size_t ratioCount);
+
+// Simplifies mesh in place to at most targetTriangleCount triangles (or as close as
+// the constraints allow) and returns its error.
+float SimplifyMesh(GeometryGenerator::MeshData& mesh, std::uint32_t targetTriangleCount);
+
+// Height in pixels of an object-space error at distance from a perspective camera
+// with the given vertical field of view and viewport height.
+inline float ProjectedLodError(float error, float distance, float viewportHeight, float fovY)
+{
+	return error*viewportHeight / (2.0f*distance*tanf(0.5f*fovY));
+}
@@ -0,0 +1,229 @@
+//***************************************************************************************
+// TaskScheduler.cpp
+//***************************************************************************************
+
+#include "TaskScheduler.h"
+#include <algorithm>
+
+namespace
+{
+	// Identifies the pool (if any) the current thread is a worker of, so nested
+	// ParallelFor calls from inside a task push onto the worker's own deque.
+	thread_local const void* tOwnerPool = nullptr;
+	thread_local int tQueueIndex = -1;
+}
+
+void TaskScheduler::ParallelFor2D(int rowBegin, int rowEnd, int colBegin, int colEnd,
+	int tileRows, int tileCols, const std::function<void(const TileRange2D&)>& body)
+{
+	if(rowEnd <= rowBegin || colEnd <= colBegin)
+		return;
+
+	if(tileRows <= 0)
+		tileRows = rowEnd - rowBegin;
+	if(tileCols <= 0)
+		tileCols = colEnd - colBegin;
+
+	const int tilesDown = (rowEnd - rowBegin + tileRows - 1) / tileRows;
+	const int tilesAcross = (colEnd - colBegin + tileCols - 1) / tileCols;
+
+	// Tiles are numbered row-major so neighbouring indices (which tend to land in the
+	// same chunk and on the same worker) are neighbouring tiles in memory.
+	ParallelFor(0, tilesDown*tilesAcross, 1, [&](int first, int last)
+	{
+		for(int t = first; t < last; ++t)
+		{
+			int ty = t / tilesAcross;
+			int tx = t - ty*tilesAcross;
+
+			TileRange2D tile;
+			tile.RowBegin = rowBegin + ty*tileRows;
+			tile.RowEnd = std::min(tile.RowBegin + tileRows, rowEnd);
+			tile.ColBegin = colBegin + tx*tileCols;
+			tile.ColEnd = std::min(tile.ColBegin + tileCols, colEnd);
+
+			body(tile);
+		}
+	});
+}
+
+int SerialTaskScheduler::WorkerCount()const
+{
+	return 1;
+}
+
+void SerialTaskScheduler::ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body)
+{
+	grainSize = std::max(grainSize, 1);
+
+	for(int i = begin; i < end; i += grainSize)
+		body(i, std::min(i + grainSize, end));
+}
+
+ThreadPoolTaskScheduler::ThreadPoolTaskScheduler(int threadCount)
+{
+	if(threadCount <= 0)
+		threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+
+	// The calling thread always participates, so spawn one fewer.
+	const int workerThreads = threadCount - 1;
+
+	for(int i = 0; i < workerThreads + 1; ++i)
+		mQueues.push_back(std::make_unique<WorkQueue>());
+
+	for(int i = 0; i < workerThreads; ++i)
+		mThreads.emplace_back(&ThreadPoolTaskScheduler::WorkerMain, this, i);
+}
+
+ThreadPoolTaskScheduler::~ThreadPoolTaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for(auto& t : mThreads)
+		t.join();
+}
+
+int ThreadPoolTaskScheduler::WorkerCount()const
+{
+	return (int)mThreads.size() + 1;
+}
+
+int ThreadPoolTaskScheduler::QueueIndexForCurrentThread()const
+{
+	if(tOwnerPool == this)
+		return tQueueIndex;
+
+	return (int)mQueues.size() - 1;
+}
+
+void ThreadPoolTaskScheduler::ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body)
+{
+	if(end <= begin)
+		return;
+
+	grainSize = std::max(grainSize, 1);
+	const int chunkCount = (end - begin + grainSize - 1) / grainSize;
+
+	// Nothing to share; skip the queues entirely.
+	if(chunkCount == 1 || mThreads.empty())
+	{
+		for(int i = begin; i < end; i += grainSize)
+			body(i, std::min(i + grainSize, end));
+		return;
+	}
+
+	Job job;
+	job.Body = &body;
+	job.Remaining.store(chunkCount, std::memory_order_relaxed);
+
+	// Deal contiguous runs of chunks to each queue, starting with our own, so every
+	// worker starts on a compact region and only steals once it runs dry.
+	const int queueCount = (int)mQueues.size();
+	const int self = QueueIndexForCurrentThread();
+
+	mPendingTasks.fetch_add(chunkCount);
+
+	for(int q = 0; q < queueCount; ++q)
+	{
+		int firstChunk = (int)((long long)chunkCount*q / queueCount);
+		int lastChunk = (int)((long long)chunkCount*(q + 1) / queueCount);
+		if(firstChunk == lastChunk)
+			continue;
+
+		WorkQueue& queue = *mQueues[(self + q) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+
+		// Pushed in reverse so the owner, popping from the back, walks forward.
+		for(int c = lastChunk - 1; c >= firstChunk; --c)
+		{
+			Task task;
+			task.Owner = &job;
+			task.Begin = begin + c*grainSize;
+			task.End = std::min(task.Begin + grainSize, end);
+			queue.Tasks.push_back(task);
+		}
+	}
+
+	{
+		// Taking the lock orders the wake-up after any worker's predicate check.
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWake.notify_all();
+
+	// Help out until our own job is done.  Tasks belonging to other jobs may get
+	// run here too, which is fine: all that matters is that the work gets done.
+	while(job.Remaining.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		if(PopOrSteal(self, task))
+			RunTask(task);
+		else
+			std::this_thread::yield();
+	}
+}
+
+bool ThreadPoolTaskScheduler::PopOrSteal(int queueIndex, Task& task)
+{
+	const int queueCount = (int)mQueues.size();
+
+	{
+		WorkQueue& own = *mQueues[queueIndex];
+		std::lock_guard<std::mutex> lock(own.Mutex);
+		if(!own.Tasks.empty())
+		{
+			task = own.Tasks.back();
+			own.Tasks.pop_back();
+			mPendingTasks.fetch_sub(1);
+			return true;
+		}
+	}
+
+	for(int i = 1; i < queueCount; ++i)
+	{
+		WorkQueue& victim = *mQueues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(victim.Mutex);
+		if(!victim.Tasks.empty())
+		{
+			task = victim.Tasks.front();
+			victim.Tasks.pop_front();
+			mPendingTasks.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPoolTaskScheduler::RunTask(const Task& task)
+{
+	(*task.Owner->Body)(task.Begin, task.End);
+
+	// Last touch of the job; the owner may return (and destroy it) right after.
+	task.Owner->Remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPoolTaskScheduler::WorkerMain(int queueIndex)
+{
+	tOwnerPool = this;
+	tQueueIndex = queueIndex;
+
+	for(;;)
+	{
+		Task task;
+		if(PopOrSteal(queueIndex, task))
+		{
+			RunTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mWake.wait(lock, [this]() { return mQuit || mPendingTasks.load() > 0; });
+
+		if(mQuit && mPendingTasks.load() <= 0)
+			return;
+	}
+}
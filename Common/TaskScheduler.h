@@ -0,0 +1,116 @@
+//***************************************************************************************
+// TaskScheduler.h
+//
+// Minimal data-parallel task scheduling used by the CPU simulation code.  Clients
+// write against the TaskScheduler interface and pick an implementation:
+//
+//   SerialTaskScheduler     - runs everything on the calling thread.
+//   ThreadPoolTaskScheduler - std::thread workers with per-worker work-stealing deques.
+//
+// Only standard C++ is used, so anything built on top of this compiles off Windows.
+//
+// WaveBench measures how the wave step scales from one worker to every core: its
+// "twopass" workload runs once per --threads count (1, 2, 4, ... by default) and
+// reports the speedup over the single-threaded run.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A block of a 2D index space: rows [RowBegin, RowEnd) x columns [ColBegin, ColEnd).
+struct TileRange2D
+{
+	int RowBegin = 0;
+	int RowEnd = 0;
+	int ColBegin = 0;
+	int ColEnd = 0;
+};
+
+class TaskScheduler
+{
+public:
+	virtual ~TaskScheduler() = default;
+
+	// Number of threads that execute work, counting the thread calling ParallelFor.
+	virtual int WorkerCount()const = 0;
+
+	///<summary>
+	/// Calls body(chunkBegin, chunkEnd) over disjoint chunks of at most grainSize
+	/// iterations that together cover [begin, end).  Chunks may run concurrently and
+	/// in any order.  Returns once every chunk has finished.
+	///</summary>
+	virtual void ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body) = 0;
+
+	///<summary>
+	/// Splits [rowBegin, rowEnd) x [colBegin, colEnd) into tiles of tileRows x tileCols
+	/// and calls body once per tile.  A tile size <= 0 means "the whole extent".
+	///</summary>
+	void ParallelFor2D(int rowBegin, int rowEnd, int colBegin, int colEnd,
+		int tileRows, int tileCols, const std::function<void(const TileRange2D&)>& body);
+};
+
+class SerialTaskScheduler : public TaskScheduler
+{
+public:
+	virtual int WorkerCount()const override;
+	virtual void ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body)override;
+};
+
+class ThreadPoolTaskScheduler : public TaskScheduler
+{
+public:
+	// threadCount is the total number of threads doing work, including the caller of
+	// ParallelFor; 0 picks std::thread::hardware_concurrency().
+	explicit ThreadPoolTaskScheduler(int threadCount = 0);
+	ThreadPoolTaskScheduler(const ThreadPoolTaskScheduler& rhs) = delete;
+	ThreadPoolTaskScheduler& operator=(const ThreadPoolTaskScheduler& rhs) = delete;
+	~ThreadPoolTaskScheduler();
+
+	virtual int WorkerCount()const override;
+	virtual void ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body)override;
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int)>* Body = nullptr;
+		std::atomic<int> Remaining{ 0 };
+	};
+
+	struct Task
+	{
+		Job* Owner = nullptr;
+		int Begin = 0;
+		int End = 0;
+	};
+
+	// Owners push and pop at the back; thieves take from the front so they grab
+	// the work furthest from what the owner is currently touching.
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	int QueueIndexForCurrentThread()const;
+	bool PopOrSteal(int queueIndex, Task& task);
+	void RunTask(const Task& task);
+	void WorkerMain(int queueIndex);
+
+private:
+	// One queue per worker thread plus a shared one (the last) for outside callers.
+	std::vector<std::unique_ptr<WorkQueue>> mQueues;
+	std::vector<std::thread> mThreads;
+
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+	std::atomic<int> mPendingTasks{ 0 };
+	bool mQuit = false;
+};
@@ -55,6 +55,15 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Direct access to the mapped memory, for filling many elements in one pass.
+    // Constant buffer elements are padded, so this is only valid for the other kind.
+    // The memory is write-combined: write it sequentially and never read it back.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -151,6 +151,14 @@ struct SubmeshGeometry
 	// Bounding box of the geometry defined by this submesh. 
 	// This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Bounding sphere of the same geometry, for when a sphere test is cheaper.  Only
+	// filled in by builders that were asked for it (see MeshBatchBuilder).
+	DirectX::BoundingSphere Sphere;
+
+	// For a simplified level of detail, how far (in object space) it strays from the
+	// full-detail mesh; 0 for full detail.  See MeshSimplifier.h.
+	float LodError = 0.0f;
 };
 
 struct MeshGeometry
@@ -0,0 +1,1455 @@
+//***************************************************************************************
+// GeometryBench.cpp
+//
+// Headless benchmark for GeometryGenerator at high tessellation.  Like WaveBench it
+// needs no window or GPU, only GeometryGenerator.cpp, MeshBounds.cpp, MeshCache.cpp,
+// MeshOptimizer.cpp, MeshSimplifier.cpp and TaskScheduler.cpp, and prints one JSON
+// document to stdout.
+//
+// Windows: build GeometryBench.vcxproj from the solution.  The Windows build also
+// compiles MeshBatchBuilder.cpp and d3dUtil.cpp so --check can run the batch builder
+// (with a null device, so still without a GPU).
+// Linux: put DirectXMath's Inc directory and a sal.h on the include path (see
+// WaveBench.cpp), then from the repository root:
+//
+//   g++ -std=c++14 -O2 -I<DirectXMath>/Inc -I<dir with sal.h> -o geometrybench
+//       GeometryBench/GeometryBench.cpp Common/GeometryGenerator.cpp Common/MeshBounds.cpp
+//       Common/MeshCache.cpp Common/MeshOptimizer.cpp Common/MeshSimplifier.cpp
+//       Common/TaskScheduler.cpp
+//
+// Usage: geometrybench [--threads 1,2,...] [--min-time seconds]
+//        geometrybench --check
+//
+// Every workload builds a fresh MeshData per iteration, so the timings include the
+// allocations.  mb_per_s counts the bytes of the finished vertex and index arrays.
+//
+// --check runs the correctness checks instead, prints one line per check, reports
+// every failure on stderr and exits non-zero if any check failed.
+//***************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Common/GeometryGenerator.h"
+#include "../Common/MeshBounds.h"
+#include "../Common/MeshCache.h"
+#include "../Common/MeshOptimizer.h"
+#include "../Common/MeshSimplifier.h"
+#include "../Common/TaskScheduler.h"
+
+#if defined(_WIN32)
+#include "../Common/MeshBatchBuilder.h"
+#pragma comment(lib, "d3dcompiler.lib")
+#endif
+
+namespace
+{
+	struct Options
+	{
+		std::vector<int> Threads;
+		double MinTime = 0.5;
+		bool Check = false;
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		while(*text)
+		{
+			char* end = nullptr;
+			long v = std::strtol(text, &end, 10);
+			if(end == text)
+				break;
+			if(v > 0)
+				values.push_back((int)v);
+			text = (*end == ',') ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for(int a = 1; a < argc; ++a)
+		{
+			if(std::strcmp(argv[a], "--check") == 0)
+				options.Check = true;
+			else if(a + 1 < argc && std::strcmp(argv[a], "--threads") == 0)
+				options.Threads = ParseList(argv[++a]);
+			else if(a + 1 < argc && std::strcmp(argv[a], "--min-time") == 0)
+				options.MinTime = std::atof(argv[++a]);
+			else
+				return false;
+		}
+
+		if(options.Threads.empty())
+		{
+			// 1, 2, 4, ... and the machine's own thread count.
+			const int hardware = std::max((int)std::thread::hardware_concurrency(), 1);
+			for(int t = 1; t < hardware; t *= 2)
+				options.Threads.push_back(t);
+			options.Threads.push_back(hardware);
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<TaskScheduler> MakeScheduler(int threads)
+	{
+		if(threads <= 1)
+			return nullptr;
+		return std::unique_ptr<TaskScheduler>(new ThreadPoolTaskScheduler(threads));
+	}
+
+	// Mean nanoseconds per call of body, after one warm-up call.
+	double TimeIterations(double minTime, const std::function<void()>& body)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		body();
+
+		int iterations = 0;
+		const Clock::time_point start = Clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			body();
+			++iterations;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while(elapsed < minTime || iterations < 3);
+
+		return elapsed*1e9 / iterations;
+	}
+
+	class JsonWriter
+	{
+	public:
+		void Begin(const char* workload, const char* params, int threads)
+		{
+			std::printf("%s\n    { \"workload\": \"%s\", \"params\": \"%s\", \"threads\": %d",
+				mFirst ? "" : ",", workload, params, threads);
+			mFirst = false;
+		}
+
+		void Field(const char* name, double value)
+		{
+			std::printf(", \"%s\": %.6g", name, value);
+		}
+
+		void End()
+		{
+			std::printf(" }");
+			std::fflush(stdout);
+		}
+
+	private:
+		bool mFirst = true;
+	};
+
+	void BenchMesh(JsonWriter& json, double minTime, const char* workload, const char* params, int threads,
+		double baseline, double* nsOut, const std::function<GeometryGenerator::MeshData()>& create)
+	{
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+
+		const double ns = TimeIterations(minTime, [&]()
+		{
+			GeometryGenerator::MeshData mesh = create();
+			vertexCount = mesh.Vertices.size();
+			indexCount = mesh.Indices32.size();
+		});
+
+		const double bytes = (double)vertexCount*sizeof(GeometryGenerator::Vertex) +
+			(double)indexCount*sizeof(GeometryGenerator::uint32);
+
+		json.Begin(workload, params, threads);
+		json.Field("vertices", (double)vertexCount);
+		json.Field("indices", (double)indexCount);
+		json.Field("ms_per_mesh", ns*1e-6);
+		json.Field("ns_per_vertex", ns / vertexCount);
+		json.Field("mb_per_s", bytes*1e3 / ns);
+		if(baseline > 0.0)
+			json.Field("speedup", baseline / ns);
+		json.End();
+
+		if(nsOut)
+			*nsOut = ns;
+	}
+
+	// OptimizeMesh on a freshly generated mesh, with the cache statistics it reports.
+	void BenchOptimize(JsonWriter& json, double minTime, const char* workload, const char* params,
+		const GeometryGenerator::MeshData& source)
+	{
+		MeshOptimizeReport report;
+
+		GeometryGenerator::MeshData mesh;
+		const double ns = TimeIterations(minTime, [&]()
+		{
+			mesh = source;
+			report = OptimizeMesh(mesh);
+		});
+
+		json.Begin(workload, params, 1);
+		json.Field("triangles", report.Before.TriangleCount);
+		json.Field("ms_per_mesh", ns*1e-6);
+		json.Field("acmr_before", report.Before.Acmr);
+		json.Field("acmr_after", report.After.Acmr);
+		json.Field("atvr_before", report.Before.Atvr);
+		json.Field("atvr_after", report.After.Atvr);
+		json.End();
+	}
+
+	// Bounding box and sphere of an existing mesh, read in place from the interleaved
+	// vertices.
+	void BenchBounds(JsonWriter& json, double minTime, const char* params, const GeometryGenerator::MeshData& mesh)
+	{
+		DirectX::BoundingBox box;
+		DirectX::BoundingSphere sphere;
+
+		const double boxNs = TimeIterations(minTime, [&]() { box = ComputeBoundingBox(mesh); });
+		const double sphereNs = TimeIterations(minTime, [&]() { sphere = ComputeBoundingSphere(mesh, box); });
+
+		const double vertexCount = (double)mesh.Vertices.size();
+
+		json.Begin("bounds", params, 1);
+		json.Field("vertices", vertexCount);
+		json.Field("box_ns_per_vertex", boxNs / vertexCount);
+		json.Field("sphere_ns_per_vertex", sphereNs / vertexCount);
+		json.Field("radius", sphere.Radius);
+		json.End();
+	}
+
+	// A level of detail chain at 1/2, 1/4 and 1/8 of the triangles, with the triangle
+	// count and error each level ended up with.
+	void BenchLodChain(JsonWriter& json, double minTime, const char* workload, const char* params,
+		const GeometryGenerator::MeshData& source)
+	{
+		const float ratios[] = { 0.5f, 0.25f, 0.125f };
+
+		std::vector<MeshLod> chain;
+		const double ns = TimeIterations(minTime, [&]() { chain = BuildLodChain(source, ratios, 3); });
+
+		json.Begin(workload, params, 1);
+		json.Field("triangles", (double)(source.Indices32.size() / 3));
+		json.Field("ms_per_chain", ns*1e-6);
+		for(size_t lod = 1; lod < chain.size(); ++lod)
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "lod%d_triangles", (int)lod);
+			json.Field(name, (double)(chain[lod].Mesh.Indices32.size() / 3));
+			std::snprintf(name, sizeof(name), "lod%d_error", (int)lod);
+			json.Field(name, chain[lod].Error);
+		}
+		json.End();
+	}
+
+	// A 4096 x 4096 grid streamed through CreateGridChunks to a sink that keeps nothing,
+	// so this is generation alone at a fixed, chunk-sized memory footprint.
+	void BenchGridChunks(JsonWriter& json, double minTime, int threads)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+		GeometryGenerator geoGen;
+
+		const GeometryGenerator::uint32 size = 4096;
+		const GeometryGenerator::uint32 chunkRows = 128;
+
+		size_t vertexCount = 0;
+		size_t peakBytes = 0;
+
+		const double ns = TimeIterations(minTime, [&]()
+		{
+			vertexCount = 0;
+			geoGen.CreateGridChunks((float)size, (float)size, size, size, chunkRows,
+				[&](const GeometryGenerator::GridChunk& chunk)
+			{
+				vertexCount += chunk.Vertices.size();
+				peakBytes = std::max(peakBytes, chunk.Vertices.capacity()*sizeof(GeometryGenerator::Vertex) +
+					chunk.Indices32.capacity()*sizeof(GeometryGenerator::uint32));
+			}, scheduler.get());
+		});
+
+		json.Begin("grid_chunks", "4096 x 4096, 128-row chunks", threads);
+		json.Field("vertices", (double)vertexCount);
+		json.Field("ms_per_mesh", ns*1e-6);
+		json.Field("ns_per_vertex", ns / vertexCount);
+		json.Field("peak_chunk_mb", peakBytes / (1024.0*1024.0));
+		json.End();
+	}
+
+	// Results of --check.  Failures go to stderr as they happen (the first few of each
+	// check, so one broken loop cannot bury the rest), and a summary line per check to
+	// stdout.
+	class CheckReport
+	{
+	public:
+		void Begin(const char* name)
+		{
+			mName = name;
+			mCheckFailures = 0;
+		}
+
+		// Counts a failure unless condition holds; format and the rest are printf-style.
+		bool Expect(bool condition, const char* format, ...)
+		{
+			if(condition)
+				return true;
+
+			if(mCheckFailures++ < 8)
+			{
+				std::fprintf(stderr, "FAILED %s: ", mName);
+				va_list args;
+				va_start(args, format);
+				std::vfprintf(stderr, format, args);
+				va_end(args);
+				std::fprintf(stderr, "\n");
+			}
+
+			++mFailures;
+			return false;
+		}
+
+		void End()
+		{
+			std::printf("%-20s %s\n", mName, mCheckFailures == 0 ? "ok" : "FAILED");
+			std::fflush(stdout);
+		}
+
+		int Failures()const { return mFailures; }
+
+	private:
+		const char* mName = "";
+		int mCheckFailures = 0;
+		int mFailures = 0;
+	};
+
+	// Checks that every directed edge of mesh's triangles has exactly one opposite, i.e.
+	// the surface is closed and consistently wound, and returns its number of edges.
+	size_t CheckWatertight(CheckReport& report, const char* name, const GeometryGenerator::MeshData& mesh)
+	{
+		const std::vector<GeometryGenerator::uint32>& indices = mesh.Indices32;
+
+		std::vector<std::uint64_t> edges;
+		edges.reserve(indices.size());
+		for(size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			for(int c = 0; c < 3; ++c)
+				edges.push_back((std::uint64_t)indices[t + c] << 32 | indices[t + (c + 1) % 3]);
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for(size_t e = 0; e < edges.size(); ++e)
+		{
+			const GeometryGenerator::uint32 a = (GeometryGenerator::uint32)(edges[e] >> 32);
+			const GeometryGenerator::uint32 b = (GeometryGenerator::uint32)edges[e];
+			const std::uint64_t opposite = (std::uint64_t)b << 32 | a;
+
+			report.Expect(e + 1 == edges.size() || edges[e + 1] != edges[e], "%s: edge %u-%u used twice", name, a, b);
+			report.Expect(std::binary_search(edges.begin(), edges.end(), opposite), "%s: edge %u-%u has no opposite", name, a, b);
+		}
+
+		return edges.size() / 2;
+	}
+
+	// A regular tetrahedron with one vertex per corner, so every edge is shared.
+	GeometryGenerator::MeshData MakeTetrahedron()
+	{
+		const float c = 0.57735027f;
+
+		GeometryGenerator::MeshData mesh;
+		mesh.Vertices =
+		{
+			GeometryGenerator::Vertex(1.0f, 1.0f, 1.0f, c, c, c, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+			GeometryGenerator::Vertex(1.0f, -1.0f, -1.0f, c, -c, -c, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+			GeometryGenerator::Vertex(-1.0f, 1.0f, -1.0f, -c, c, -c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+			GeometryGenerator::Vertex(-1.0f, -1.0f, 1.0f, -c, -c, c, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f)
+		};
+		mesh.Indices32 = { 0, 1, 2,  0, 3, 1,  0, 2, 3,  1, 3, 2 };
+		return mesh;
+	}
+
+	// Subdivides mesh levels times, checking the result stays watertight and that each
+	// pass adds one vertex per edge (V' = V + E) and splits every triangle in four.
+	void CheckSubdivideLevels(CheckReport& report, const char* name, GeometryGenerator::MeshData mesh, int levels)
+	{
+		GeometryGenerator geoGen;
+
+		size_t edgeCount = CheckWatertight(report, name, mesh);
+		for(int level = 1; level <= levels; ++level)
+		{
+			const size_t vertexCount = mesh.Vertices.size();
+			const size_t triangleCount = mesh.Indices32.size() / 3;
+
+			geoGen.Subdivide(mesh);
+
+			report.Expect(mesh.Vertices.size() == vertexCount + edgeCount, "%s level %d: %d vertices, expected %d + %d",
+				name, level, (int)mesh.Vertices.size(), (int)vertexCount, (int)edgeCount);
+			report.Expect(mesh.Indices32.size() == 12*triangleCount, "%s level %d: %d triangles, expected 4 x %d",
+				name, level, (int)mesh.Indices32.size() / 3, (int)triangleCount);
+
+			edgeCount = CheckWatertight(report, name, mesh);
+		}
+	}
+
+	// Checks that every triangle of source became the same four triangles the unwelded
+	// Subdivide emitted, corners first and each edge's midpoint shared by the triangles
+	// along it, and that every midpoint is the average of its edge's ends.  Midpoints
+	// are symmetric in their ends, so this is the same vertex data as before.
+	void CheckSubdivideLayout(CheckReport& report, const char* name, const GeometryGenerator::MeshData& source)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData mesh = source;
+		geoGen.Subdivide(mesh);
+
+		const std::vector<GeometryGenerator::uint32>& in = source.Indices32;
+		const std::vector<GeometryGenerator::uint32>& out = mesh.Indices32;
+
+		auto checkMidpoint = [&](GeometryGenerator::uint32 m, GeometryGenerator::uint32 a, GeometryGenerator::uint32 b)
+		{
+			const GeometryGenerator::Vertex& v = mesh.Vertices[m];
+			const GeometryGenerator::Vertex& va = mesh.Vertices[a];
+			const GeometryGenerator::Vertex& vb = mesh.Vertices[b];
+
+			report.Expect(v.Position.x == 0.5f*(va.Position.x + vb.Position.x) &&
+				v.Position.y == 0.5f*(va.Position.y + vb.Position.y) &&
+				v.Position.z == 0.5f*(va.Position.z + vb.Position.z) &&
+				v.TexC.x == 0.5f*(va.TexC.x + vb.TexC.x) && v.TexC.y == 0.5f*(va.TexC.y + vb.TexC.y),
+				"%s: vertex %u is not the midpoint of %u-%u", name, m, a, b);
+		};
+
+		for(size_t t = 0; t + 2 < in.size() && 12*(t/3) + 11 < out.size(); t += 3)
+		{
+			const GeometryGenerator::uint32* q = &out[12*(t/3)];
+			const GeometryGenerator::uint32 m0 = q[1];
+			const GeometryGenerator::uint32 m1 = q[4];
+			const GeometryGenerator::uint32 m2 = q[2];
+
+			if(!report.Expect(q[0] == in[t] && q[10] == in[t + 1] && q[8] == in[t + 2] &&
+				q[3] == m0 && q[9] == m0 && q[7] == m1 && q[11] == m1 && q[5] == m2 && q[6] == m2 &&
+				m0 >= source.Vertices.size() && m1 >= source.Vertices.size() && m2 >= source.Vertices.size(),
+				"%s: triangle %d is not split as before", name, (int)t/3))
+				continue;
+
+			// Input vertices are kept in place.
+			report.Expect(std::memcmp(&mesh.Vertices[in[t]], &source.Vertices[in[t]], sizeof(GeometryGenerator::Vertex)) == 0,
+				"%s: vertex %u changed", name, in[t]);
+
+			checkMidpoint(m0, in[t], in[t + 1]);
+			checkMidpoint(m1, in[t + 1], in[t + 2]);
+			checkMidpoint(m2, in[t], in[t + 2]);
+		}
+	}
+
+	// Subdivide shares one midpoint per edge: the geosphere at every level and a welded
+	// tetrahedron subdivided five times stay watertight with the expected counts, and
+	// the faceted shapes split every triangle as before.
+	void CheckSubdivide(CheckReport& report)
+	{
+		report.Begin("subdivide");
+
+		GeometryGenerator geoGen;
+
+		for(int n = 0; n <= 6; ++n)
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "geosphere %d", n);
+
+			const GeometryGenerator::MeshData geosphere = geoGen.CreateGeosphere(1.0f, n);
+			CheckWatertight(report, name, geosphere);
+
+			const size_t expected = 10*((size_t)1 << 2*n) + 2;
+			report.Expect(geosphere.Vertices.size() == expected, "%s has %d vertices, expected %d",
+				name, (int)geosphere.Vertices.size(), (int)expected);
+		}
+
+		CheckSubdivideLevels(report, "geosphere", geoGen.CreateGeosphere(1.0f, 0), 6);
+
+		GeometryGenerator::MeshData tetrahedron = MakeTetrahedron();
+		CheckSubdivideLevels(report, "tetrahedron", tetrahedron, 5);
+
+		CheckSubdivideLayout(report, "box", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 0));
+		CheckSubdivideLayout(report, "wedge", geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0));
+		CheckSubdivideLayout(report, "pyramid", geoGen.CreatePyramid(1.5f, 1.5f, 0));
+		CheckSubdivideLayout(report, "diamond", geoGen.CreateDiamond(1.0f, 2.0f, 1.0f, 0));
+		CheckSubdivideLayout(report, "sanlengzhu", geoGen.CreateSanLengZhu(1.0f, 2.0f, 0));
+		CheckSubdivideLayout(report, "trapezoid", geoGen.CreateTrapezoid(1.0f, 2.0f, 1.0f, 0));
+		CheckSubdivideLayout(report, "pentagonal prism", geoGen.CreatePentagonalPrism(1.0f, 1.0f, 1.0f, 0));
+		CheckSubdivideLayout(report, "box 2", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 2));
+		CheckSubdivideLayout(report, "geosphere 3", geoGen.CreateGeosphere(1.0f, 3));
+
+		report.End();
+	}
+
+	// The vertex bytes of every whole triangle of mesh, in order, one string each.
+	std::vector<std::string> TriangleBytes(const GeometryGenerator::MeshData& mesh)
+	{
+		const size_t vertexSize = sizeof(GeometryGenerator::Vertex);
+
+		std::vector<std::string> triangles(mesh.Indices32.size() / 3);
+		for(size_t t = 0; t < triangles.size(); ++t)
+		{
+			triangles[t].resize(3*vertexSize);
+			for(int c = 0; c < 3; ++c)
+				std::memcpy(&triangles[t][c*vertexSize], &mesh.Vertices[mesh.Indices32[3*t + c]], vertexSize);
+		}
+
+		return triangles;
+	}
+
+	// OptimizeMesh may only reorder: the same triangles (each keeping its corner order,
+	// so its winding) over the same vertices, renumbered in first-use order, and any
+	// trailing partial triangle still in place and pointing at the same vertex data.
+	void CheckOptimizeMesh(CheckReport& report, const char* name, const GeometryGenerator::MeshData& source)
+	{
+		GeometryGenerator::MeshData mesh = source;
+		OptimizeMesh(mesh);
+
+		const size_t vertexSize = sizeof(GeometryGenerator::Vertex);
+		const size_t vertexCount = source.Vertices.size();
+		const size_t indexCount = source.Indices32.size();
+
+		if(!report.Expect(mesh.Vertices.size() == vertexCount && mesh.Indices32.size() == indexCount,
+			"%s: %d vertices and %d indices became %d and %d", name, (int)vertexCount, (int)indexCount,
+			(int)mesh.Vertices.size(), (int)mesh.Indices32.size()))
+			return;
+
+		std::vector<std::string> before = TriangleBytes(source);
+		std::vector<std::string> after = TriangleBytes(mesh);
+		std::sort(before.begin(), before.end());
+		std::sort(after.begin(), after.end());
+		report.Expect(before == after, "%s: the triangles changed", name);
+
+		std::vector<std::string> verticesBefore(vertexCount);
+		std::vector<std::string> verticesAfter(vertexCount);
+		for(size_t v = 0; v < vertexCount; ++v)
+		{
+			verticesBefore[v].assign((const char*)&source.Vertices[v], vertexSize);
+			verticesAfter[v].assign((const char*)&mesh.Vertices[v], vertexSize);
+		}
+		std::sort(verticesBefore.begin(), verticesBefore.end());
+		std::sort(verticesAfter.begin(), verticesAfter.end());
+		report.Expect(verticesBefore == verticesAfter, "%s: the vertices are not a permutation", name);
+
+		for(size_t k = indexCount - indexCount % 3; k < indexCount; ++k)
+		{
+			const GeometryGenerator::uint32 a = source.Indices32[k];
+			const GeometryGenerator::uint32 b = mesh.Indices32[k];
+			if(a >= vertexCount)
+				report.Expect(b == a, "%s: out of range trailing index %u became %u", name, a, b);
+			else
+				report.Expect(b < vertexCount && std::memcmp(&source.Vertices[a], &mesh.Vertices[b], vertexSize) == 0,
+					"%s: trailing index %d points at different vertex data", name, (int)k);
+		}
+
+		GeometryGenerator::uint32 next = 0;
+		for(GeometryGenerator::uint32 index : mesh.Indices32)
+		{
+			if(index >= vertexCount || index < next)
+				continue;
+			if(!report.Expect(index == next, "%s: vertex %u is used before vertex %u", name, index, next))
+				break;
+			++next;
+		}
+	}
+
+	// The meshes of the optimize_* workloads and the app's shapes, including the wedge
+	// and pyramid whose index lists end in a partial triangle.
+	void CheckOptimizer(CheckReport& report)
+	{
+		report.Begin("optimize_mesh");
+
+		GeometryGenerator geoGen;
+
+		CheckOptimizeMesh(report, "sphere", geoGen.CreateSphere(1.0f, 512, 256));
+		CheckOptimizeMesh(report, "geosphere", geoGen.CreateGeosphere(1.0f, 6));
+		CheckOptimizeMesh(report, "grid", geoGen.CreateGrid(512.0f, 512.0f, 512, 512));
+
+		GeometryGenerator::MeshData wedge = geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0);
+		GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.5f, 1.5f, 0);
+		report.Expect(wedge.Indices32.size() % 3 != 0 && pyramid.Indices32.size() % 3 != 0,
+			"the wedge and pyramid no longer end in a partial triangle");
+		CheckOptimizeMesh(report, "wedge", wedge);
+		CheckOptimizeMesh(report, "pyramid", pyramid);
+
+		CheckOptimizeMesh(report, "box", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3));
+		CheckOptimizeMesh(report, "cylinder", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		CheckOptimizeMesh(report, "torus", geoGen.CreateTorus(4.0f, 1.0f, 32, 32));
+		CheckOptimizeMesh(report, "diamond", geoGen.CreateDiamond(1.0f, 2.0f, 1.0f, 2));
+		CheckOptimizeMesh(report, "pentagonal prism", geoGen.CreatePentagonalPrism(1.0f, 1.0f, 1.0f, 2));
+
+		report.End();
+	}
+
+	// WriteIndices at both widths against Indices32 and GetIndices16, writing exactly
+	// Indices32.size() indices and nothing past them.
+	void CheckWriteIndicesOf(CheckReport& report, const char* name, GeometryGenerator::MeshData mesh)
+	{
+		const size_t count = mesh.Indices32.size();
+		const unsigned char guard = 0xCD;
+
+		for(GeometryGenerator::uint32 stride = mesh.IndexStride(); stride <= 4; stride += 2)
+		{
+			std::vector<unsigned char> buffer((count + 4)*stride, guard);
+			mesh.WriteIndices(buffer.data(), stride);
+
+			for(size_t k = 0; k < count; ++k)
+			{
+				GeometryGenerator::uint32 index = 0;
+				if(stride == 2)
+				{
+					GeometryGenerator::uint16 index16;
+					std::memcpy(&index16, &buffer[2*k], 2);
+					index = index16;
+					report.Expect(index16 == mesh.GetIndices16()[k], "%s: 16-bit index %d differs from GetIndices16", name, (int)k);
+				}
+				else
+				{
+					std::memcpy(&index, &buffer[4*k], 4);
+				}
+
+				if(!report.Expect(index == mesh.Indices32[k], "%s: %d-byte index %d is %u, expected %u",
+					name, (int)stride, (int)k, index, mesh.Indices32[k]))
+					break;
+			}
+
+			report.Expect(std::count(buffer.begin() + count*stride, buffer.end(), guard) == (std::ptrdiff_t)(4*stride),
+				"%s: %d-byte WriteIndices wrote past the end", name, (int)stride);
+		}
+	}
+
+	// IndexStride switches to 4 bytes just past 65536 vertices, and WriteIndices agrees
+	// with Indices32 (and GetIndices16 where 16 bits suffice) on either side.
+	void CheckWriteIndices(CheckReport& report)
+	{
+		report.Begin("write_indices");
+
+		GeometryGenerator geoGen;
+
+		GeometryGenerator::MeshData largest16 = geoGen.CreateGrid(10.0f, 10.0f, 256, 256);
+		GeometryGenerator::MeshData smallest32 = geoGen.CreateGrid(10.0f, 10.0f, 256, 257);
+
+		report.Expect(largest16.Vertices.size() == 0x10000 && largest16.IndexStride() == 2,
+			"256 x 256 grid: %d vertices, %u-byte indices", (int)largest16.Vertices.size(), largest16.IndexStride());
+		report.Expect(smallest32.Vertices.size() == 0x10100 && smallest32.IndexStride() == 4,
+			"256 x 257 grid: %d vertices, %u-byte indices", (int)smallest32.Vertices.size(), smallest32.IndexStride());
+		report.Expect(*std::max_element(largest16.Indices32.begin(), largest16.Indices32.end()) == 0xFFFF,
+			"256 x 256 grid does not use vertex 65535");
+
+		CheckWriteIndicesOf(report, "grid 256 x 256", largest16);
+		CheckWriteIndicesOf(report, "grid 256 x 257", smallest32);
+		CheckWriteIndicesOf(report, "box", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3));
+		CheckWriteIndicesOf(report, "wedge", geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0));
+		CheckWriteIndicesOf(report, "sphere", geoGen.CreateSphere(1.0f, 40, 20));
+		CheckWriteIndicesOf(report, "empty", GeometryGenerator::MeshData());
+
+		report.End();
+	}
+
+	// ComputeBoundingBox and ComputeBoundingSphere against a plain scalar reduction.  The
+	// box must match exactly; the sphere must hold every position and be within
+	// rounding of the farthest one.
+	void CheckBoundsOf(CheckReport& report, const char* name, const GeometryGenerator::MeshData& mesh)
+	{
+		const DirectX::BoundingBox box = ComputeBoundingBox(mesh);
+		const DirectX::BoundingSphere sphere = ComputeBoundingSphere(mesh, box);
+
+		if(mesh.Vertices.empty())
+		{
+			report.Expect(box.Center.x == 0.0f && box.Center.y == 0.0f && box.Center.z == 0.0f &&
+				box.Extents.x == 0.0f && box.Extents.y == 0.0f && box.Extents.z == 0.0f,
+				"%s: the box of no positions is not empty at the origin", name);
+			report.Expect(sphere.Radius == 0.0f, "%s: the sphere of no positions has radius %g", name, sphere.Radius);
+			return;
+		}
+
+		float lo[3] = { mesh.Vertices[0].Position.x, mesh.Vertices[0].Position.y, mesh.Vertices[0].Position.z };
+		float hi[3] = { lo[0], lo[1], lo[2] };
+		for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+		{
+			const float p[3] = { v.Position.x, v.Position.y, v.Position.z };
+			for(int c = 0; c < 3; ++c)
+			{
+				lo[c] = std::min(lo[c], p[c]);
+				hi[c] = std::max(hi[c], p[c]);
+			}
+		}
+
+		report.Expect(box.Center.x == 0.5f*(lo[0] + hi[0]) && box.Center.y == 0.5f*(lo[1] + hi[1]) &&
+			box.Center.z == 0.5f*(lo[2] + hi[2]), "%s: box center (%g, %g, %g) is off", name, box.Center.x, box.Center.y, box.Center.z);
+		report.Expect(box.Extents.x == 0.5f*(hi[0] - lo[0]) && box.Extents.y == 0.5f*(hi[1] - lo[1]) &&
+			box.Extents.z == 0.5f*(hi[2] - lo[2]), "%s: box extents (%g, %g, %g) are off", name, box.Extents.x, box.Extents.y, box.Extents.z);
+
+		report.Expect(sphere.Center.x == box.Center.x && sphere.Center.y == box.Center.y && sphere.Center.z == box.Center.z,
+			"%s: the sphere is not centered on the box", name);
+
+		double farthest = 0.0;
+		for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+		{
+			const double dx = (double)v.Position.x - box.Center.x;
+			const double dy = (double)v.Position.y - box.Center.y;
+			const double dz = (double)v.Position.z - box.Center.z;
+			farthest = std::max(farthest, std::sqrt(dx*dx + dy*dy + dz*dz));
+		}
+
+		report.Expect(std::fabs(sphere.Radius - farthest) <= 1e-6*farthest + 1e-7,
+			"%s: sphere radius %.9g, farthest position at %.9g", name, sphere.Radius, farthest);
+	}
+
+	// Bounds of the app's shapes, an empty mesh, a single vertex, and every count up to
+	// a few times the four positions a loop iteration takes, so the remainder is covered.
+	void CheckBounds(CheckReport& report)
+	{
+		report.Begin("bounds");
+
+		GeometryGenerator geoGen;
+
+		CheckBoundsOf(report, "box", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3));
+		CheckBoundsOf(report, "sphere", geoGen.CreateSphere(0.5f, 20, 20));
+		CheckBoundsOf(report, "cylinder", geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20));
+		CheckBoundsOf(report, "cone", geoGen.CreateCone(0.5f, 1.0f, 20, 20));
+		CheckBoundsOf(report, "wedge", geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0));
+		CheckBoundsOf(report, "pyramid", geoGen.CreatePyramid(1.5f, 1.5f, 0));
+		CheckBoundsOf(report, "diamond", geoGen.CreateDiamond(1.0f, 2.0f, 1.0f, 2));
+		CheckBoundsOf(report, "sanlengzhu", geoGen.CreateSanLengZhu(1.0f, 2.0f, 2));
+		CheckBoundsOf(report, "trapezoid", geoGen.CreateTrapezoid(1.0f, 2.0f, 1.0f, 2));
+		CheckBoundsOf(report, "pentagonal prism", geoGen.CreatePentagonalPrism(1.0f, 1.0f, 1.0f, 2));
+		CheckBoundsOf(report, "torus", geoGen.CreateTorus(4.0f, 1.0f, 24, 24));
+		CheckBoundsOf(report, "geosphere", geoGen.CreateGeosphere(0.5f, 3));
+		CheckBoundsOf(report, "grid", geoGen.CreateGrid(20.0f, 30.0f, 30, 40));
+		CheckBoundsOf(report, "empty", GeometryGenerator::MeshData());
+
+		// Scattered positions, the extremes at varying places in the array.
+		GeometryGenerator::MeshData points;
+		unsigned seed = 9;
+		for(int count = 1; count <= 13; ++count)
+		{
+			points.Vertices.resize(count);
+			for(GeometryGenerator::Vertex& v : points.Vertices)
+			{
+				float p[3];
+				for(float& c : p)
+				{
+					seed = seed*1664525u + 1013904223u;
+					c = ((int)(seed >> 8 & 0xFFFF) - 0x8000) / 1024.0f;
+				}
+				v.Position = DirectX::XMFLOAT3(p[0], p[1], p[2]);
+			}
+
+			char name[32];
+			std::snprintf(name, sizeof(name), "%d positions", count);
+			CheckBoundsOf(report, name, points);
+		}
+
+		report.End();
+	}
+
+	// Properties every level of a chain must have: fewer triangles than the level
+	// before, a nondecreasing error, only whole triangles of three distinct in-range
+	// vertices, and every vertex referenced.
+	void CheckLodLevels(CheckReport& report, const char* name, const std::vector<MeshLod>& chain, size_t levelCount)
+	{
+		if(!report.Expect(chain.size() == levelCount, "%s: %d levels, expected %d", name, (int)chain.size(), (int)levelCount))
+			return;
+
+		report.Expect(chain[0].Error == 0.0f, "%s: level 0 has error %g", name, chain[0].Error);
+
+		for(size_t lod = 1; lod < chain.size(); ++lod)
+		{
+			const GeometryGenerator::MeshData& mesh = chain[lod].Mesh;
+			const size_t triangleCount = mesh.Indices32.size() / 3;
+
+			report.Expect(triangleCount < chain[lod - 1].Mesh.Indices32.size() / 3, "%s: level %d has %d triangles, level %d had %d",
+				name, (int)lod, (int)triangleCount, (int)lod - 1, (int)chain[lod - 1].Mesh.Indices32.size() / 3);
+			report.Expect(chain[lod].Error >= chain[lod - 1].Error, "%s: level %d error %g is below level %d's %g",
+				name, (int)lod, chain[lod].Error, (int)lod - 1, chain[lod - 1].Error);
+			report.Expect(mesh.Indices32.size() % 3 == 0, "%s: level %d ends in a partial triangle", name, (int)lod);
+
+			std::vector<char> used(mesh.Vertices.size(), 0);
+			for(size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+			{
+				const GeometryGenerator::uint32* tri = &mesh.Indices32[t];
+				if(!report.Expect(tri[0] < used.size() && tri[1] < used.size() && tri[2] < used.size(),
+					"%s: level %d triangle %d is out of range", name, (int)lod, (int)t / 3))
+					continue;
+
+				report.Expect(tri[0] != tri[1] && tri[1] != tri[2] && tri[0] != tri[2],
+					"%s: level %d triangle %d is degenerate", name, (int)lod, (int)t / 3);
+				used[tri[0]] = used[tri[1]] = used[tri[2]] = 1;
+			}
+
+			report.Expect(std::count(used.begin(), used.end(), 0) == 0, "%s: level %d keeps unreferenced vertices", name, (int)lod);
+		}
+	}
+
+	// Area-weighted RMS and largest distance of mesh's triangle centroids from the unit
+	// sphere, a stand-in for the distance to the original geosphere.
+	void SphereDeviation(const GeometryGenerator::MeshData& mesh, double& rms, double& largest)
+	{
+		double sum = 0.0;
+		double area = 0.0;
+		largest = 0.0;
+		for(size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+		{
+			const DirectX::XMFLOAT3& a = mesh.Vertices[mesh.Indices32[t + 0]].Position;
+			const DirectX::XMFLOAT3& b = mesh.Vertices[mesh.Indices32[t + 1]].Position;
+			const DirectX::XMFLOAT3& c = mesh.Vertices[mesh.Indices32[t + 2]].Position;
+
+			const double cx = ((double)a.x + b.x + c.x) / 3.0;
+			const double cy = ((double)a.y + b.y + c.y) / 3.0;
+			const double cz = ((double)a.z + b.z + c.z) / 3.0;
+			const double d = std::fabs(1.0 - std::sqrt(cx*cx + cy*cy + cz*cz));
+
+			const double ux = (double)b.x - a.x, uy = (double)b.y - a.y, uz = (double)b.z - a.z;
+			const double vx = (double)c.x - a.x, vy = (double)c.y - a.y, vz = (double)c.z - a.z;
+			const double nx = uy*vz - uz*vy, ny = uz*vx - ux*vz, nz = ux*vy - uy*vx;
+			const double triangleArea = 0.5*std::sqrt(nx*nx + ny*ny + nz*nz);
+
+			sum += triangleArea*d*d;
+			area += triangleArea;
+			largest = std::max(largest, d);
+		}
+
+		rms = area > 0.0 ? std::sqrt(sum / area) : 0.0;
+	}
+
+	// BuildLodChain: a flat grid simplifies at zero error without moving its border or
+	// flipping a triangle, closed meshes stay closed and manifold at every level, and
+	// the geosphere's measured deviation stays within twice the reported error (plus
+	// what the unsimplified geosphere already deviates from the sphere).
+	void CheckSimplifier(CheckReport& report)
+	{
+		report.Begin("simplify");
+
+		GeometryGenerator geoGen;
+		const float ratios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+		const GeometryGenerator::MeshData grid = geoGen.CreateGrid(10.0f, 16.0f, 21, 33);
+		const std::vector<MeshLod> flat = BuildLodChain(grid, ratios, 4);
+		CheckLodLevels(report, "grid", flat, 5);
+
+		const DirectX::BoundingBox gridBox = ComputeBoundingBox(grid);
+		for(size_t lod = 1; lod < flat.size(); ++lod)
+		{
+			const GeometryGenerator::MeshData& mesh = flat[lod].Mesh;
+			report.Expect(flat[lod].Error == 0.0f, "grid: level %d has error %g", (int)lod, flat[lod].Error);
+
+			const DirectX::BoundingBox box = ComputeBoundingBox(mesh);
+			report.Expect(std::memcmp(&box.Center, &gridBox.Center, sizeof(box.Center)) == 0 &&
+				std::memcmp(&box.Extents, &gridBox.Extents, sizeof(box.Extents)) == 0, "grid: level %d lost part of its border", (int)lod);
+
+			for(size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+			{
+				const DirectX::XMFLOAT3& a = mesh.Vertices[mesh.Indices32[t + 0]].Position;
+				const DirectX::XMFLOAT3& b = mesh.Vertices[mesh.Indices32[t + 1]].Position;
+				const DirectX::XMFLOAT3& c = mesh.Vertices[mesh.Indices32[t + 2]].Position;
+				const float up = (b.z - a.z)*(c.x - a.x) - (b.x - a.x)*(c.z - a.z);
+				report.Expect(up > 0.0f, "grid: level %d triangle %d is flipped or degenerate", (int)lod, (int)t / 3);
+			}
+		}
+
+		const std::vector<MeshLod> sphere = BuildLodChain(geoGen.CreateGeosphere(1.0f, 4), ratios, 4);
+		CheckLodLevels(report, "geosphere", sphere, 5);
+
+		double baseRms = 0.0;
+		double baseLargest = 0.0;
+		if(!sphere.empty())
+			SphereDeviation(sphere[0].Mesh, baseRms, baseLargest);
+
+		for(size_t lod = 0; lod < sphere.size(); ++lod)
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "geosphere level %d", (int)lod);
+			CheckWatertight(report, name, sphere[lod].Mesh);
+
+			double rms = 0.0;
+			double largest = 0.0;
+			SphereDeviation(sphere[lod].Mesh, rms, largest);
+			report.Expect(rms <= 2.0*sphere[lod].Error + baseRms, "%s: deviation %g against a reported error of %g",
+				name, rms, sphere[lod].Error);
+		}
+
+		GeometryGenerator::MeshData tetrahedron = MakeTetrahedron();
+		for(int level = 0; level < 4; ++level)
+			geoGen.Subdivide(tetrahedron);
+
+		const std::vector<MeshLod> faceted = BuildLodChain(tetrahedron, ratios, 4);
+		CheckLodLevels(report, "tetrahedron", faceted, 5);
+		for(size_t lod = 0; lod < faceted.size(); ++lod)
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "tetrahedron level %d", (int)lod);
+			CheckWatertight(report, name, faceted[lod].Mesh);
+		}
+
+		report.End();
+	}
+
+	// CreateTorus with slice and cross counts that differ: every index in range, each
+	// quad of the (slice, cross section) lattice covered by exactly two triangles
+	// wound like the sphere's (normal facing away from the tube), and the mesh still
+	// optimizes and simplifies cleanly.
+	void CheckTorus(CheckReport& report)
+	{
+		report.Begin("torus");
+
+		GeometryGenerator geoGen;
+		const float radius = 4.0f;
+		const float crossRadius = 1.0f;
+		const GeometryGenerator::uint32 counts[][2] = { { 16, 8 }, { 8, 16 }, { 5, 11 }, { 32, 32 }, { 6, 4 } };
+		const float ratios[] = { 0.5f, 0.25f };
+
+		for(const auto& count : counts)
+		{
+			const GeometryGenerator::uint32 slices = count[0];
+			const GeometryGenerator::uint32 cross = count[1];
+			const GeometryGenerator::uint32 stride = cross + 1;
+			const GeometryGenerator::MeshData mesh = geoGen.CreateTorus(radius, crossRadius, slices, cross);
+
+			char name[32];
+			std::snprintf(name, sizeof(name), "torus %ux%u", slices, cross);
+
+			if(!report.Expect(mesh.Vertices.size() == (size_t)(slices + 1)*stride && mesh.Indices32.size() == (size_t)6*slices*cross,
+				"%s: %d vertices and %d indices", name, (int)mesh.Vertices.size(), (int)mesh.Indices32.size()))
+				continue;
+
+			std::vector<int> quadTriangles(slices*cross, 0);
+			bool inRange = true;
+			for(size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+			{
+				const GeometryGenerator::uint32* tri = &mesh.Indices32[t];
+				if(!report.Expect(tri[0] < mesh.Vertices.size() && tri[1] < mesh.Vertices.size() && tri[2] < mesh.Vertices.size(),
+					"%s: triangle %d is out of range", name, (int)t / 3))
+				{
+					inRange = false;
+					continue;
+				}
+
+				// The quad is the lowest slice and cross section the corners touch; the
+				// corners must not reach further than the next of each.
+				GeometryGenerator::uint32 slice = tri[0] / stride;
+				GeometryGenerator::uint32 ring = tri[0] % stride;
+				for(int c = 1; c < 3; ++c)
+				{
+					slice = std::min(slice, tri[c] / stride);
+					ring = std::min(ring, tri[c] % stride);
+				}
+				bool adjacent = slice < slices && ring < cross;
+				for(int c = 0; c < 3; ++c)
+					adjacent = adjacent && tri[c] / stride - slice <= 1 && tri[c] % stride - ring <= 1;
+				if(report.Expect(adjacent, "%s: triangle %d spans more than one quad", name, (int)t / 3))
+					++quadTriangles[slice*cross + ring];
+
+				const DirectX::XMFLOAT3& a = mesh.Vertices[tri[0]].Position;
+				const DirectX::XMFLOAT3& b = mesh.Vertices[tri[1]].Position;
+				const DirectX::XMFLOAT3& c = mesh.Vertices[tri[2]].Position;
+				const float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+				const float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+				float ox = (a.x + b.x + c.x) / 3.0f;
+				const float oy = (a.y + b.y + c.y) / 3.0f;
+				float oz = (a.z + b.z + c.z) / 3.0f;
+				const float ringDistance = std::sqrt(ox*ox + oz*oz);
+				ox -= radius*ox / ringDistance;
+				oz -= radius*oz / ringDistance;
+				report.Expect((uy*vz - uz*vy)*ox + (uz*vx - ux*vz)*oy + (ux*vy - uy*vx)*oz > 0.0f,
+					"%s: triangle %d faces into the tube", name, (int)t / 3);
+			}
+
+			report.Expect(std::count(quadTriangles.begin(), quadTriangles.end(), 2) == (std::ptrdiff_t)quadTriangles.size(),
+				"%s: not every quad has exactly two triangles", name);
+
+			for(size_t v = 0; v < mesh.Vertices.size(); ++v)
+			{
+				const DirectX::XMFLOAT3& p = mesh.Vertices[v].Position;
+				const float d = std::sqrt(p.x*p.x + p.z*p.z) - radius;
+				report.Expect(std::fabs(std::sqrt(d*d + p.y*p.y) - crossRadius) <= 1e-4f, "%s: vertex %d is off the tube", name, (int)v);
+			}
+
+			// Out of range indices would overrun the optimizer's and simplifier's
+			// per-vertex tables, so only run them on a mesh that passed.
+			if(!inRange)
+				continue;
+
+			CheckOptimizeMesh(report, name, mesh);
+
+			const std::vector<MeshLod> chain = BuildLodChain(mesh, ratios, 2);
+			CheckLodLevels(report, name, chain, 3);
+		}
+
+		report.End();
+	}
+
+	// Whether two cache contents describe the same batch, byte for byte.
+	bool SameCacheContents(const MeshCacheContents& a, const MeshCacheContents& b)
+	{
+		if(a.Key != b.Key || a.VertexByteStride != b.VertexByteStride || a.IndexStride != b.IndexStride ||
+			a.VertexBufferByteSize != b.VertexBufferByteSize || a.IndexBufferByteSize != b.IndexBufferByteSize ||
+			a.Submeshes.size() != b.Submeshes.size())
+			return false;
+
+		if(std::memcmp(a.Vertices, b.Vertices, a.VertexBufferByteSize) != 0 ||
+			std::memcmp(a.Indices, b.Indices, a.IndexBufferByteSize) != 0)
+			return false;
+
+		for(size_t s = 0; s < a.Submeshes.size(); ++s)
+		{
+			const MeshCacheSubmesh& x = a.Submeshes[s];
+			const MeshCacheSubmesh& y = b.Submeshes[s];
+			if(x.Name != y.Name || x.IndexCount != y.IndexCount || x.StartIndexLocation != y.StartIndexLocation ||
+				x.BaseVertexLocation != y.BaseVertexLocation || x.LodError != y.LodError ||
+				std::memcmp(&x.Bounds.Center, &y.Bounds.Center, sizeof(x.Bounds.Center)) != 0 ||
+				std::memcmp(&x.Bounds.Extents, &y.Bounds.Extents, sizeof(x.Bounds.Extents)) != 0 ||
+				std::memcmp(&x.Sphere.Center, &y.Sphere.Center, sizeof(x.Sphere.Center)) != 0 ||
+				x.Sphere.Radius != y.Sphere.Radius)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Writes meshes as one batch at indexStride bytes per index, reads the file back
+	// mapped and parsed, and checks that a changed key, a truncated file and corrupted
+	// counts or ranges are all turned away.
+	void CheckMeshCacheOf(CheckReport& report, const char* name, const std::vector<GeometryGenerator::MeshData>& meshes,
+		GeometryGenerator::uint32 indexStride)
+	{
+		const std::wstring path = L"geometrybench-check.meshcache";
+		const std::string narrowPath(path.begin(), path.end());
+
+		std::vector<GeometryGenerator::Vertex> vertices;
+		std::vector<unsigned char> indices;
+
+		MeshCacheContents contents;
+		contents.Key = 0x0123456789ABCDEFull + indexStride;
+		contents.VertexByteStride = sizeof(GeometryGenerator::Vertex);
+		contents.IndexStride = indexStride;
+
+		for(size_t m = 0; m < meshes.size(); ++m)
+		{
+			const GeometryGenerator::MeshData& mesh = meshes[m];
+
+			MeshCacheSubmesh submesh;
+			submesh.Name = "mesh" + std::to_string(m);
+			submesh.IndexCount = (std::uint32_t)mesh.Indices32.size();
+			submesh.StartIndexLocation = (std::uint32_t)(indices.size() / indexStride);
+			submesh.BaseVertexLocation = (std::int32_t)vertices.size();
+			submesh.Bounds = ComputeBoundingBox(mesh);
+			submesh.Sphere = ComputeBoundingSphere(mesh, submesh.Bounds);
+			submesh.LodError = 0.125f*m;
+			contents.Submeshes.push_back(submesh);
+
+			vertices.insert(vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+			indices.resize(indices.size() + mesh.Indices32.size()*indexStride);
+			mesh.WriteIndices(&indices[submesh.StartIndexLocation*indexStride], indexStride);
+		}
+
+		contents.Vertices = vertices.data();
+		contents.VertexBufferByteSize = (std::uint32_t)(vertices.size()*sizeof(GeometryGenerator::Vertex));
+		contents.Indices = indices.data();
+		contents.IndexBufferByteSize = (std::uint32_t)indices.size();
+
+		if(!report.Expect(WriteMeshCache(path, contents), "%s: could not write %s", name, narrowPath.c_str()))
+			return;
+
+		FILE* leftover = std::fopen((narrowPath + ".tmp").c_str(), "rb");
+		report.Expect(leftover == nullptr, "%s: the temporary file was left behind", name);
+		if(leftover)
+			std::fclose(leftover);
+
+		{
+			MappedMeshCache mapped;
+			if(report.Expect(mapped.Open(path, contents.Key), "%s: the file written could not be opened", name))
+			{
+				report.Expect(SameCacheContents(mapped.Contents(), contents), "%s: the mapped file differs from what was written", name);
+				report.Expect((std::uintptr_t)mapped.Contents().Vertices % MeshCacheAlignment == 0 &&
+					(std::uintptr_t)mapped.Contents().Indices % MeshCacheAlignment == 0, "%s: the mapped buffers are not aligned", name);
+			}
+
+			MappedMeshCache stale;
+			report.Expect(!stale.Open(path, contents.Key + 1), "%s: the file opened under another key", name);
+		}
+
+		// The same file in memory, for damaging.
+		std::vector<char> file;
+		if(FILE* f = std::fopen(narrowPath.c_str(), "rb"))
+		{
+			char buffer[4096];
+			size_t read = 0;
+			while((read = std::fread(buffer, 1, sizeof(buffer), f)) != 0)
+				file.insert(file.end(), buffer, buffer + read);
+			std::fclose(f);
+		}
+		std::remove(narrowPath.c_str());
+
+		MeshCacheContents parsed;
+		if(!report.Expect(ParseMeshCache(file.data(), file.size(), contents.Key, parsed), "%s: the file does not parse", name))
+			return;
+
+		const size_t truncated[] = { 0, sizeof(MeshCacheHeader) - 1, sizeof(MeshCacheHeader), file.size() / 2, file.size() - 1 };
+		for(size_t size : truncated)
+			report.Expect(!ParseMeshCache(file.data(), size, contents.Key, parsed), "%s: parsed when cut to %d bytes", name, (int)size);
+
+		const MeshCacheHeader header = *(const MeshCacheHeader*)file.data();
+		const size_t submeshCountOffset = offsetof(MeshCacheHeader, SubmeshCount);
+		const size_t firstSubmesh = sizeof(MeshCacheHeader);
+
+		struct Damage
+		{
+			const char* What;
+			size_t Offset;
+			std::uint32_t Value;
+		};
+		const Damage damages[] =
+		{
+			{ "a corrupt magic", offsetof(MeshCacheHeader, Magic), header.Magic ^ 1u },
+			{ "another version", offsetof(MeshCacheHeader, Version), header.Version + 1 },
+			{ "a huge submesh count", submeshCountOffset, 0x7FFFFFFFu },
+			{ "a submesh count past the names", submeshCountOffset, header.SubmeshCount + (header.NameByteSize + 64) / (std::uint32_t)sizeof(MeshCacheFileSubmesh) + 1 },
+			{ "a bad index stride", offsetof(MeshCacheHeader, IndexStride), 3 },
+			{ "a misaligned vertex buffer", offsetof(MeshCacheHeader, VertexBufferOffset), (std::uint32_t)header.VertexBufferOffset + 4 },
+			{ "an index range past the buffer", firstSubmesh + offsetof(MeshCacheFileSubmesh, IndexCount), header.IndexBufferByteSize / indexStride + 1 },
+			{ "a name past the names", firstSubmesh + offsetof(MeshCacheFileSubmesh, NameOffset), header.NameByteSize },
+			{ "a negative base vertex", firstSubmesh + offsetof(MeshCacheFileSubmesh, BaseVertexLocation), 0xFFFFFFFFu },
+		};
+
+		for(const Damage& damage : damages)
+		{
+			std::vector<char> damaged = file;
+			std::memcpy(&damaged[damage.Offset], &damage.Value, sizeof(damage.Value));
+			report.Expect(!ParseMeshCache(damaged.data(), damaged.size(), contents.Key, parsed), "%s: parsed with %s", name, damage.What);
+		}
+	}
+
+	// MeshCache round trips with 16-bit and 32-bit indices and rejects damaged files.
+	void CheckMeshCache(CheckReport& report)
+	{
+		report.Begin("mesh_cache");
+
+		GeometryGenerator geoGen;
+
+		std::vector<GeometryGenerator::MeshData> meshes;
+		meshes.push_back(geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3));
+		meshes.push_back(geoGen.CreateSphere(0.5f, 20, 20));
+		meshes.push_back(geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0));
+		CheckMeshCacheOf(report, "16-bit", meshes, 2);
+
+		meshes.push_back(geoGen.CreateGrid(300.0f, 300.0f, 300, 300));
+		CheckMeshCacheOf(report, "32-bit", meshes, 4);
+
+		report.End();
+	}
+
+#if defined(_WIN32)
+	// The app's vertex format (see FrameResource.h).
+	struct CheckVertex
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Normal;
+		DirectX::XMFLOAT2 TexC;
+	};
+
+	void WriteCheckVertices(const GeometryGenerator::Vertex* src, size_t count, void* dst)
+	{
+		CheckVertex* v = static_cast<CheckVertex*>(dst);
+		for(size_t i = 0; i < count; ++i)
+		{
+			v[i].Pos = src[i].Position;
+			v[i].Normal = src[i].Normal;
+			v[i].TexC = src[i].TexC;
+		}
+	}
+
+	// Builds meshes with MeshBatchBuilder (every other one added as a generator, the
+	// rest as MeshData) and compares the result with a serial concatenation of the same
+	// optimized meshes: vertex and index bytes, index format and every DrawArgs entry,
+	// bounds included.
+	void CheckBatchOf(CheckReport& report, const char* name,
+		const std::vector<std::pair<std::string, GeometryGenerator::MeshData>>& meshes, TaskScheduler* scheduler,
+		bool spheres)
+	{
+		MeshBatchBuilder builder(sizeof(CheckVertex), WriteCheckVertices);
+		builder.SetComputeBoundingSpheres(spheres);
+		for(size_t m = 0; m < meshes.size(); ++m)
+		{
+			GeometryGenerator::MeshData mesh = meshes[m].second;
+			if(m % 2 == 0)
+				builder.Add(meshes[m].first, [mesh](GeometryGenerator&) { return mesh; });
+			else
+				builder.Add(meshes[m].first, std::move(mesh));
+		}
+
+		std::unique_ptr<MeshGeometry> geo = builder.Build(name, nullptr, nullptr, scheduler);
+
+		// The reference: the same meshes optimized and appended one after another.
+		std::vector<GeometryGenerator::MeshData> optimized;
+		GeometryGenerator::uint32 indexStride = 2;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		for(const auto& named : meshes)
+		{
+			optimized.push_back(named.second);
+			OptimizeMesh(optimized.back());
+			indexStride = std::max(indexStride, optimized.back().IndexStride());
+			vertexCount += optimized.back().Vertices.size();
+			indexCount += optimized.back().Indices32.size();
+		}
+
+		std::vector<unsigned char> vertices(vertexCount*sizeof(CheckVertex));
+		std::vector<unsigned char> indices(indexCount*indexStride);
+		size_t baseVertex = 0;
+		size_t startIndex = 0;
+		for(size_t m = 0; m < meshes.size(); ++m)
+		{
+			const GeometryGenerator::MeshData& mesh = optimized[m];
+			WriteCheckVertices(mesh.Vertices.data(), mesh.Vertices.size(), &vertices[baseVertex*sizeof(CheckVertex)]);
+			mesh.WriteIndices(indices.data() + startIndex*indexStride, indexStride);
+
+			auto it = geo->DrawArgs.find(meshes[m].first);
+			if(report.Expect(it != geo->DrawArgs.end(), "%s: no DrawArgs for %s", name, meshes[m].first.c_str()))
+			{
+				const SubmeshGeometry& submesh = it->second;
+				report.Expect(submesh.IndexCount == mesh.Indices32.size() && submesh.StartIndexLocation == startIndex &&
+					submesh.BaseVertexLocation == (INT)baseVertex, "%s: %s drawn as %u indices from %u, base %d",
+					name, meshes[m].first.c_str(), submesh.IndexCount, submesh.StartIndexLocation, submesh.BaseVertexLocation);
+
+				// Without spheres requested, Sphere keeps its default.
+				const DirectX::BoundingBox box = ComputeBoundingBox(mesh);
+				const DirectX::BoundingSphere sphere = spheres ? ComputeBoundingSphere(mesh, box) : DirectX::BoundingSphere();
+				report.Expect(std::memcmp(&submesh.Bounds.Center, &box.Center, sizeof(box.Center)) == 0 &&
+					std::memcmp(&submesh.Bounds.Extents, &box.Extents, sizeof(box.Extents)) == 0,
+					"%s: %s has the wrong Bounds", name, meshes[m].first.c_str());
+				report.Expect(std::memcmp(&submesh.Sphere.Center, &sphere.Center, sizeof(sphere.Center)) == 0 &&
+					submesh.Sphere.Radius == sphere.Radius, "%s: %s has the wrong Sphere", name, meshes[m].first.c_str());
+			}
+
+			baseVertex += mesh.Vertices.size();
+			startIndex += mesh.Indices32.size();
+		}
+
+		report.Expect(geo->DrawArgs.size() == meshes.size(), "%s: %d DrawArgs for %d meshes",
+			name, (int)geo->DrawArgs.size(), (int)meshes.size());
+		report.Expect(geo->VertexByteStride == sizeof(CheckVertex), "%s: vertex stride %u", name, geo->VertexByteStride);
+		report.Expect(geo->IndexFormat == (indexStride == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT),
+			"%s: wrong index format for %u-byte indices", name, indexStride);
+
+		if(report.Expect(geo->VertexBufferByteSize == vertices.size() && geo->VertexBufferCPU->GetBufferSize() == vertices.size(),
+			"%s: %u vertex bytes, expected %d", name, geo->VertexBufferByteSize, (int)vertices.size()))
+		{
+			report.Expect(std::memcmp(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vertices.size()) == 0,
+				"%s: the vertex buffer differs", name);
+		}
+
+		if(report.Expect(geo->IndexBufferByteSize == indices.size() && geo->IndexBufferCPU->GetBufferSize() == indices.size(),
+			"%s: %u index bytes, expected %d", name, geo->IndexBufferByteSize, (int)indices.size()))
+		{
+			report.Expect(std::memcmp(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), indices.size()) == 0,
+				"%s: the index buffer differs", name);
+		}
+	}
+
+	// MeshBatchBuilder against a plain serial concatenation, on a pool and serially,
+	// with 16-bit indices and with one mesh large enough to need 32-bit ones.
+	void CheckMeshBatch(CheckReport& report)
+	{
+		report.Begin("mesh_batch");
+
+		GeometryGenerator geoGen;
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(4);
+
+		std::vector<std::pair<std::string, GeometryGenerator::MeshData>> meshes;
+		meshes.emplace_back("box", geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3));
+		meshes.emplace_back("sphere", geoGen.CreateSphere(0.5f, 20, 20));
+		meshes.emplace_back("wedge", geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 0));
+		meshes.emplace_back("grid", geoGen.CreateGrid(20.0f, 30.0f, 30, 40));
+		meshes.emplace_back("geosphere", geoGen.CreateGeosphere(0.5f, 3));
+		meshes.emplace_back("torus", geoGen.CreateTorus(4.0f, 1.0f, 24, 24));
+
+		CheckBatchOf(report, "16-bit batch", meshes, scheduler.get(), true);
+		CheckBatchOf(report, "serial 16-bit batch", meshes, nullptr, false);
+
+		meshes.emplace_back("terrain", geoGen.CreateGrid(300.0f, 300.0f, 300, 300));
+		CheckBatchOf(report, "32-bit batch", meshes, scheduler.get(), true);
+
+		report.End();
+	}
+
+	// Whether two built batches hold the same bytes and DrawArgs, bounds included.
+	bool SameGeometry(const MeshGeometry& a, const MeshGeometry& b)
+	{
+		if(a.VertexByteStride != b.VertexByteStride || a.IndexFormat != b.IndexFormat ||
+			a.VertexBufferByteSize != b.VertexBufferByteSize || a.IndexBufferByteSize != b.IndexBufferByteSize ||
+			a.DrawArgs.size() != b.DrawArgs.size())
+			return false;
+
+		if(std::memcmp(a.VertexBufferCPU->GetBufferPointer(), b.VertexBufferCPU->GetBufferPointer(), a.VertexBufferByteSize) != 0 ||
+			std::memcmp(a.IndexBufferCPU->GetBufferPointer(), b.IndexBufferCPU->GetBufferPointer(), a.IndexBufferByteSize) != 0)
+			return false;
+
+		for(const auto& arg : a.DrawArgs)
+		{
+			auto it = b.DrawArgs.find(arg.first);
+			if(it == b.DrawArgs.end())
+				return false;
+
+			const SubmeshGeometry& x = arg.second;
+			const SubmeshGeometry& y = it->second;
+			if(x.IndexCount != y.IndexCount || x.StartIndexLocation != y.StartIndexLocation ||
+				x.BaseVertexLocation != y.BaseVertexLocation || x.LodError != y.LodError ||
+				std::memcmp(&x.Bounds.Center, &y.Bounds.Center, sizeof(x.Bounds.Center)) != 0 ||
+				std::memcmp(&x.Bounds.Extents, &y.Bounds.Extents, sizeof(x.Bounds.Extents)) != 0 ||
+				std::memcmp(&x.Sphere.Center, &y.Sphere.Center, sizeof(x.Sphere.Center)) != 0 ||
+				x.Sphere.Radius != y.Sphere.Radius)
+				return false;
+		}
+
+		return true;
+	}
+
+	// A batch built through a cache file: the first build generates and saves, the
+	// second maps the file without running a generator and gives the same geometry,
+	// levels of detail included, and a changed key generates again.
+	void CheckBatchCacheOf(CheckReport& report, const char* name, bool wide)
+	{
+		const std::wstring path = L"geometrybench-check-batch.meshcache";
+		const std::string narrowPath(path.begin(), path.end());
+		std::remove(narrowPath.c_str());
+
+		const float lodRatios[] = { 0.5f, 0.25f };
+
+		int generated = 0;
+		auto build = [&](const char* boxKey)
+		{
+			MeshBatchBuilder builder(sizeof(CheckVertex), WriteCheckVertices);
+			builder.SetCacheFile(path);
+			builder.SetComputeBoundingSpheres(true);
+			builder.Add("box", boxKey, [&](GeometryGenerator& g) { ++generated; return g.CreateBox(1.5f, 0.5f, 1.5f, 3); });
+			builder.Add("sphere", "CreateSphere(0.5f, 20, 20)", [&](GeometryGenerator& g) { ++generated; return g.CreateSphere(0.5f, 20, 20); },
+				std::vector<float>(lodRatios, lodRatios + 2));
+			if(wide)
+				builder.Add("terrain", "CreateGrid(300.0f, 300.0f, 300, 300)", [&](GeometryGenerator& g) { ++generated; return g.CreateGrid(300.0f, 300.0f, 300, 300); });
+			return builder.Build(name, nullptr, nullptr);
+		};
+
+		const int meshCount = wide ? 3 : 2;
+
+		std::unique_ptr<MeshGeometry> fresh = build("CreateBox(1.5f, 0.5f, 1.5f, 3)");
+		report.Expect(generated == meshCount, "%s: the first build ran %d generators", name, generated);
+
+		// The sphere's levels are stored as submeshes of their own, with the errors
+		// BuildLodChain reports.
+		GeometryGenerator geoGen;
+		const std::vector<MeshLod> lods = BuildLodChain(geoGen.CreateSphere(0.5f, 20, 20), lodRatios, 2);
+		const std::vector<const SubmeshGeometry*> chain = GetLodChain(*fresh, "sphere");
+		if(report.Expect(chain.size() == lods.size() && fresh->DrawArgs.count(LodName("sphere", 2)) == 1,
+			"%s: %d levels for the sphere, expected %d", name, (int)chain.size(), (int)lods.size()))
+		{
+			for(size_t lod = 0; lod < chain.size(); ++lod)
+			{
+				report.Expect(chain[lod]->IndexCount == lods[lod].Mesh.Indices32.size() && chain[lod]->LodError == lods[lod].Error,
+					"%s: sphere level %d has %u indices and error %g, expected %d and %g", name, (int)lod,
+					chain[lod]->IndexCount, chain[lod]->LodError, (int)lods[lod].Mesh.Indices32.size(), lods[lod].Error);
+			}
+		}
+
+		std::unique_ptr<MeshGeometry> cached = build("CreateBox(1.5f, 0.5f, 1.5f, 3)");
+		report.Expect(generated == meshCount, "%s: the cached build ran %d generators", name, generated - meshCount);
+		report.Expect(SameGeometry(*fresh, *cached), "%s: the cached build differs from the generated one", name);
+
+		build("CreateBox(1.5f, 0.5f, 1.5f, 2)");
+		report.Expect(generated == 2*meshCount, "%s: a changed key ran %d generators", name, generated - meshCount);
+
+		std::remove(narrowPath.c_str());
+	}
+
+	void CheckMeshBatchCache(CheckReport& report)
+	{
+		report.Begin("mesh_batch_cache");
+		CheckBatchCacheOf(report, "16-bit cache", false);
+		CheckBatchCacheOf(report, "32-bit cache", true);
+		report.End();
+	}
+#endif
+
+	int RunChecks()
+	{
+		CheckReport report;
+		CheckSubdivide(report);
+		CheckOptimizer(report);
+		CheckWriteIndices(report);
+		CheckBounds(report);
+		CheckMeshCache(report);
+		CheckSimplifier(report);
+		CheckTorus(report);
+#if defined(_WIN32)
+		CheckMeshBatch(report);
+		CheckMeshBatchCache(report);
+#endif
+		return report.Failures() == 0 ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: %s [--threads 1,2,...] [--min-time seconds]\n"
+			"       %s --check\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	if(options.Check)
+		return RunChecks();
+
+	const double minTime = options.MinTime;
+	const int maxThreads = *std::max_element(options.Threads.begin(), options.Threads.end());
+
+	std::printf("{\n  \"hardware_threads\": %u,\n  \"min_time_s\": %g,\n  \"results\": [",
+		std::thread::hardware_concurrency(), minTime);
+
+	JsonWriter json;
+	GeometryGenerator geoGen;
+
+	BenchMesh(json, minTime, "sphere", "512 slices, 256 stacks", 1, 0.0, nullptr, [&]() { return geoGen.CreateSphere(1.0f, 512, 256); });
+	BenchMesh(json, minTime, "cylinder", "512 slices, 512 stacks", 1, 0.0, nullptr, [&]() { return geoGen.CreateCylinder(1.0f, 0.5f, 4.0f, 512, 512); });
+	BenchMesh(json, minTime, "torus", "512 slices, 512 cross", 1, 0.0, nullptr, [&]() { return geoGen.CreateTorus(4.0f, 1.0f, 512, 512); });
+	BenchMesh(json, minTime, "geosphere", "6 subdivisions", 1, 0.0, nullptr, [&]() { return geoGen.CreateGeosphere(1.0f, 6); });
+
+	// Thread scaling of the grid; one thread is the serial CreateGrid.
+	double baseline = 0.0;
+	for(int threads : options.Threads)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+
+		double ns = 0.0;
+		BenchMesh(json, minTime, "grid", "2048 x 2048", threads, baseline, &ns,
+			[&]() { return geoGen.CreateGrid(2048.0f, 2048.0f, 2048, 2048, scheduler.get()); });
+		if(baseline == 0.0)
+			baseline = ns;
+	}
+
+	BenchGridChunks(json, minTime, maxThreads);
+
+	// Vertex cache optimization, FIFO cache of 16 entries.  The copy of the source mesh
+	// is part of the time.
+	BenchOptimize(json, minTime, "optimize_sphere", "512 slices, 256 stacks", geoGen.CreateSphere(1.0f, 512, 256));
+	BenchOptimize(json, minTime, "optimize_geosphere", "6 subdivisions", geoGen.CreateGeosphere(1.0f, 6));
+	BenchOptimize(json, minTime, "optimize_grid", "512 x 512", geoGen.CreateGrid(512.0f, 512.0f, 512, 512));
+
+	BenchBounds(json, minTime, "sphere, 512 slices, 256 stacks", geoGen.CreateSphere(1.0f, 512, 256));
+
+	// Simplification; errors are in the meshes' own units.
+	BenchLodChain(json, minTime, "lod_sphere", "128 slices, 64 stacks", geoGen.CreateSphere(1.0f, 128, 64));
+	BenchLodChain(json, minTime, "lod_torus", "96 slices, 96 cross", geoGen.CreateTorus(4.0f, 1.0f, 96, 96));
+
+	std::printf("\n  ]\n}\n");
+	return 0;
+}
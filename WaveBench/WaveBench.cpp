@@ -0,0 +1,902 @@
+//***************************************************************************************
+// WaveBench.cpp
+//
+// Headless benchmark for the wave solver.  It needs no window, GPU or Direct3D, only
+// Waves.cpp, WaveBatch.cpp, WaterClipmap.cpp and TaskScheduler.cpp, and prints one JSON document to stdout so CI can
+// track regressions.
+//
+// Windows: build WaveBench.vcxproj from the solution.
+// Linux: DirectXMath is header-only; put its Inc directory and a sal.h (for example
+// the one shipped with DirectX-Headers) on the include path, then from the repository
+// root compile the sources together:
+//
+//   g++ -std=c++14 -O2 -pthread -I<DirectXMath>/Inc -I<dir with sal.h> -o wavebench
+//       WaveBench/WaveBench.cpp "lab assignment 1/Waves.cpp"
+//       "lab assignment 1/WaveBatch.cpp" "lab assignment 1/WaterClipmap.cpp"
+//       Common/TaskScheduler.cpp
+//
+// Usage: wavebench [--sizes 128,256,...] [--threads 1,2,...] [--min-time seconds]
+//        wavebench --check
+//
+// Every workload runs until at least --min-time seconds have passed (0.25 by default)
+// and reports the mean time per iteration.  GB/s figures use a simple traffic model
+// (bytes_per_cell: each buffer read or written once per step) rather than measured
+// memory traffic.
+//
+// --check runs the correctness checks instead, prints one line per check, reports
+// every failure on stderr and exits non-zero if any check failed.
+//***************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../lab assignment 1/WaterClipmap.h"
+#include "../lab assignment 1/WaveBatch.h"
+#include "../lab assignment 1/Waves.h"
+
+namespace
+{
+	const float TimeStep = 0.03f;
+	const float Speed = 4.0f;
+	const float Damping = 0.2f;
+
+	struct Options
+	{
+		std::vector<int> Sizes = { 128, 256, 512, 1024, 2048, 4096 };
+		std::vector<int> Threads;
+		double MinTime = 0.25;
+		bool Check = false;
+	};
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		while(*text)
+		{
+			char* end = nullptr;
+			long v = std::strtol(text, &end, 10);
+			if(end == text)
+				break;
+			if(v > 0)
+				values.push_back((int)v);
+			text = (*end == ',') ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for(int a = 1; a < argc; ++a)
+		{
+			if(std::strcmp(argv[a], "--check") == 0)
+				options.Check = true;
+			else if(a + 1 < argc && std::strcmp(argv[a], "--sizes") == 0)
+				options.Sizes = ParseList(argv[++a]);
+			else if(a + 1 < argc && std::strcmp(argv[a], "--threads") == 0)
+				options.Threads = ParseList(argv[++a]);
+			else if(a + 1 < argc && std::strcmp(argv[a], "--min-time") == 0)
+				options.MinTime = std::atof(argv[++a]);
+			else
+				return false;
+		}
+
+		if(options.Threads.empty())
+		{
+			// 1, 2, 4, ... and the machine's own thread count.
+			const int hardware = std::max((int)std::thread::hardware_concurrency(), 1);
+			for(int t = 1; t < hardware; t *= 2)
+				options.Threads.push_back(t);
+			options.Threads.push_back(hardware);
+		}
+
+		return !options.Sizes.empty();
+	}
+
+	// Mean nanoseconds per call of body, after two warm-up calls.
+	double TimeIterations(double minTime, const std::function<void()>& body)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		body();
+		body();
+
+		int iterations = 0;
+		const Clock::time_point start = Clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			body();
+			++iterations;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while(elapsed < minTime || iterations < 3);
+
+		return elapsed*1e9 / iterations;
+	}
+
+	std::unique_ptr<TaskScheduler> MakeScheduler(int threads)
+	{
+		if(threads <= 1)
+			return nullptr;
+		return std::unique_ptr<TaskScheduler>(new ThreadPoolTaskScheduler(threads));
+	}
+
+	// Keeps a full grid busy; without fresh impulses the waves would damp out into
+	// denormals and the timings would measure those instead.
+	void Stir(Waves& waves, unsigned& seed)
+	{
+		for(int k = 0; k < 4; ++k)
+		{
+			seed = seed*1664525u + 1013904223u;
+			int i = 2 + (int)((seed >> 8) % (unsigned)(waves.RowCount() - 4));
+			int j = 2 + (int)((seed >> 20) % (unsigned)(waves.ColumnCount() - 4));
+			waves.Disturb(i, j, 0.5f);
+		}
+	}
+
+	class JsonWriter
+	{
+	public:
+		void Begin(int size, const char* workload, int threads)
+		{
+			std::printf("%s\n    { \"size\": %d, \"workload\": \"%s\", \"threads\": %d",
+				mFirst ? "" : ",", size, workload, threads);
+			mFirst = false;
+		}
+
+		void Field(const char* name, double value)
+		{
+			std::printf(", \"%s\": %.6g", name, value);
+		}
+
+		void End()
+		{
+			std::printf(" }");
+			std::fflush(stdout);
+		}
+
+	private:
+		bool mFirst = true;
+	};
+
+	// One Update() of a grid that pays for exactly one time step.
+	void BenchStep(JsonWriter& json, const Options& options, int size, const char* workload,
+		WaveSolverMode mode, bool lazyNormals, int threads, double bytesPerCell, double baseline, double* nsOut)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+
+		Waves waves(size, size, 1.0f, TimeStep, Speed, Damping);
+		waves.SetScheduler(scheduler.get());
+		waves.SetSolverMode(mode);
+		waves.SetLazyNormals(lazyNormals);
+
+		unsigned seed = 1;
+		const double ns = TimeIterations(options.MinTime, [&]()
+		{
+			Stir(waves, seed);
+			waves.Update(TimeStep);
+		});
+
+		const double cells = (double)(size - 2)*(size - 2);
+
+		json.Begin(size, workload, threads);
+		json.Field("ns_per_step", ns);
+		json.Field("ns_per_cell", ns / cells);
+		json.Field("bytes_per_cell", bytesPerCell);
+		json.Field("gb_per_s", bytesPerCell*cells / ns);
+		if(baseline > 0.0)
+			json.Field("speedup", baseline / ns);
+		json.End();
+
+		waves.SetScheduler(nullptr);
+
+		if(nsOut)
+			*nsOut = ns;
+	}
+
+	// A single disturbed corner on an otherwise calm grid with sleeping tiles.
+	void BenchSparse(JsonWriter& json, const Options& options, int size, int threads)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+
+		Waves waves(size, size, 1.0f, TimeStep, Speed, Damping);
+		waves.SetScheduler(scheduler.get());
+		waves.SetSleepThreshold(1e-4f);
+
+		const int corner = std::max(size / 8, 5);
+		unsigned seed = 1;
+		const double ns = TimeIterations(options.MinTime, [&]()
+		{
+			seed = seed*1664525u + 1013904223u;
+			waves.Disturb(2 + (int)((seed >> 8) % (unsigned)(corner - 4)), 2 + (int)((seed >> 20) % (unsigned)(corner - 4)), 0.5f);
+			waves.Update(TimeStep);
+		});
+
+		json.Begin(size, "sparse", threads);
+		json.Field("ns_per_step", ns);
+		json.Field("ns_per_cell", ns / ((double)(size - 2)*(size - 2)));
+		json.Field("active_tile_ratio", waves.ActivityStats().ActiveTileRatio);
+		json.End();
+
+		waves.SetScheduler(nullptr);
+	}
+
+	// One batched Disturb() of many small impulses spread over the grid.
+	void BenchDisturb(JsonWriter& json, const Options& options, int size, int threads)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+
+		Waves waves(size, size, 1.0f, TimeStep, Speed, Damping);
+		waves.SetScheduler(scheduler.get());
+
+		const int count = 10000;
+		std::vector<WaveImpulse> impulses(count);
+		unsigned seed = 7;
+		for(auto& impulse : impulses)
+		{
+			seed = seed*1664525u + 1013904223u;
+			impulse.Row = (int)((seed >> 8) % (unsigned)size);
+			impulse.Col = (int)((seed >> 20) % (unsigned)size);
+			impulse.Magnitude = 1e-3f;
+			impulse.Radius = 3.0f;
+		}
+
+		const double ns = TimeIterations(options.MinTime, [&]()
+		{
+			waves.Disturb(impulses.data(), count);
+		});
+
+		json.Begin(size, "disturb_batch", threads);
+		json.Field("impulses", count);
+		json.Field("ns_per_batch", ns);
+		json.Field("ns_per_impulse", ns / count);
+		json.End();
+
+		waves.SetScheduler(nullptr);
+	}
+
+	// One time step of many small ponds: a single WaveBatch against the same ponds as
+	// separate Waves objects, each paying for its own dispatch.
+	void BenchBatch(JsonWriter& json, const Options& options, int size, int gridCount, int threads)
+	{
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(threads);
+
+		std::vector<std::unique_ptr<Waves>> ponds;
+		WaveBatch batch;
+		for(int g = 0; g < gridCount; ++g)
+		{
+			ponds.emplace_back(new Waves(size, size, 1.0f, TimeStep, Speed, Damping));
+			ponds.back()->SetScheduler(scheduler.get());
+			batch.AddGrid(size, size, 1.0f, TimeStep, Speed, Damping);
+		}
+		batch.SetScheduler(scheduler.get());
+
+		// One fresh impulse per step keeps the ponds from damping out into denormals.
+		unsigned seed = 1;
+		const double separateNs = TimeIterations(options.MinTime, [&]()
+		{
+			seed = seed*1664525u + 1013904223u;
+			ponds[seed % (unsigned)gridCount]->Disturb(2 + (int)((seed >> 8) % (unsigned)(size - 4)),
+				2 + (int)((seed >> 20) % (unsigned)(size - 4)), 0.5f);
+			for(auto& pond : ponds)
+				pond->Step(1);
+		});
+
+		seed = 1;
+		const double batchNs = TimeIterations(options.MinTime, [&]()
+		{
+			seed = seed*1664525u + 1013904223u;
+			batch.Disturb(seed % (unsigned)gridCount, 2 + (int)((seed >> 8) % (unsigned)(size - 4)),
+				2 + (int)((seed >> 20) % (unsigned)(size - 4)), 0.5f);
+			batch.Step(1);
+		});
+
+		const double cells = (double)gridCount*(size - 2)*(size - 2);
+
+		json.Begin(size, "batch", threads);
+		json.Field("grids", gridCount);
+		json.Field("ns_per_step", batchNs);
+		json.Field("ns_per_cell", batchNs / cells);
+		json.Field("separate_ns_per_step", separateNs);
+		json.Field("separate_ns_per_cell", separateNs / cells);
+		json.Field("speedup", separateNs / batchNs);
+		json.End();
+
+		for(auto& pond : ponds)
+			pond->SetScheduler(nullptr);
+		batch.SetScheduler(nullptr);
+	}
+
+	// Results of --check.  Failures go to stderr as they happen (the first few of each
+	// check, so one broken loop cannot bury the rest), and a summary line per check to
+	// stdout.
+	class CheckReport
+	{
+	public:
+		void Begin(const char* name)
+		{
+			mName = name;
+			mCheckFailures = 0;
+		}
+
+		// Counts a failure unless condition holds; format and the rest are printf-style.
+		bool Expect(bool condition, const char* format, ...)
+		{
+			if(condition)
+				return true;
+
+			if(mCheckFailures++ < 8)
+			{
+				std::fprintf(stderr, "FAILED %s: ", mName);
+				va_list args;
+				va_start(args, format);
+				std::vfprintf(stderr, format, args);
+				va_end(args);
+				std::fprintf(stderr, "\n");
+			}
+
+			++mFailures;
+			return false;
+		}
+
+		void End()
+		{
+			std::printf("%-20s %s\n", mName, mCheckFailures == 0 ? "ok" : "FAILED");
+			std::fflush(stdout);
+		}
+
+		int Failures()const { return mFailures; }
+
+	private:
+		const char* mName = "";
+		int mCheckFailures = 0;
+		int mFailures = 0;
+	};
+
+	// Runs a few steps of disturbances so heights and normals are all different.
+	void Churn(Waves& waves, int steps)
+	{
+		unsigned seed = 3;
+		for(int s = 0; s < steps; ++s)
+		{
+			Stir(waves, seed);
+			waves.Step(1);
+		}
+	}
+
+	// WriteWaveVertices against the per-vertex Vertex the app used to build: position,
+	// normal and texture coordinates of every vertex of a non-square grid, written in
+	// two row ranges into a plain buffer.
+	void CheckWaveVertices(CheckReport& report)
+	{
+		report.Begin("wave_vertices");
+
+		const int m = 37;
+		const int n = 53;
+		const float dx = 0.75f;
+
+		Waves waves(m, n, dx, TimeStep, Speed, Damping);
+		Churn(waves, 20);
+
+		// Poison the buffer so a vertex that is never written cannot pass by accident.
+		WaveVertex poison;
+		std::memset(&poison, 0xFF, sizeof(poison));
+		std::vector<WaveVertex> vertices(m*n, poison);
+
+		const WaveGridLayout& layout = waves.GridLayout();
+		WriteWaveVertices(layout, waves.Heights(), waves.NormalsX(), waves.NormalsY(), waves.NormalsZ(), 0, 15, vertices.data());
+		WriteWaveVertices(layout, waves.Heights(), waves.NormalsX(), waves.NormalsY(), waves.NormalsZ(), 15, m, vertices.data());
+
+		// The old construction: x and z from the grid spacing, then texture coordinates
+		// mapping [-w/2,w/2] --> [0,1].
+		const float halfWidth = (n - 1)*dx*0.5f;
+		const float halfDepth = (m - 1)*dx*0.5f;
+
+		for(int i = 0; i < m; ++i)
+		{
+			for(int j = 0; j < n; ++j)
+			{
+				const int k = i*n + j;
+				const WaveVertex& v = vertices[k];
+
+				const float x = -halfWidth + j*dx;
+				const float z = halfDepth - i*dx;
+				const float u = 0.5f + x / waves.Width();
+				const float tv = 0.5f - z / waves.Depth();
+
+				report.Expect(v.Pos.x == x && v.Pos.z == z, "vertex (%d, %d) xz (%g, %g), expected (%g, %g)",
+					i, j, v.Pos.x, v.Pos.z, x, z);
+				report.Expect(v.Pos.y == waves.Height(k), "vertex (%d, %d) height %g, expected %g",
+					i, j, v.Pos.y, waves.Height(k));
+
+				const DirectX::XMFLOAT3 normal = waves.Normal(k);
+				report.Expect(v.Normal.x == normal.x && v.Normal.y == normal.y && v.Normal.z == normal.z,
+					"vertex (%d, %d) normal differs", i, j);
+				report.Expect(v.TexC.x == u && v.TexC.y == tv, "vertex (%d, %d) uv (%g, %g), expected (%g, %g)",
+					i, j, v.TexC.x, v.TexC.y, u, tv);
+			}
+		}
+
+		// Waves::WriteVertices() is the same thing in one call.
+		std::vector<WaveVertex> whole(m*n, poison);
+		waves.WriteVertices(whole.data());
+		report.Expect(std::memcmp(whole.data(), vertices.data(), whole.size()*sizeof(WaveVertex)) == 0,
+			"Waves::WriteVertices differs from WriteWaveVertices");
+
+		report.End();
+	}
+
+	// The batched Disturb() against a plain double-precision sum of every impulse's
+	// footprint: random radii (including 0) and falloffs, centres on and past the grid
+	// edges, applied on a pool so several bands run at once.  The boundary must stay
+	// zero, and a serial run must give the same bits as the pooled one.
+	void CheckDisturbBatch(CheckReport& report)
+	{
+		report.Begin("disturb_batch");
+
+		const int m = 61;
+		const int n = 97;
+		const int count = 10000;
+
+		std::vector<WaveImpulse> impulses(count);
+		unsigned seed = 11;
+		for(auto& impulse : impulses)
+		{
+			seed = seed*1664525u + 1013904223u;
+			impulse.Row = -4 + (int)((seed >> 8) % (unsigned)(m + 8));
+			impulse.Col = -4 + (int)((seed >> 20) % (unsigned)(n + 8));
+			seed = seed*1664525u + 1013904223u;
+			impulse.Radius = (float)((seed >> 8) % 8u) + ((seed >> 12) % 2u)*0.5f;
+			impulse.Falloff = (WaveFalloff)((seed >> 16) % 3u);
+			impulse.Magnitude = ((int)((seed >> 20) % 201u) - 100)*1e-4f;
+		}
+
+		std::vector<double> expected(m*n, 0.0);
+		std::vector<double> scale(m*n, 0.0);
+		for(const WaveImpulse& impulse : impulses)
+		{
+			const int reach = impulse.Radius > 0.0f ? (int)impulse.Radius : 0;
+			for(int i = std::max(impulse.Row - reach, 1); i < std::min(impulse.Row + reach + 1, m - 1); ++i)
+			{
+				for(int j = std::max(impulse.Col - reach, 1); j < std::min(impulse.Col + reach + 1, n - 1); ++j)
+				{
+					double weight = 1.0;
+					if(reach > 0)
+					{
+						const double di = i - impulse.Row;
+						const double dj = j - impulse.Col;
+						const double t = (di*di + dj*dj) / ((double)impulse.Radius*impulse.Radius);
+						if(t > 1.0)
+							continue;
+						if(impulse.Falloff == WaveFalloff::Linear)
+							weight = 1.0 - std::sqrt(t);
+						else if(impulse.Falloff == WaveFalloff::Smooth)
+							weight = (1.0 - t)*(1.0 - t);
+					}
+
+					expected[i*n + j] += impulse.Magnitude*weight;
+					scale[i*n + j] += std::fabs(impulse.Magnitude*weight);
+				}
+			}
+		}
+
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(4);
+		Waves pooled(m, n, 1.0f, TimeStep, Speed, Damping);
+		pooled.SetScheduler(scheduler.get());
+		pooled.Disturb(impulses.data(), count);
+		pooled.SetScheduler(nullptr);
+
+		Waves serial(m, n, 1.0f, TimeStep, Speed, Damping);
+		serial.Disturb(impulses.data(), count);
+
+		for(int i = 0; i < m; ++i)
+		{
+			for(int j = 0; j < n; ++j)
+			{
+				const int k = i*n + j;
+				const double h = pooled.Height(k);
+
+				if(i == 0 || j == 0 || i == m - 1 || j == n - 1)
+					report.Expect(h == 0.0, "boundary cell (%d, %d) is %g", i, j, h);
+				else
+					report.Expect(std::fabs(h - expected[k]) <= 1e-5*scale[k] + 1e-7,
+						"cell (%d, %d) is %.9g, expected %.9g", i, j, h, expected[k]);
+
+				report.Expect(pooled.Height(k) == serial.Height(k),
+					"cell (%d, %d) differs between pooled and serial runs", i, j);
+			}
+		}
+
+		report.End();
+	}
+
+	// Checks one level's triangle list: every index in range, every triangle half of one
+	// cell and wound like GeometryGenerator::CreateGrid (cross product pointing +y), and
+	// each cell covered by exactly two triangles, or by none inside the hole.
+	void CheckClipmapIndices(CheckReport& report, const WaterClipmap& clipmap,
+		const std::vector<std::uint16_t>& indices, int holeBegin, int holeEnd)
+	{
+		const int n = clipmap.GridSize();
+		const int stride = n + 1;
+
+		if(!report.Expect(indices.size() % 3 == 0, "%d indices is not a triangle list", (int)indices.size()))
+			return;
+
+		std::vector<int> cover(n*n, 0);
+		for(size_t t = 0; t < indices.size(); t += 3)
+		{
+			int row[3];
+			int col[3];
+			bool inRange = true;
+			for(int c = 0; c < 3; ++c)
+			{
+				inRange = report.Expect(indices[t + c] < clipmap.LevelVertexCount(),
+					"index %d out of range", (int)indices[t + c]) && inRange;
+				row[c] = indices[t + c] / stride;
+				col[c] = indices[t + c] % stride;
+			}
+			if(!inRange)
+				continue;
+
+			// x runs along columns and z along rows.
+			const int abx = col[1] - col[0];
+			const int abz = row[1] - row[0];
+			const int acx = col[2] - col[0];
+			const int acz = row[2] - row[0];
+			report.Expect(abz*acx - abx*acz == 1, "triangle %d is not a half cell wound towards +y", (int)t / 3);
+
+			const int i = std::min(std::min(row[0], row[1]), row[2]);
+			const int j = std::min(std::min(col[0], col[1]), col[2]);
+			if(report.Expect(std::max(std::max(row[0], row[1]), row[2]) == i + 1 &&
+				std::max(std::max(col[0], col[1]), col[2]) == j + 1, "triangle %d spans several cells", (int)t / 3))
+				++cover[i*n + j];
+		}
+
+		for(int i = 0; i < n; ++i)
+		{
+			for(int j = 0; j < n; ++j)
+			{
+				const bool hole = i >= holeBegin && i < holeEnd && j >= holeBegin && j < holeEnd;
+				report.Expect(cover[i*n + j] == (hole ? 0 : 2), "cell (%d, %d) has %d triangles", i, j, cover[i*n + j]);
+			}
+		}
+	}
+
+	// WaterClipmap over a disturbed grid, for eye positions in the middle, off centre,
+	// half off the grid and far outside it.  Each ring's hole must be exactly the next
+	// finer level, the index lists must tile their cells with +y facing triangles, and
+	// the heights along every level's outer edge must lie on the next coarser level's
+	// edge so neighbouring levels meet without cracks.
+	void CheckWaterClipmap(CheckReport& report)
+	{
+		report.Begin("water_clipmap");
+
+		Waves waves(65, 81, 1.0f, TimeStep, Speed, Damping);
+		Churn(waves, 40);
+
+		WaterClipmap clipmap(16, 4, 0.5f);
+		const int n = clipmap.GridSize();
+		const int stride = n + 1;
+		const int quarter = n / 4;
+
+		CheckClipmapIndices(report, clipmap, clipmap.BuildCenterIndices(), 0, 0);
+		CheckClipmapIndices(report, clipmap, clipmap.BuildRingIndices(), quarter, 3*quarter);
+
+		// The static stream has to agree with the row/column layout the indices assume.
+		std::vector<WaveStaticVertex> statics(clipmap.VertexCount());
+		clipmap.BuildStaticVertices(statics.data());
+		for(int l = 0; l < clipmap.LevelCount(); ++l)
+		{
+			const float cell = clipmap.Level(l).CellSize;
+			for(int k = 0; k < clipmap.LevelVertexCount(); ++k)
+			{
+				const WaveStaticVertex& v = statics[l*clipmap.LevelVertexCount() + k];
+				report.Expect(v.PosXZ.x == (k % stride)*cell && v.PosXZ.y == (k / stride)*cell,
+					"level %d static vertex %d at (%g, %g)", l, k, v.PosXZ.x, v.PosXZ.y);
+			}
+		}
+
+		const float eyes[][2] = { { 0.0f, 0.0f }, { 3.3f, -7.9f }, { 30.0f, 25.0f }, { -41.0f, 12.5f }, { 500.0f, 0.0f } };
+
+		std::vector<WaveCompactVertex> fine(clipmap.LevelVertexCount());
+		std::vector<WaveCompactVertex> coarse(clipmap.LevelVertexCount());
+
+		for(const auto& eye : eyes)
+		{
+			clipmap.Update(eye[0], eye[1]);
+
+			for(int l = 0; l + 1 < clipmap.LevelCount(); ++l)
+			{
+				const WaterClipmapLevel& f = clipmap.Level(l);
+				const WaterClipmapLevel& c = clipmap.Level(l + 1);
+
+				// The hole of level l+1 is cells [n/4, 3n/4) in each direction.
+				report.Expect(c.CellSize == 2.0f*f.CellSize, "level %d cell size %g after %g", l + 1, c.CellSize, f.CellSize);
+				report.Expect(f.OriginX == c.OriginX + quarter*c.CellSize && f.OriginZ == c.OriginZ + quarter*c.CellSize,
+					"eye (%g, %g): level %d origin (%g, %g) is not the corner of level %d's hole",
+					eye[0], eye[1], l, f.OriginX, f.OriginZ, l + 1);
+
+				clipmap.WriteLevelVertices(l, waves.GridLayout(), waves.Heights(),
+					waves.NormalsX(), waves.NormalsY(), waves.NormalsZ(), fine.data());
+				clipmap.WriteLevelVertices(l + 1, waves.GridLayout(), waves.Heights(),
+					waves.NormalsX(), waves.NormalsY(), waves.NormalsZ(), coarse.data());
+
+				// Fine edge vertex k sits on coarse vertex k/2 of the hole's edge when k is
+				// even and halfway between two of them when k is odd.
+				for(int side = 0; side < 4; ++side)
+				{
+					for(int k = 0; k <= n; ++k)
+					{
+						const int fineRow[4] = { 0, n, k, k };
+						const int fineCol[4] = { k, k, 0, n };
+						const int h0 = quarter + k / 2;
+						const int h1 = quarter + (k + 1) / 2;
+						const int coarseRow[4][2] = { { quarter, quarter }, { 3*quarter, 3*quarter }, { h0, h1 }, { h0, h1 } };
+						const int coarseCol[4][2] = { { h0, h1 }, { h0, h1 }, { quarter, quarter }, { 3*quarter, 3*quarter } };
+
+						const float h = fine[fineRow[side]*stride + fineCol[side]].Height;
+						const float expected = 0.5f*(coarse[coarseRow[side][0]*stride + coarseCol[side][0]].Height +
+							coarse[coarseRow[side][1]*stride + coarseCol[side][1]].Height);
+
+						report.Expect(std::fabs(h - expected) <= 1e-4f,
+							"eye (%g, %g): level %d edge %d vertex %d height %g, coarser level has %g",
+							eye[0], eye[1], l, side, k, h, expected);
+					}
+				}
+			}
+		}
+
+		report.End();
+	}
+
+	// WaveBatch against one TwoPass Waves per grid: grids smaller and larger than a
+	// band, stepped on a pool with disturbances in between, must give the same heights
+	// and normals bit for bit.
+	void CheckWaveBatch(CheckReport& report)
+	{
+		report.Begin("wave_batch");
+
+		const int sizes[][2] = { { 24, 24 }, { 40, 17 }, { 7, 90 }, { 70, 33 }, { 5, 5 } };
+		const int gridCount = (int)(sizeof(sizes) / sizeof(sizes[0]));
+
+		std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(4);
+
+		std::vector<std::unique_ptr<Waves>> reference;
+		WaveBatch batch;
+		for(int g = 0; g < gridCount; ++g)
+		{
+			const float dx = 0.5f + 0.25f*g;
+			reference.emplace_back(new Waves(sizes[g][0], sizes[g][1], dx, TimeStep, Speed, Damping));
+			reference.back()->SetSolverMode(WaveSolverMode::TwoPass);
+			batch.AddGrid(sizes[g][0], sizes[g][1], dx, TimeStep, Speed, Damping);
+		}
+		batch.SetScheduler(scheduler.get());
+		batch.SetBandRows(8);
+
+		unsigned seed = 5;
+		for(int round = 0; round < 6; ++round)
+		{
+			for(int g = 0; g < gridCount; ++g)
+			{
+				seed = seed*1664525u + 1013904223u;
+				const int i = 2 + (int)((seed >> 8) % (unsigned)(sizes[g][0] - 4));
+				const int j = 2 + (int)((seed >> 20) % (unsigned)(sizes[g][1] - 4));
+				reference[g]->Disturb(i, j, 0.25f);
+				batch.Disturb(g, i, j, 0.25f);
+			}
+
+			const int steps = 1 + round;
+			for(auto& waves : reference)
+				waves->Step(steps);
+			batch.Step(steps);
+
+			for(int g = 0; g < gridCount; ++g)
+			{
+				const Waves& waves = *reference[g];
+				for(int k = 0; k < waves.VertexCount(); ++k)
+				{
+					report.Expect(batch.Heights(g)[k] == waves.Heights()[k], "round %d grid %d height %d is %g, expected %g",
+						round, g, k, batch.Heights(g)[k], waves.Heights()[k]);
+					report.Expect(batch.NormalsX(g)[k] == waves.NormalsX()[k] && batch.NormalsY(g)[k] == waves.NormalsY()[k] &&
+						batch.NormalsZ(g)[k] == waves.NormalsZ()[k], "round %d grid %d normal %d differs", round, g, k);
+				}
+			}
+		}
+
+		batch.SetScheduler(nullptr);
+		report.End();
+	}
+
+	// A fixed script of disturbances and uneven step counts, the same for every grid it
+	// is replayed on.
+	void StirAndStep(Waves& waves, int rounds)
+	{
+		const int m = waves.RowCount();
+		const int n = waves.ColumnCount();
+
+		unsigned seed = 11;
+		for(int round = 0; round < rounds; ++round)
+		{
+			for(int d = 0; d < 3; ++d)
+			{
+				seed = seed*1664525u + 1013904223u;
+				const int i = 2 + (int)((seed >> 8) % (unsigned)(m - 4));
+				const int j = 2 + (int)((seed >> 20) % (unsigned)(n - 4));
+				waves.Disturb(i, j, (d == 1 ? -0.5f : 0.75f));
+			}
+
+			waves.Step(1 + round % 9);
+		}
+	}
+
+	// The fused solver takes up to four time steps per sweep; whatever the step count,
+	// serial or pooled, it must land on the same heights and normals as TwoPass.
+	void CheckFusedSolver(CheckReport& report)
+	{
+		report.Begin("fused_solver");
+
+		const int sizes[][2] = { { 37, 53 }, { 64, 64 }, { 129, 20 } };
+		std::unique_ptr<TaskScheduler> pool = MakeScheduler(4);
+
+		for(const auto& size : sizes)
+		{
+			for(int threads = 1; threads <= 4; threads += 3)
+			{
+				Waves twoPass(size[0], size[1], 0.8f, TimeStep, Speed, Damping);
+				Waves fused(size[0], size[1], 0.8f, TimeStep, Speed, Damping);
+				twoPass.SetSolverMode(WaveSolverMode::TwoPass);
+				fused.SetSolverMode(WaveSolverMode::Fused, 4);
+				if(threads > 1)
+				{
+					twoPass.SetScheduler(pool.get());
+					fused.SetScheduler(pool.get());
+				}
+
+				StirAndStep(twoPass, 12);
+				StirAndStep(fused, 12);
+
+				report.Expect(fused.Checksum() == twoPass.Checksum(), "%dx%d, %d threads: checksum %016llx, expected %016llx",
+					size[0], size[1], threads, (unsigned long long)fused.Checksum(), (unsigned long long)twoPass.Checksum());
+				for(int k = 0; k < twoPass.VertexCount(); ++k)
+				{
+					report.Expect(fused.Height(k) == twoPass.Height(k), "%dx%d, %d threads: height %d is %g, expected %g",
+						size[0], size[1], threads, k, fused.Height(k), twoPass.Height(k));
+					report.Expect(fused.NormalsX()[k] == twoPass.NormalsX()[k] && fused.NormalsY()[k] == twoPass.NormalsY()[k] &&
+						fused.NormalsZ()[k] == twoPass.NormalsZ()[k], "%dx%d, %d threads: normal %d differs",
+						size[0], size[1], threads, k);
+				}
+
+				twoPass.SetScheduler(nullptr);
+				fused.SetScheduler(nullptr);
+			}
+		}
+
+		report.End();
+	}
+
+	// FixedPoint is what lockstep peers run, so the same script must give the same
+	// checksum whatever the thread count and tiling.
+	void CheckFixedPoint(CheckReport& report)
+	{
+		report.Begin("fixed_point");
+
+		const int m = 97;
+		const int n = 71;
+
+		struct Setup
+		{
+			const char* Name;
+			int Threads;
+			int TileRows;
+			int TileCols;
+		};
+		const Setup setups[] =
+		{
+			{ "serial", 1, 16, 0 },
+			{ "8 threads", 8, 16, 0 },
+			{ "8 threads, 7x33 tiles", 8, 7, 33 },
+			{ "3 threads, 1x5 tiles", 3, 1, 5 },
+		};
+
+		Waves reference(m, n, 0.8f, TimeStep, Speed, Damping);
+		reference.SetSolverMode(WaveSolverMode::FixedPoint);
+		StirAndStep(reference, 20);
+
+		Waves untouched(m, n, 0.8f, TimeStep, Speed, Damping);
+		untouched.SetSolverMode(WaveSolverMode::FixedPoint);
+		report.Expect(reference.Checksum() != untouched.Checksum(), "the script left the grid unchanged");
+
+		for(const Setup& setup : setups)
+		{
+			std::unique_ptr<TaskScheduler> scheduler = MakeScheduler(setup.Threads);
+
+			Waves waves(m, n, 0.8f, TimeStep, Speed, Damping);
+			waves.SetScheduler(scheduler.get());
+			waves.SetTileSize(setup.TileRows, setup.TileCols);
+			waves.SetSolverMode(WaveSolverMode::FixedPoint);
+			StirAndStep(waves, 20);
+
+			report.Expect(waves.Checksum() == reference.Checksum(), "%s: checksum %016llx, expected %016llx", setup.Name,
+				(unsigned long long)waves.Checksum(), (unsigned long long)reference.Checksum());
+			for(int k = 0; k < waves.VertexCount(); ++k)
+			{
+				report.Expect(waves.Height(k) == reference.Height(k), "%s: height %d is %g, expected %g",
+					setup.Name, k, waves.Height(k), reference.Height(k));
+			}
+
+			waves.SetScheduler(nullptr);
+		}
+
+		report.End();
+	}
+
+	int RunChecks()
+	{
+		CheckReport report;
+		CheckWaveVertices(report);
+		CheckFusedSolver(report);
+		CheckFixedPoint(report);
+		CheckDisturbBatch(report);
+		CheckWaterClipmap(report);
+		CheckWaveBatch(report);
+		return report.Failures() == 0 ? 0 : 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "usage: %s [--sizes 128,256,...] [--threads 1,2,...] [--min-time seconds]\n"
+			"       %s --check\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	if(options.Check)
+		return RunChecks();
+
+	const int maxThreads = *std::max_element(options.Threads.begin(), options.Threads.end());
+
+	std::printf("{\n  \"kernel\": \"%s\",\n  \"hardware_threads\": %u,\n  \"min_time_s\": %g,\n  \"results\": [",
+		Waves::KernelName(), std::thread::hardware_concurrency(), options.MinTime);
+
+	JsonWriter json;
+
+	for(int size : options.Sizes)
+	{
+		if(size < 8)
+			continue;
+
+		// Thread scaling of the default solver: stencil (read prev and curr, write
+		// prev) plus the normal pass (read curr, write three normals).
+		double baseline = 0.0;
+		for(int threads : options.Threads)
+		{
+			double ns = 0.0;
+			BenchStep(json, options, size, "twopass", WaveSolverMode::TwoPass, false, threads, 28.0, baseline, &ns);
+			if(baseline == 0.0)
+				baseline = ns;
+		}
+
+		// The other solver paths at full width.
+		BenchStep(json, options, size, "fused", WaveSolverMode::Fused, false, maxThreads, 24.0, 0.0, nullptr);
+		BenchStep(json, options, size, "fixed_point", WaveSolverMode::FixedPoint, false, maxThreads, 36.0, 0.0, nullptr);
+		BenchStep(json, options, size, "heights_only", WaveSolverMode::TwoPass, true, maxThreads, 12.0, 0.0, nullptr);
+		BenchSparse(json, options, size, maxThreads);
+		BenchDisturb(json, options, size, maxThreads);
+	}
+
+	// Many ponds too small to be worth splitting on their own.
+	BenchBatch(json, options, 24, 64, maxThreads);
+
+	std::printf("\n  ]\n}\n");
+	return 0;
+}
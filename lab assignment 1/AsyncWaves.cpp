@@ -0,0 +1,131 @@
+//***************************************************************************************
+// AsyncWaves.cpp
+//***************************************************************************************
+
+#include "AsyncWaves.h"
+#include <algorithm>
+
+AsyncWaves::AsyncWaves(Waves* waves)
+	: mWaves(waves)
+{
+	// Every slot starts out holding the initial solution, so AcquireLatest() is
+	// valid before the first update has finished.
+	for(auto& slot : mSlots)
+		Capture(slot);
+
+	mThread = std::thread(&AsyncWaves::ThreadMain, this);
+}
+
+AsyncWaves::~AsyncWaves()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	mThread.join();
+}
+
+void AsyncWaves::Disturb(int i, int j, float magnitude)
+{
+	Disturbance d;
+	d.I = i;
+	d.J = j;
+	d.Magnitude = magnitude;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPendingDisturbances.push_back(d);
+}
+
+void AsyncWaves::Disturb(const WaveImpulse* impulses, int count)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPendingImpulses.insert(mPendingImpulses.end(), impulses, impulses + count);
+}
+
+void AsyncWaves::Kick(float dt)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPendingTime += dt;
+		mHasWork = true;
+	}
+	mWake.notify_one();
+}
+
+void AsyncWaves::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [this]() { return !mHasWork && !mBusy; });
+}
+
+const WaveSnapshot& AsyncWaves::AcquireLatest()
+{
+	// Only swap when the writer has published since our last look; otherwise we
+	// would hand it back the slot we are reading.
+	if(mSharedSlot.load(std::memory_order_relaxed) & FreshBit)
+		mFrontSlot = mSharedSlot.exchange(mFrontSlot, std::memory_order_acq_rel) & ~FreshBit;
+
+	return mSlots[mFrontSlot];
+}
+
+void AsyncWaves::ThreadMain()
+{
+	for(;;)
+	{
+		float dt = 0.0f;
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mQuit || mHasWork; });
+
+			if(mQuit)
+				return;
+
+			dt = mPendingTime;
+			mPendingTime = 0.0f;
+			mHasWork = false;
+			mBusy = true;
+
+			// Swapping keeps both vectors' capacity, so steady state does not allocate.
+			mActiveDisturbances.clear();
+			std::swap(mActiveDisturbances, mPendingDisturbances);
+			mActiveImpulses.clear();
+			std::swap(mActiveImpulses, mPendingImpulses);
+		}
+
+		for(const auto& d : mActiveDisturbances)
+			mWaves->Disturb(d.I, d.J, d.Magnitude);
+
+		mWaves->Disturb(mActiveImpulses.data(), (int)mActiveImpulses.size());
+
+		mWaves->Update(dt);
+		++mFrame;
+
+		Publish();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBusy = false;
+		}
+		mIdle.notify_all();
+	}
+}
+
+void AsyncWaves::Capture(WaveSnapshot& snapshot)const
+{
+	mWaves->Capture(snapshot);
+	snapshot.Frame = mFrame;
+}
+
+void AsyncWaves::Publish()
+{
+	// Snapshots always carry normals.
+	mWaves->UpdateNormals();
+	Capture(mSlots[mBackSlot]);
+
+	// Hand the filled slot over and take back whichever one was shared; if the
+	// reader skipped the previous snapshot, that is the one we now overwrite.
+	mBackSlot = mSharedSlot.exchange(mBackSlot | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+}
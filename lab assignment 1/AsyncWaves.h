@@ -0,0 +1,90 @@
+//***************************************************************************************
+// AsyncWaves.h
+//
+// Runs a Waves simulation on its own thread.  The render thread kicks one Update() per
+// frame and reads the newest finished solution from a snapshot; the two sides only
+// meet in a lock-free triple buffer, so the render thread never waits on the solver.
+//
+// Nothing here touches Direct3D, so the class can be driven headlessly: Kick(), then
+// WaitIdle(), then AcquireLatest().
+//***************************************************************************************
+
+#ifndef ASYNCWAVES_H
+#define ASYNCWAVES_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Waves.h"
+
+class AsyncWaves
+{
+public:
+	// The simulation thread owns waves until this object is destroyed; only its grid
+	// dimensions and GridLayout() may be read from other threads in the meantime.
+	explicit AsyncWaves(Waves* waves);
+	AsyncWaves(const AsyncWaves& rhs) = delete;
+	AsyncWaves& operator=(const AsyncWaves& rhs) = delete;
+	~AsyncWaves();
+
+	// Queue disturbances; they are applied right before the next update runs.
+	void Disturb(int i, int j, float magnitude);
+	void Disturb(const WaveImpulse* impulses, int count);
+
+	// Asks the simulation thread to run Waves::Update(dt) and returns immediately.
+	// If the previous update is still running, the time is added to the next one.
+	void Kick(float dt);
+
+	// Blocks until every kicked update has been published.
+	void WaitIdle();
+
+	// Returns the newest published snapshot.  It stays untouched until the next call
+	// to AcquireLatest(), which must come from the same thread; until then any
+	// thread may read or sample it (e.g. buoyancy jobs).
+	const WaveSnapshot& AcquireLatest();
+
+private:
+	struct Disturbance
+	{
+		int I = 0;
+		int J = 0;
+		float Magnitude = 0.0f;
+	};
+
+	void ThreadMain();
+	void Capture(WaveSnapshot& snapshot)const;
+	void Publish();
+
+private:
+	// Set on the shared slot index while the reader has not picked it up yet.
+	static const int FreshBit = 4;
+
+	Waves* mWaves = nullptr;
+
+	// Triple buffer: the writer owns mBackSlot, the reader owns mFrontSlot, and the
+	// third is handed between them by atomic exchange.
+	WaveSnapshot mSlots[3];
+	int mBackSlot = 0;
+	int mFrontSlot = 1;
+	std::atomic<int> mSharedSlot{ 2 };
+	std::uint64_t mFrame = 0;
+
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mIdle;
+	float mPendingTime = 0.0f;
+	bool mHasWork = false;
+	bool mBusy = false;
+	bool mQuit = false;
+	std::vector<Disturbance> mPendingDisturbances;
+	std::vector<Disturbance> mActiveDisturbances;
+	std::vector<WaveImpulse> mPendingImpulses;
+	std::vector<WaveImpulse> mActiveImpulses;
+
+	std::thread mThread;
+};
+
+#endif // ASYNCWAVES_H
@@ -6,8 +6,13 @@
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
 #include "../Common/GeometryGenerator.h"
+#include "../Common/MeshBatchBuilder.h"
+#include "../Common/TaskScheduler.h"
 #include "FrameResource.h"
 #include "Waves.h"
+#include "AsyncWaves.h"
+#include "WaterClipmap.h"
+#include "CastleLayout.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -18,6 +23,12 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Vertical field of view of the camera.
+const float gFovY = 0.25f * MathHelper::Pi;
+
+// Largest simplification error, in pixels on screen, a level of detail may show.
+const float gLodPixelError = 1.0f;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -51,14 +62,33 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+    UINT InstanceCount = 1;
+    UINT StartInstanceLocation = 0;
+
+    // Optional second vertex stream, bound to slot 1 when BufferLocation is non-zero.
+    // Used for per-frame vertex data kept apart from the static data in Geo.
+    D3D12_VERTEX_BUFFER_VIEW DynamicVertexBufferView = {};
+
+    // Optional per-instance stream, also bound to slot 1; see CastleInstance.
+    D3D12_VERTEX_BUFFER_VIEW InstanceBufferView = {};
+
+    // Levels of detail of the mesh, finest first.  When set, UpdateLods() picks the
+    // DrawIndexedInstanced parameters above from them every frame, by the error seen
+    // from the nearest point of LodBounds (world space, around every instance) with
+    // the mesh scaled up by LodScale.
+    std::vector<const SubmeshGeometry*> Lods;
+    BoundingBox LodBounds;
+    float LodScale = 1.0f;
 };
 
 enum class RenderLayer : int
 {
     Opaque = 0,
+    OpaqueInstanced,
     Transparent,
     AlphaTested,
     AlphaTestedTreeSprites,
+    Water,
     Count
 };
 
@@ -83,10 +113,12 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
     void UpdateCamera(const GameTimer& gt);
+    void UpdateLods();
     void AnimateMaterials(const GameTimer& gt);
     void UpdateObjectCBs(const GameTimer& gt);
     void UpdateMaterialCBs(const GameTimer& gt);
     void UpdateMainPassCB(const GameTimer& gt);
+    void UpdateWaterClipmap(const GameTimer& gt);
     void UpdateWaves(const GameTimer& gt);
 
     void LoadTextures();
@@ -95,6 +127,7 @@ private:
     void BuildShadersAndInputLayout();
     void BuildWavesGeometry();
     void BuildShapeGeometry();
+    void BuildCastle();
     void BuildTreeSpritesGeometry();
     void BuildPSOs();
     void BuildFrameResources();
@@ -124,16 +157,38 @@ private:
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
     std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mWaterInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mInstancedInputLayout;
+
+    // The castle's pieces, drawn from the unit meshes in shapeGeo, and the same
+    // instances on the GPU.
+    CastleLayout mCastleLayout;
+    ComPtr<ID3D12Resource> mCastleInstanceBuffer = nullptr;
+    ComPtr<ID3D12Resource> mCastleInstanceUploader = nullptr;
+    D3D12_VERTEX_BUFFER_VIEW mCastleInstanceBufferView = {};
 
-    RenderItem* mWavesRitem = nullptr;
+    // One render item per clipmap level, finest first.
+    std::vector<RenderItem*> mWaterLevelRitems;
+
+    // Places the water's local space (where mWaves and mWaterClipmap live) in the world.
+    XMFLOAT4X4 mWaterWorld = MathHelper::Identity4x4();
 
     // List of all the render items.
     std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
     std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+    // Worker threads shared by the CPU-side simulation passes.
+    std::unique_ptr<ThreadPoolTaskScheduler> mTaskScheduler;
+
     std::unique_ptr<Waves> mWaves;
 
+    // Steps mWaves on its own thread; declared after it so it stops first.
+    std::unique_ptr<AsyncWaves> mAsyncWaves;
+
+    // Draws the water as LOD rings around the eye, sampling mWaves.
+    std::unique_ptr<WaterClipmap> mWaterClipmap;
+
     // Render items divided by PSO.
     std::vector<RenderItem*> mOpaqueRitems;
 
@@ -196,13 +251,25 @@ bool ShapesApp::Initialize()
     // so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+    mTaskScheduler = std::make_unique<ThreadPoolTaskScheduler>();
+
     mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+    mWaves->SetScheduler(mTaskScheduler.get());
+    // Sleeping tiles (SetSleepThreshold) stay off: a tile that falls asleep has its
+    // heights zeroed, which changes the simulation, and with a drop every 0.25 s the
+    // whole grid stays awake anyway.
+    mAsyncWaves = std::make_unique<AsyncWaves>(mWaves.get());
+
+    // Five levels of 64x64 cells, the finest at the simulation's resolution.
+    mWaterClipmap = std::make_unique<WaterClipmap>(64, 5, mWaves->SpatialStep());
+    XMStoreFloat4x4(&mWaterWorld, XMMatrixScaling(3.0f, 1.0f, 3.0f) * XMMatrixTranslation(0.0f, -3.0f, 0.0f));
 
     LoadTextures();
     BuildRootSignature();
     BuildDescriptorHeaps();
     BuildShadersAndInputLayout();
     BuildShapeGeometry();
+    BuildCastle();
     BuildWavesGeometry();
     BuildTreeSpritesGeometry();
     BuildMaterials();
@@ -226,7 +293,7 @@ void ShapesApp::OnResize()
     D3DApp::OnResize();
 
     // The window resized, so update the aspect ratio and recompute the projection matrix.
-    XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+    XMMATRIX P = XMMatrixPerspectiveFovLH(gFovY, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
 }
 
@@ -234,6 +301,7 @@ void ShapesApp::Update(const GameTimer& gt)
 {
     OnKeyboardInput(gt);
     UpdateCamera(gt);
+    UpdateLods();
 
     // Cycle through the circular frame resource array.
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -250,6 +318,7 @@ void ShapesApp::Update(const GameTimer& gt)
     }
 
     AnimateMaterials(gt);
+    UpdateWaterClipmap(gt);
     UpdateObjectCBs(gt);
     UpdateMaterialCBs(gt);
     UpdateMainPassCB(gt);
@@ -295,6 +364,9 @@ void ShapesApp::Draw(const GameTimer& gt)
 
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
 
+    mCommandList->SetPipelineState(mPSOs["opaqueInstanced"].Get());
+    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::OpaqueInstanced]);
+
     //step 2
     mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
@@ -309,6 +381,9 @@ void ShapesApp::Draw(const GameTimer& gt)
     mCommandList->SetPipelineState(mPSOs["transparent"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
 
+    mCommandList->SetPipelineState(mPSOs["water"].Get());
+    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Water]);
+
     // Indicate a state transition on the resource usage.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
         D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
@@ -422,6 +497,39 @@ void ShapesApp::AnimateMaterials(const GameTimer& gt)
     waterMat->NumFramesDirty = gNumFrameResources;
 }
 
+void ShapesApp::UpdateLods()
+{
+    const XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
+
+    for (auto& e : mAllRitems)
+    {
+        if (e->Lods.empty())
+            continue;
+
+        // Distance from the eye to the nearest point of the bounds, never nearer than
+        // the near plane.
+        XMVECTOR center = XMLoadFloat3(&e->LodBounds.Center);
+        XMVECTOR extents = XMLoadFloat3(&e->LodBounds.Extents);
+        XMVECTOR nearest = XMVectorClamp(eyePos, XMVectorSubtract(center, extents), XMVectorAdd(center, extents));
+        float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(nearest, eyePos)));
+        if (distance < 1.0f)
+            distance = 1.0f;
+
+        // The coarsest level whose error stays under gLodPixelError on screen.
+        size_t lod = e->Lods.size() - 1;
+        while (lod > 0 &&
+            ProjectedLodError(e->Lods[lod]->LodError * e->LodScale, distance, (float)mClientHeight, gFovY) > gLodPixelError)
+        {
+            --lod;
+        }
+
+        const SubmeshGeometry* submesh = e->Lods[lod];
+        e->IndexCount = submesh->IndexCount;
+        e->StartIndexLocation = submesh->StartIndexLocation;
+        e->BaseVertexLocation = submesh->BaseVertexLocation;
+    }
+}
+
 void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
 {
     auto currObjectCB = mCurrFrameResource->ObjectCB.get();
@@ -547,31 +655,60 @@ void ShapesApp::UpdateWaves(const GameTimer& gt)
 
         float r = MathHelper::RandF(0.2f, 0.5f);
 
-        mWaves->Disturb(i, j, r);
+        mAsyncWaves->Disturb(i, j, r);
     }
 
-    // Update the wave simulation.
-    mWaves->Update(gt.DeltaTime());
+    // Pick up the newest solution the simulation thread has finished.
+    const WaveSnapshot& waves = mAsyncWaves->AcquireLatest();
 
-    // Update the wave vertex buffer with the new solution.
+    // Sample the new heights and normals for every clipmap level straight into the
+    // wave vertex buffer.
     auto currWavesVB = mCurrFrameResource->WavesVB.get();
-    for (int i = 0; i < mWaves->VertexCount(); ++i)
+    WaveCompactVertex* dst = currWavesVB->MappedData();
+    for (int l = 0; l < mWaterClipmap->LevelCount(); ++l)
     {
-        Vertex v;
+        mWaterClipmap->WriteLevelVertices(l, *waves.Layout, waves.Heights.data(),
+            waves.NormalX.data(), waves.NormalY.data(), waves.NormalZ.data(),
+            dst + l * mWaterClipmap->LevelVertexCount());
+    }
 
-        v.Pos = mWaves->Position(i);
-        v.Normal = mWaves->Normal(i);
+    // Let the next step run while this frame is being recorded.
+    mAsyncWaves->Kick(gt.DeltaTime());
 
-        // Derive tex-coords from position by 
-        // mapping [-w/2,w/2] --> [0,1]
-        v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-        v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+    // Set the dynamic VB of the water renderitems to the current frame VB.  Each level
+    // picks its own vertices through BaseVertexLocation.
+    D3D12_VERTEX_BUFFER_VIEW vbv;
+    vbv.BufferLocation = currWavesVB->Resource()->GetGPUVirtualAddress();
+    vbv.StrideInBytes = sizeof(WaveCompactVertex);
+    vbv.SizeInBytes = mWaterClipmap->VertexCount() * sizeof(WaveCompactVertex);
 
-        currWavesVB->CopyData(i, v);
-    }
+    for (auto ri : mWaterLevelRitems)
+        ri->DynamicVertexBufferView = vbv;
+}
+
+void ShapesApp::UpdateWaterClipmap(const GameTimer& gt)
+{
+    // Follow the eye, in the water's local space.
+    XMMATRIX waterWorld = XMLoadFloat4x4(&mWaterWorld);
+    XMVECTOR eyeL = XMVector3TransformCoord(XMLoadFloat3(&mEyePos),
+        XMMatrixInverse(&XMMatrixDeterminant(waterWorld), waterWorld));
+
+    if (!mWaterClipmap->Update(XMVectorGetX(eyeL), XMVectorGetZ(eyeL)))
+        return;
 
-    // Set the dynamic VB of the wave renderitem to the current frame VB.
-    mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+    // Tile the water texture 5 times across the simulated grid, as the single grid did.
+    const float texScale = 5.0f / mWaves->Width();
+
+    for (int l = 0; l < mWaterClipmap->LevelCount(); ++l)
+    {
+        const WaterClipmapLevel& level = mWaterClipmap->Level(l);
+        RenderItem* ri = mWaterLevelRitems[l];
+
+        XMStoreFloat4x4(&ri->World, XMMatrixTranslation(level.OriginX, 0.0f, level.OriginZ) * waterWorld);
+        XMStoreFloat4x4(&ri->TexTransform, XMMatrixScaling(texScale, -texScale, 1.0f) *
+            XMMatrixTranslation(level.OriginX * texScale, -level.OriginZ * texScale, 0.0f));
+        ri->NumFramesDirty = gNumFrameResources;
+    }
 }
 
 void ShapesApp::LoadTextures()
@@ -810,6 +947,22 @@ void ShapesApp::BuildShadersAndInputLayout()
     mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_0");
     mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_0");
 
+    const D3D_SHADER_MACRO waterDefines[] =
+    {
+        "WAVE_COMPACT", "1",
+        NULL, NULL
+    };
+
+    mShaders["waterVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", waterDefines, "VS", "vs_5_0");
+
+    const D3D_SHADER_MACRO instancedDefines[] =
+    {
+        "INSTANCED", "1",
+        NULL, NULL
+    };
+
+    mShaders["instancedVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", instancedDefines, "VS", "vs_5_0");
+
     mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_0");
     mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_0");
     mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_0");
@@ -826,332 +979,146 @@ void ShapesApp::BuildShadersAndInputLayout()
         { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
+
+    // Slot 0 is the static WaveStaticVertex stream, slot 1 the per-frame WaveCompactVertex one.
+    mWaterInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "HEIGHT", 0, DXGI_FORMAT_R32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 4, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+
+    // Slot 0 is Vertex, slot 1 one CastleInstance per instance.
+    mInstancedInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "INSTPOSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "INSTROTATION", 0, DXGI_FORMAT_R32_FLOAT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "INSTSCALE", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+    };
 }
 
 void ShapesApp::BuildWavesGeometry()
 {
-    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-    assert(mWaves->VertexCount() < 0x0000ffff);
-
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for (int i = 0; i < m - 1; ++i)
-    {
-        for (int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i * n + j;
-            indices[k + 1] = i * n + j + 1;
-            indices[k + 2] = (i + 1) * n + j;
+    // Only the static half of the vertices lives in the geometry; heights and
+    // normals are streamed per frame through FrameResource::WavesVB.
+    std::vector<WaveStaticVertex> vertices(mWaterClipmap->VertexCount());
+    mWaterClipmap->BuildStaticVertices(vertices.data());
 
-            indices[k + 3] = (i + 1) * n + j;
-            indices[k + 4] = i * n + j + 1;
-            indices[k + 5] = (i + 1) * n + j + 1;
+    // Level 0 is a full grid, every other level a ring around the finer one.  Both
+    // index lists address one level's vertices; BaseVertexLocation selects the level.
+    std::vector<std::uint16_t> centerIndices = mWaterClipmap->BuildCenterIndices();
+    std::vector<std::uint16_t> ringIndices = mWaterClipmap->BuildRingIndices();
 
-            k += 6; // next quad
-        }
-    }
+    std::vector<std::uint16_t> indices;
+    indices.insert(indices.end(), centerIndices.begin(), centerIndices.end());
+    indices.insert(indices.end(), ringIndices.begin(), ringIndices.end());
 
-    UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
-    UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
+    UINT vbByteSize = (UINT)vertices.size() * sizeof(WaveStaticVertex);
+    UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "waterGeo";
 
-    // Set dynamically.
-    geo->VertexBufferCPU = nullptr;
-    geo->VertexBufferGPU = nullptr;
+    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
+    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+
     geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
         mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexByteStride = sizeof(WaveStaticVertex);
     geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
-    SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT)indices.size();
-    submesh.StartIndexLocation = 0;
-    submesh.BaseVertexLocation = 0;
+    SubmeshGeometry center;
+    center.IndexCount = (UINT)centerIndices.size();
+    center.StartIndexLocation = 0;
+    center.BaseVertexLocation = 0;
+
+    SubmeshGeometry ring;
+    ring.IndexCount = (UINT)ringIndices.size();
+    ring.StartIndexLocation = (UINT)centerIndices.size();
+    ring.BaseVertexLocation = 0;
 
-    geo->DrawArgs["water"] = submesh;
+    geo->DrawArgs["clipmapCenter"] = center;
+    geo->DrawArgs["clipmapRing"] = ring;
 
     mGeometries["waterGeo"] = std::move(geo);
 }
 
 void ShapesApp::BuildShapeGeometry()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(100.0f, 100.0f, 50, 50);
-    GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-    GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(2.5f, 2.5f, 18.5f, 20, 20);
-    GeometryGenerator::MeshData cone = geoGen.CreateCylinder(2.5f, 0.01f, 5.0f, 20, 20);
-    GeometryGenerator::MeshData wedge = geoGen.CreateWedge(12.0f, 1.0f, 6.0f, 2);
-    GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.5f, 1.5f, 2);
-    GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(2.5f, 5.0f, 2.5f, 2);
-    GeometryGenerator::MeshData sanlengzhu = geoGen.CreateSanLengZhu(1.5f, 2.0f, 3);
-    GeometryGenerator::MeshData trapezoid = geoGen.CreateTrapezoid(1.0f, 2.0f, 2.0f, 3);
-    //GeometryGenerator::MeshData flag = geoGen.CreateFlag(3.0f, 2.0f, 1.0f, 3);
-    GeometryGenerator::MeshData torus = geoGen.CreateTorus(7.0f, 1.0f, 8, 8);
-    GeometryGenerator::MeshData box2 = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
+    // Extract the vertex elements we are interested in.
+    MeshBatchBuilder builder(sizeof(Vertex), [](const GeometryGenerator::Vertex* src, size_t count, void* dst)
+    {
+        Vertex* vertices = (Vertex*)dst;
+        for(size_t i = 0; i < count; ++i)
+        {
+            vertices[i].Pos = src[i].Position;
+            vertices[i].Normal = src[i].Normal;
+            vertices[i].TexC = src[i].TexC;
+        }
+    });
 
     //
-    // We are concatenating all the geometry into one big vertex/index buffer.  So
-    // define the regions in the buffer each submesh covers.
+    // We are concatenating all the geometry into one big vertex/index buffer.  The
+    // builder works out the region each submesh covers, generates the meshes in
+    // parallel and reorders each one for the vertex cache and vertex fetch.  Later
+    // runs load the finished buffers from the cache file instead.
     //
-
-    // Cache the vertex offsets to each object in the concatenated vertex buffer.
-    UINT boxVertexOffset = 0;
-    UINT gridVertexOffset = (UINT)box.Vertices.size();
-    UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-    UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-    UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-    UINT wedgeVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-    UINT pyramidVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-    UINT diamondVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-    UINT sanlengzhuVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-    UINT trapezoidVertexOffset = sanlengzhuVertexOffset + (UINT)sanlengzhu.Vertices.size();
-    UINT torusVertexOffset = trapezoidVertexOffset + (UINT)trapezoid.Vertices.size();
-    UINT box2VertexOffset = torusVertexOffset + (UINT)torus.Vertices.size();
-
-    // Cache the starting index for each object in the concatenated index buffer.
-    UINT boxIndexOffset = 0;
-    UINT gridIndexOffset = (UINT)box.Indices32.size();
-    UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-    UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-    UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-    UINT wedgeIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-    UINT pyramidIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-    UINT diamondIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-    UINT sanlengzhuIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-    UINT trapezoidIndexOffset = sanlengzhuIndexOffset + (UINT)sanlengzhu.Indices32.size();
-    UINT torusIndexOffset = trapezoidIndexOffset + (UINT)trapezoid.Indices32.size();
-    UINT box2IndexOffset = torusIndexOffset + (UINT)torus.Indices32.size();
-
-    SubmeshGeometry boxSubmesh;
-    boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-    boxSubmesh.StartIndexLocation = boxIndexOffset;
-    boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-    SubmeshGeometry gridSubmesh;
-    gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-    gridSubmesh.StartIndexLocation = gridIndexOffset;
-    gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-    SubmeshGeometry sphereSubmesh;
-    sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-    sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-    sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-    SubmeshGeometry cylinderSubmesh;
-    cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-    cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-    cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-    SubmeshGeometry coneSubmesh;
-    coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-    coneSubmesh.StartIndexLocation = coneIndexOffset;
-    coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-    SubmeshGeometry wedgeSubmesh;
-    wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-    wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-    wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-    SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-    SubmeshGeometry diamondSubmesh;
-    diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-    diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-    diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-    SubmeshGeometry sanlengzhuSubmesh;
-    sanlengzhuSubmesh.IndexCount = (UINT)sanlengzhu.Indices32.size();
-    sanlengzhuSubmesh.StartIndexLocation = sanlengzhuIndexOffset;
-    sanlengzhuSubmesh.BaseVertexLocation = sanlengzhuVertexOffset;
-
-    SubmeshGeometry trapezoidSubmesh;
-    trapezoidSubmesh.IndexCount = (UINT)trapezoid.Indices32.size();
-    trapezoidSubmesh.StartIndexLocation = trapezoidIndexOffset;
-    trapezoidSubmesh.BaseVertexLocation = trapezoidVertexOffset;
-
-    SubmeshGeometry torusSubmesh;
-    torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-    torusSubmesh.StartIndexLocation = torusIndexOffset;
-    torusSubmesh.BaseVertexLocation = torusVertexOffset;
-
-    SubmeshGeometry box2Submesh;
-    box2Submesh.IndexCount = (UINT)box2.Indices32.size();
-    box2Submesh.StartIndexLocation = box2IndexOffset;
-    box2Submesh.BaseVertexLocation = box2VertexOffset;
-
-
+    // The round shapes also get coarser levels of detail, at these fractions of their
+    // triangle count, for UpdateLods() to switch to with distance.
     //
-    // Extract the vertex elements we are interested in and pack the
-    // vertices of all the meshes into one vertex buffer.
+    // box, cylinder, cone and sphere fill the unit cube: the castle's instances scale
+    // them to size (see CastleLayout.h).
     //
 
-    auto totalVertexCount =
-        box.Vertices.size() +
-        grid.Vertices.size() +
-        sphere.Vertices.size() +
-        cylinder.Vertices.size() +
-        cone.Vertices.size() +
-        wedge.Vertices.size() +
-        pyramid.Vertices.size() +
-        diamond.Vertices.size() +
-        sanlengzhu.Vertices.size() +
-        trapezoid.Vertices.size() +
-        torus.Vertices.size() +
-        box2.Vertices.size();
-
-    std::vector<Vertex> vertices(totalVertexCount);
-
-    UINT k = 0;
-    for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-        vertices[k].TexC = box.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Normal = grid.Vertices[i].Normal;
-        vertices[k].TexC = grid.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Normal = sphere.Vertices[i].Normal;
-        vertices[k].TexC = sphere.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cylinder.Vertices[i].Position;
-        vertices[k].Normal = cylinder.Vertices[i].Normal;
-        vertices[k].TexC = cylinder.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cone.Vertices[i].Position;
-        vertices[k].Normal = cone.Vertices[i].Normal;
-        vertices[k].TexC = cone.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = wedge.Vertices[i].Position;
-        vertices[k].Normal = wedge.Vertices[i].Normal;
-        vertices[k].TexC = wedge.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-        vertices[k].Normal = pyramid.Vertices[i].Normal;
-        vertices[k].TexC = pyramid.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = diamond.Vertices[i].Position;
-        vertices[k].Normal = diamond.Vertices[i].Normal;
-        vertices[k].TexC = diamond.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < sanlengzhu.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = sanlengzhu.Vertices[i].Position;
-        vertices[k].Normal = sanlengzhu.Vertices[i].Normal;
-        vertices[k].TexC = sanlengzhu.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < trapezoid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = trapezoid.Vertices[i].Position;
-        vertices[k].Normal = trapezoid.Vertices[i].Normal;
-        vertices[k].TexC = trapezoid.Vertices[i].TexC;
-    }
+    const std::vector<float> lodRatios = { 0.5f, 0.25f, 0.125f };
 
-    for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = torus.Vertices[i].Position;
-        vertices[k].Normal = torus.Vertices[i].Normal;
-        vertices[k].TexC = torus.Vertices[i].TexC;
-    }
+    builder.SetCacheFile(L"shapeGeo.meshcache");
 
-    for (size_t i = 0; i < box2.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = box2.Vertices[i].Position;
-        vertices[k].Normal = box2.Vertices[i].Normal;
-        vertices[k].TexC = box2.Vertices[i].TexC;
-    }
+    MESH_BATCH_ADD(builder, "box", CreateBox(1.0f, 1.0f, 1.0f, 3));
+    MESH_BATCH_ADD(builder, "grid", CreateGrid(100.0f, 100.0f, 50, 50));
+    MESH_BATCH_ADD_LODS(builder, "sphere", CreateSphere(0.5f, 20, 20), lodRatios);
+    MESH_BATCH_ADD_LODS(builder, "cylinder", CreateCylinder(0.5f, 0.5f, 1.0f, 20, 20), lodRatios);
+    MESH_BATCH_ADD_LODS(builder, "cone", CreateCylinder(0.5f, 0.002f, 1.0f, 20, 20), lodRatios);
+    MESH_BATCH_ADD(builder, "wedge", CreateWedge(12.0f, 1.0f, 6.0f, 2));
+    MESH_BATCH_ADD(builder, "pyramid", CreatePyramid(1.5f, 1.5f, 2));
+    MESH_BATCH_ADD(builder, "diamond", CreateDiamond(2.5f, 5.0f, 2.5f, 2));
+    MESH_BATCH_ADD(builder, "sanlengzhu", CreateSanLengZhu(1.5f, 2.0f, 3));
+    MESH_BATCH_ADD(builder, "trapezoid", CreateTrapezoid(1.0f, 2.0f, 2.0f, 3));
+    //MESH_BATCH_ADD(builder, "flag", CreateFlag(3.0f, 2.0f, 1.0f, 3));
+    MESH_BATCH_ADD(builder, "torus", CreateTorus(7.0f, 1.0f, 8, 8));
 
-    std::vector<std::uint16_t> indices;
-    indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-    indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-    indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-    indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sanlengzhu.GetIndices16()), std::end(sanlengzhu.GetIndices16()));
-    indices.insert(indices.end(), std::begin(trapezoid.GetIndices16()), std::end(trapezoid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
-    indices.insert(indices.end(), std::begin(box2.GetIndices16()), std::end(box2.GetIndices16()));
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+    auto geo = builder.Build("shapeGeo", md3dDevice.Get(), mCommandList.Get(), mTaskScheduler.get());
 
-    auto geo = std::make_unique<MeshGeometry>();
-    geo->Name = "shapeGeo";
-
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+    mGeometries[geo->Name] = std::move(geo);
+}
 
-    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+void ShapesApp::BuildCastle()
+{
+    // The default parameters give the castle this demo has always had; raise
+    // Perimeter and TowerCount for a larger one at the same draw count.
+    BuildCastleLayout(CastleParams(), mCastleLayout);
 
-    geo->VertexByteStride = sizeof(Vertex);
-    geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-    geo->IndexBufferByteSize = ibByteSize;
+    const UINT ibByteSize = (UINT)mCastleLayout.Instances.size() * sizeof(CastleInstance);
 
-    geo->DrawArgs["box"] = boxSubmesh;
-    geo->DrawArgs["grid"] = gridSubmesh;
-    geo->DrawArgs["sphere"] = sphereSubmesh;
-    geo->DrawArgs["cylinder"] = cylinderSubmesh;
-    geo->DrawArgs["cone"] = coneSubmesh;
-    geo->DrawArgs["wedge"] = wedgeSubmesh;
-    geo->DrawArgs["pyramid"] = pyramidSubmesh;
-    geo->DrawArgs["diamond"] = diamondSubmesh;
-    geo->DrawArgs["sanlengzhu"] = sanlengzhuSubmesh;
-    geo->DrawArgs["trapezoid"] = trapezoidSubmesh;
-    geo->DrawArgs["torus"] = torusSubmesh;
-    geo->DrawArgs["box2"] = box2Submesh;
+    mCastleInstanceBuffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), mCastleLayout.Instances.data(), ibByteSize, mCastleInstanceUploader);
 
-    mGeometries[geo->Name] = std::move(geo);
+    mCastleInstanceBufferView.BufferLocation = mCastleInstanceBuffer->GetGPUVirtualAddress();
+    mCastleInstanceBufferView.StrideInBytes = sizeof(CastleInstance);
+    mCastleInstanceBufferView.SizeInBytes = ibByteSize;
 }
 
 void ShapesApp::BuildTreeSpritesGeometry()
@@ -1274,6 +1241,18 @@ void ShapesApp::BuildPSOs()
     opaquePsoDesc.DSVFormat = mDepthStencilFormat;
     ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
 
+    //
+    // PSO for instanced opaque objects, such as the castle pieces.
+    //
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedPsoDesc = opaquePsoDesc;
+    instancedPsoDesc.InputLayout = { mInstancedInputLayout.data(), (UINT)mInstancedInputLayout.size() };
+    instancedPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+        mShaders["instancedVS"]->GetBufferSize()
+    };
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedPsoDesc, IID_PPV_ARGS(&mPSOs["opaqueInstanced"])));
+
     // 
     // PSO for transparent objects
     //
@@ -1301,6 +1280,18 @@ void ShapesApp::BuildPSOs()
     transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
     ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
+    //
+    // PSO for the water grid: transparent, fed by the compact two-stream layout.
+    //
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC waterPsoDesc = transparentPsoDesc;
+    waterPsoDesc.InputLayout = { mWaterInputLayout.data(), (UINT)mWaterInputLayout.size() };
+    waterPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["waterVS"]->GetBufferPointer()),
+        mShaders["waterVS"]->GetBufferSize()
+    };
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&waterPsoDesc, IID_PPV_ARGS(&mPSOs["water"])));
+
     //
     // PSO for alpha tested objects
     //
@@ -1346,7 +1337,7 @@ void ShapesApp::BuildFrameResources()
     for (int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaterClipmap->VertexCount()));
     }
 }
 
@@ -1460,27 +1451,9 @@ void ShapesApp::BuildRenderItems()
 
     UINT Index = 0;
 
-    auto wavesRitem = std::make_unique<RenderItem>();
-    //wavesRitem->World = MathHelper::Identity4x4();
-    XMStoreFloat4x4(&wavesRitem->World, XMMatrixScaling(3.0f, 1.0f, 3.0f) * XMMatrixTranslation(0.0f, -3.0f, 0.0f));
-    XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.f, 5.f, 5.f));
-    wavesRitem->ObjCBIndex = Index++;
-    wavesRitem->Mat = mMaterials["water"].get();
-    wavesRitem->Geo = mGeometries["waterGeo"].get();
-    wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["water"].IndexCount;
-    wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["water"].StartIndexLocation;
-    wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["water"].BaseVertexLocation;
-
-    // we use mVavesRitem in updatewaves() to set the dynamic VB of the wave renderitem to the current frame VB.
-    mWavesRitem = wavesRitem.get();
-
-    mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
-    mAllRitems.push_back(std::move(wavesRitem));
-
     auto treeSpritesRitem = std::make_unique<RenderItem>();
     treeSpritesRitem->World = MathHelper::Identity4x4();
-    treeSpritesRitem->ObjCBIndex = 3;
+    treeSpritesRitem->ObjCBIndex = Index++;
     treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
     treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
     //step2
@@ -1491,84 +1464,6 @@ void ShapesApp::BuildRenderItems()
     mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
     mAllRitems.push_back(std::move(treeSpritesRitem));
 
-    //leftwall
-    auto boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(35.0f, 30.0f, 1.5f) * XMMatrixTranslation(0.0f, 7.5f, 25.0f));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
-    //rightwall
-    boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(1.5f, 30.0f, 35.0f) * XMMatrixTranslation(-25.0f, 7.5f, 0.0f));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
-    //backwall
-    boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(1.5f, 30.0f, 35.0f) * XMMatrixTranslation(25.0f, 7.5f, 0.0f));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
-    //Frontwall_A
-    boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(10.0f, 30.0f, 1.5f) * XMMatrixTranslation(-15.0, 8.0, -25));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
-    //Frontwall_B
-    boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(10.0f, 30.0f, 1.5f) * XMMatrixTranslation(15, 8.0, -25));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
-    //Lintel
-    boxRitem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(10.0f, 10.0f, 1.5f) * XMMatrixTranslation(0.0f, 13, -25));
-    boxRitem->ObjCBIndex = Index++;
-    boxRitem->Mat = mMaterials["bricks0"].get();
-    boxRitem->Geo = mGeometries["shapeGeo"].get();
-    boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-    boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
-    mAllRitems.push_back(std::move(boxRitem));
-
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
     gridRitem->ObjCBIndex = Index++;
@@ -1581,153 +1476,6 @@ void ShapesApp::BuildRenderItems()
     mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
     mAllRitems.push_back(std::move(gridRitem));
 
-    //Battlements
-    auto box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(-15.0f, 16.0f, 24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(-15.0f, 16.0f, -24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(0.0f, 16.0f, 24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(0.0f, 16.0f, -24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(15.0f, 16.0f, 24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(5.0f, 5.0f, 1.5f) * XMMatrixTranslation(15.0f, 16.0f, -24.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    //right
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(25.0f, 17.0f, -15.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(25.0f, 16.0f, -1.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(25.0f, 16.0f, 14.5f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    //left
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(-25.0f, 16.0f, -15.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(-25.0f, 16.0f, -1.0f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
-    box2Ritem = std::make_unique<RenderItem>();
-    XMStoreFloat4x4(&box2Ritem->World, XMMatrixScaling(1.5f, 5.0f, 5.0f) * XMMatrixTranslation(-25.0f, 16.0f, 14.5f));
-    box2Ritem->ObjCBIndex = Index++;
-    box2Ritem->Mat = mMaterials["bricks0"].get();
-    box2Ritem->Geo = mGeometries["shapeGeo"].get();
-    box2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    box2Ritem->IndexCount = box2Ritem->Geo->DrawArgs["box2"].IndexCount;
-    box2Ritem->StartIndexLocation = box2Ritem->Geo->DrawArgs["box2"].StartIndexLocation;
-    box2Ritem->BaseVertexLocation = box2Ritem->Geo->DrawArgs["box2"].BaseVertexLocation;
-    mRitemLayer[(int)RenderLayer::Opaque].push_back(box2Ritem.get());
-    mAllRitems.push_back(std::move(box2Ritem));
-
     //Wedge
     auto wedgeRitem = std::make_unique<RenderItem>();
     XMStoreFloat4x4(&wedgeRitem->World, XMMatrixScaling(1.25f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 1.5f, -30.0f));
@@ -1818,91 +1566,50 @@ void ShapesApp::BuildRenderItems()
     mRitemLayer[(int)RenderLayer::Opaque].push_back(torusRitem.get());
     mAllRitems.push_back(std::move(torusRitem));
 
+    // The castle: one instanced draw per kind of piece, however many pieces there are.
+    const char* pieceMeshes[(int)CastlePiece::Count] = { "box", "box", "cylinder", "cone", "sphere" };
+    for (int p = 0; p < (int)CastlePiece::Count; ++p)
+    {
+        const CastlePieceRange& range = mCastleLayout.Pieces[p];
+        if (range.Count == 0)
+            continue;
+
+        auto pieceRitem = std::make_unique<RenderItem>();
+        pieceRitem->ObjCBIndex = Index++;
+        pieceRitem->Mat = mMaterials["bricks0"].get();
+        pieceRitem->Geo = mGeometries["shapeGeo"].get();
+        pieceRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        pieceRitem->IndexCount = pieceRitem->Geo->DrawArgs[pieceMeshes[p]].IndexCount;
+        pieceRitem->StartIndexLocation = pieceRitem->Geo->DrawArgs[pieceMeshes[p]].StartIndexLocation;
+        pieceRitem->BaseVertexLocation = pieceRitem->Geo->DrawArgs[pieceMeshes[p]].BaseVertexLocation;
+        pieceRitem->InstanceCount = range.Count;
+        pieceRitem->StartInstanceLocation = range.Start;
+        pieceRitem->InstanceBufferView = mCastleInstanceBufferView;
+        pieceRitem->Lods = GetLodChain(*pieceRitem->Geo, pieceMeshes[p]);
+        pieceRitem->LodBounds = range.Bounds;
+        pieceRitem->LodScale = range.MaxScale;
+        mRitemLayer[(int)RenderLayer::OpaqueInstanced].push_back(pieceRitem.get());
+        mAllRitems.push_back(std::move(pieceRitem));
+    }
 
-    //Pillars & Cones & Spheres
-    UINT objCBIndex = Index++;
-    for (int i = 0; i < 2; ++i)
+    // Water clipmap levels.  World and TexTransform follow the eye and are set in
+    // UpdateWaterClipmap(); the dynamic VB is set in UpdateWaves().
+    for (int l = 0; l < mWaterClipmap->LevelCount(); ++l)
     {
-        auto leftCylRitem = std::make_unique<RenderItem>();
-        auto rightCylRitem = std::make_unique<RenderItem>();
-        auto leftSphereRitem = std::make_unique<RenderItem>();
-        auto rightSphereRitem = std::make_unique<RenderItem>();
-        auto leftConeRitem = std::make_unique<RenderItem>();
-        auto rightConeRitem = std::make_unique<RenderItem>();
-
-        XMMATRIX leftCylWorld = XMMatrixTranslation(-25.0f + i * 50, 9.5f, 24.0f);
-        XMMATRIX rightCylWorld = XMMatrixTranslation(-25.0f + i * 50, 9.5f, -24.0f);
-        XMMATRIX leftConeWorld = XMMatrixTranslation(-25.0f + i * 50, 21.5f, 24.0f);
-        XMMATRIX rightConeWorld = XMMatrixTranslation(-25.0f + i * 50, 21.5f, -24.0f);
-        XMMATRIX leftSphereWorld = XMMatrixTranslation(-25.0f + i * 50, 24.5f, 24.0);
-        XMMATRIX rightSphereWorld = XMMatrixTranslation(-25.0f + i * 50, 24.5f, -24.0);
-
-        XMStoreFloat4x4(&leftCylRitem->World, leftCylWorld);
-        leftCylRitem->ObjCBIndex = objCBIndex++;
-        leftCylRitem->Mat = mMaterials["bricks0"].get();
-        leftCylRitem->Geo = mGeometries["shapeGeo"].get();
-        leftCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-        leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-        leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
-
-        XMStoreFloat4x4(&rightCylRitem->World, rightCylWorld);
-        rightCylRitem->ObjCBIndex = objCBIndex++;
-        rightCylRitem->Mat = mMaterials["bricks0"].get();
-        rightCylRitem->Geo = mGeometries["shapeGeo"].get();
-        rightCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-        rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-        rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
-
-        XMStoreFloat4x4(&leftConeRitem->World, leftConeWorld);
-        leftConeRitem->ObjCBIndex = objCBIndex++;
-        leftConeRitem->Mat = mMaterials["bricks0"].get();
-        leftConeRitem->Geo = mGeometries["shapeGeo"].get();
-        leftConeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        leftConeRitem->IndexCount = leftConeRitem->Geo->DrawArgs["cone"].IndexCount;
-        leftConeRitem->StartIndexLocation = leftConeRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-        leftConeRitem->BaseVertexLocation = leftConeRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(leftConeRitem.get());
-
-        XMStoreFloat4x4(&rightConeRitem->World, rightConeWorld);
-        rightConeRitem->ObjCBIndex = objCBIndex++;
-        rightConeRitem->Mat = mMaterials["bricks0"].get();
-        rightConeRitem->Geo = mGeometries["shapeGeo"].get();
-        rightConeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        rightConeRitem->IndexCount = rightConeRitem->Geo->DrawArgs["cone"].IndexCount;
-        rightConeRitem->StartIndexLocation = rightConeRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-        rightConeRitem->BaseVertexLocation = rightConeRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(rightConeRitem.get());
-
-        XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
-        leftSphereRitem->ObjCBIndex = objCBIndex++;
-        leftSphereRitem->Mat = mMaterials["bricks0"].get();
-        leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
-        leftSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-        leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-        leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(leftSphereRitem.get());
-
-        XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
-        rightSphereRitem->ObjCBIndex = objCBIndex++;
-        rightSphereRitem->Mat = mMaterials["bricks0"].get();
-        rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
-        rightSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-        rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-        rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-        mRitemLayer[(int)RenderLayer::Opaque].push_back(rightSphereRitem.get());
-
-        mAllRitems.push_back(std::move(leftCylRitem));
-        mAllRitems.push_back(std::move(rightCylRitem));
-        mAllRitems.push_back(std::move(leftConeRitem));
-        mAllRitems.push_back(std::move(rightConeRitem));
-        mAllRitems.push_back(std::move(leftSphereRitem));
-        mAllRitems.push_back(std::move(rightSphereRitem));
+        const SubmeshGeometry& submesh = mGeometries["waterGeo"]->DrawArgs[l == 0 ? "clipmapCenter" : "clipmapRing"];
+
+        auto waterRitem = std::make_unique<RenderItem>();
+        waterRitem->ObjCBIndex = Index++;
+        waterRitem->Mat = mMaterials["water"].get();
+        waterRitem->Geo = mGeometries["waterGeo"].get();
+        waterRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        waterRitem->IndexCount = submesh.IndexCount;
+        waterRitem->StartIndexLocation = submesh.StartIndexLocation;
+        waterRitem->BaseVertexLocation = l * mWaterClipmap->LevelVertexCount();
+
+        mWaterLevelRitems.push_back(waterRitem.get());
+        mRitemLayer[(int)RenderLayer::Water].push_back(waterRitem.get());
+        mAllRitems.push_back(std::move(waterRitem));
     }
 
     // All the render items are opaque.
@@ -1924,6 +1631,10 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
         auto ri = ritems[i];
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+        if (ri->DynamicVertexBufferView.BufferLocation != 0)
+            cmdList->IASetVertexBuffers(1, 1, &ri->DynamicVertexBufferView);
+        if (ri->InstanceBufferView.BufferLocation != 0)
+            cmdList->IASetVertexBuffers(1, 1, &ri->InstanceBufferView);
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
@@ -1937,7 +1648,8 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
         cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
         cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation,
+            ri->BaseVertexLocation, ri->StartInstanceLocation);
     }
 }
 
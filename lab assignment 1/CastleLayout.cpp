@@ -0,0 +1,270 @@
+//***************************************************************************************
+// CastleLayout.cpp
+//***************************************************************************************
+
+#include "CastleLayout.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// One wall, from the centre of tower k to the centre of tower k + 1.
+	struct WallSide
+	{
+		XMFLOAT2 From;        // xz
+		XMFLOAT2 Direction;   // xz, unit length
+		float Length;
+		float RotationY;      // turns the mesh's +x onto Direction
+	};
+
+	int BlockCount(float length, float blockLength)
+	{
+		if(blockLength <= 0.0f || length <= blockLength)
+			return 1;
+		return (int)std::ceil(length / blockLength);
+	}
+
+	int MerlonCount(const CastleParams& params, float sideLength)
+	{
+		if(params.CrenellationSpacing <= 0.0f || params.MerlonHeight <= 0.0f)
+			return 0;
+
+		// Keep clear of the towers at both ends.
+		const float usable = sideLength - 2.0f*params.TowerRadius;
+		return usable > 0.0f ? (int)std::floor(usable / params.CrenellationSpacing) : 0;
+	}
+
+	bool HasGate(const CastleParams& params, float sideLength)
+	{
+		return params.GateWidth > 0.0f && params.GateHeight > 0.0f &&
+			params.GateWidth < sideLength - 2.0f*params.TowerRadius;
+	}
+
+	// Where the opening starts and ends along its wall.  Counting and placing both use
+	// these, so they always agree on the number of blocks.
+	void GateSpan(const CastleParams& params, float sideLength, float& gateFrom, float& gateTo)
+	{
+		gateFrom = 0.5f*(sideLength - params.GateWidth);
+		gateTo = gateFrom + params.GateWidth;
+	}
+
+	int WallBlockCount(const CastleParams& params, float sideLength, bool gate)
+	{
+		if(!gate)
+			return BlockCount(sideLength, params.WallBlockLength);
+
+		// The stretches beside the opening, and the lintel above it.
+		float gateFrom, gateTo;
+		GateSpan(params, sideLength, gateFrom, gateTo);
+
+		int count = BlockCount(gateFrom, params.WallBlockLength) +
+			BlockCount(sideLength - gateTo, params.WallBlockLength);
+		if(params.GateHeight < params.WallHeight)
+			count += BlockCount(gateTo - gateFrom, params.WallBlockLength);
+		return count;
+	}
+
+	// Writes the blocks that fill [from, to] along side, between heights bottom and top.
+	CastleInstance* WriteWallStretch(CastleInstance* dst, const CastleParams& params, const WallSide& side,
+		float from, float to, float bottom, float top)
+	{
+		const int count = BlockCount(to - from, params.WallBlockLength);
+		const float length = (to - from) / count;
+
+		for(int b = 0; b < count; ++b)
+		{
+			const float t = from + (b + 0.5f)*length;
+
+			dst->Position = XMFLOAT3(side.From.x + t*side.Direction.x, 0.5f*(bottom + top),
+				side.From.y + t*side.Direction.y);
+			dst->RotationY = side.RotationY;
+			dst->Scale = XMFLOAT3(length, top - bottom, params.WallThickness);
+			++dst;
+		}
+
+		return dst;
+	}
+
+	void ComputeRangeBounds(const CastleInstance* instances, CastlePieceRange& range)
+	{
+		range.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+		range.MaxScale = 0.0f;
+		if(range.Count == 0)
+			return;
+
+		XMFLOAT3 vMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 vMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+		// Pieces along one wall share a rotation, so it rarely changes between them.
+		float rotation = 0.0f;
+		float c = 1.0f;
+		float s = 0.0f;
+
+		for(std::uint32_t i = range.Start; i < range.Start + range.Count; ++i)
+		{
+			const CastleInstance& instance = instances[i];
+
+			if(instance.RotationY != rotation)
+			{
+				rotation = instance.RotationY;
+				c = std::fabs(std::cos(rotation));
+				s = std::fabs(std::sin(rotation));
+			}
+
+			// Half extents of the turned unit cube.
+			const float hx = 0.5f*(c*instance.Scale.x + s*instance.Scale.z);
+			const float hy = 0.5f*instance.Scale.y;
+			const float hz = 0.5f*(s*instance.Scale.x + c*instance.Scale.z);
+
+			const XMFLOAT3& p = instance.Position;
+			vMin = XMFLOAT3(std::min(vMin.x, p.x - hx), std::min(vMin.y, p.y - hy), std::min(vMin.z, p.z - hz));
+			vMax = XMFLOAT3(std::max(vMax.x, p.x + hx), std::max(vMax.y, p.y + hy), std::max(vMax.z, p.z + hz));
+
+			range.MaxScale = std::max(range.MaxScale,
+				std::max(std::max(instance.Scale.x, instance.Scale.y), instance.Scale.z));
+		}
+
+		range.Bounds.Center = XMFLOAT3(0.5f*(vMin.x + vMax.x), 0.5f*(vMin.y + vMax.y), 0.5f*(vMin.z + vMax.z));
+		range.Bounds.Extents = XMFLOAT3(0.5f*(vMax.x - vMin.x), 0.5f*(vMax.y - vMin.y), 0.5f*(vMax.z - vMin.z));
+	}
+}
+
+void BuildCastleLayout(const CastleParams& params, CastleLayout& layout)
+{
+	assert(params.TowerCount >= 3);
+	assert(params.Perimeter > 0.0f && params.WallHeight > 0.0f);
+
+	const int towerCount = params.TowerCount;
+	const float sideLength = params.Perimeter / towerCount;
+
+	//
+	// The sides of the polygon, turned so that the middle of side 0 faces -z.
+	//
+
+	std::vector<WallSide> sides(towerCount);
+	std::vector<XMFLOAT2> corners(towerCount);
+
+	const float circumradius = 0.5f*sideLength / std::sin(XM_PI / towerCount);
+	for(int k = 0; k < towerCount; ++k)
+	{
+		const float angle = -XM_PIDIV2 + (2*k - 1)*XM_PI / towerCount;
+		corners[k] = XMFLOAT2(circumradius*std::cos(angle), circumradius*std::sin(angle));
+	}
+
+	for(int k = 0; k < towerCount; ++k)
+	{
+		const XMFLOAT2& from = corners[k];
+		const XMFLOAT2& to = corners[(k + 1) % towerCount];
+
+		WallSide& side = sides[k];
+		side.From = from;
+		side.Length = sideLength;
+		side.Direction = XMFLOAT2((to.x - from.x) / sideLength, (to.y - from.y) / sideLength);
+
+		// XMMatrixRotationY takes +x to (cos, 0, -sin).
+		side.RotationY = std::atan2(-side.Direction.y, side.Direction.x);
+	}
+
+	//
+	// Count every kind of piece, then place them straight into their ranges.
+	//
+
+	const bool gate = HasGate(params, sideLength);
+	const int merlonsPerSide = MerlonCount(params, sideLength);
+
+	std::uint32_t counts[(int)CastlePiece::Count] = {};
+	counts[(int)CastlePiece::Wall] = (std::uint32_t)(WallBlockCount(params, sideLength, gate) +
+		(towerCount - 1)*WallBlockCount(params, sideLength, false));
+	counts[(int)CastlePiece::Merlon] = (std::uint32_t)(towerCount*merlonsPerSide);
+	counts[(int)CastlePiece::Tower] = (std::uint32_t)towerCount;
+	counts[(int)CastlePiece::Roof] = params.RoofHeight > 0.0f ? (std::uint32_t)towerCount : 0;
+	counts[(int)CastlePiece::Finial] = (params.RoofHeight > 0.0f && params.FinialRadius > 0.0f) ? (std::uint32_t)towerCount : 0;
+
+	std::uint32_t total = 0;
+	for(int p = 0; p < (int)CastlePiece::Count; ++p)
+	{
+		layout.Pieces[p].Start = total;
+		layout.Pieces[p].Count = counts[p];
+		total += counts[p];
+	}
+
+	layout.Instances.resize(total);
+	CastleInstance* instances = layout.Instances.data();
+
+	CastleInstance* walls = instances + layout.Pieces[(int)CastlePiece::Wall].Start;
+	CastleInstance* merlons = instances + layout.Pieces[(int)CastlePiece::Merlon].Start;
+
+	const float merlonY = params.WallHeight + 0.5f*params.MerlonHeight;
+	const XMFLOAT3 merlonScale(0.5f*params.CrenellationSpacing, params.MerlonHeight, params.WallThickness);
+
+	for(int k = 0; k < towerCount; ++k)
+	{
+		const WallSide& side = sides[k];
+
+		if(k == 0 && gate)
+		{
+			float gateFrom, gateTo;
+			GateSpan(params, sideLength, gateFrom, gateTo);
+
+			walls = WriteWallStretch(walls, params, side, 0.0f, gateFrom, 0.0f, params.WallHeight);
+			walls = WriteWallStretch(walls, params, side, gateTo, sideLength, 0.0f, params.WallHeight);
+			if(params.GateHeight < params.WallHeight)
+				walls = WriteWallStretch(walls, params, side, gateFrom, gateTo, params.GateHeight, params.WallHeight);
+		}
+		else
+		{
+			walls = WriteWallStretch(walls, params, side, 0.0f, sideLength, 0.0f, params.WallHeight);
+		}
+
+		// Centred on the middle of the wall.
+		for(int m = 0; m < merlonsPerSide; ++m)
+		{
+			const float t = 0.5f*sideLength + (m - 0.5f*(merlonsPerSide - 1))*params.CrenellationSpacing;
+
+			merlons->Position = XMFLOAT3(side.From.x + t*side.Direction.x, merlonY, side.From.y + t*side.Direction.y);
+			merlons->RotationY = side.RotationY;
+			merlons->Scale = merlonScale;
+			++merlons;
+		}
+	}
+
+	assert(walls == instances + layout.Pieces[(int)CastlePiece::Wall].Start + counts[(int)CastlePiece::Wall]);
+	assert(merlons == instances + layout.Pieces[(int)CastlePiece::Merlon].Start + counts[(int)CastlePiece::Merlon]);
+
+	const float towerDiameter = 2.0f*params.TowerRadius;
+	const float finialDiameter = 2.0f*params.FinialRadius;
+	const float roofTop = params.TowerHeight + params.RoofHeight;
+
+	for(int k = 0; k < towerCount; ++k)
+	{
+		const XMFLOAT2& c = corners[k];
+
+		CastleInstance& tower = instances[layout.Pieces[(int)CastlePiece::Tower].Start + k];
+		tower.Position = XMFLOAT3(c.x, 0.5f*params.TowerHeight, c.y);
+		tower.RotationY = 0.0f;
+		tower.Scale = XMFLOAT3(towerDiameter, params.TowerHeight, towerDiameter);
+
+		if(counts[(int)CastlePiece::Roof] != 0)
+		{
+			CastleInstance& roof = instances[layout.Pieces[(int)CastlePiece::Roof].Start + k];
+			roof.Position = XMFLOAT3(c.x, params.TowerHeight + 0.5f*params.RoofHeight, c.y);
+			roof.RotationY = 0.0f;
+			roof.Scale = XMFLOAT3(towerDiameter, params.RoofHeight, towerDiameter);
+		}
+
+		if(counts[(int)CastlePiece::Finial] != 0)
+		{
+			CastleInstance& finial = instances[layout.Pieces[(int)CastlePiece::Finial].Start + k];
+			finial.Position = XMFLOAT3(c.x, roofTop + params.FinialRadius, c.y);
+			finial.RotationY = 0.0f;
+			finial.Scale = XMFLOAT3(finialDiameter, finialDiameter, finialDiameter);
+		}
+	}
+
+	for(int p = 0; p < (int)CastlePiece::Count; ++p)
+		ComputeRangeBounds(instances, layout.Pieces[p]);
+}
@@ -0,0 +1,114 @@
+//***************************************************************************************
+// CastleLayout.h
+//
+// Procedural castle layout.  Towers stand on the corners of a regular polygon, curtain
+// walls run between them, merlons line the wall tops, and the first wall has a gate.
+// The result is a flat array of instances grouped by piece kind, so each kind is one
+// instanced draw no matter how many pieces the castle has.
+//
+// Every piece kind is drawn with a mesh that fills the unit cube centred on the origin:
+// a 1x1x1 box, a cylinder or cone of radius 0.5 and height 1, a sphere of radius 0.5.
+// An instance scales that mesh to the size of the piece, turns it about +y and moves
+// it into place (see CastleInstanceWorld).
+//
+// Everything here is plain CPU work (no Direct3D), so layouts can be built and measured
+// headlessly; see CastleBench.
+//***************************************************************************************
+
+#ifndef CASTLELAYOUT_H
+#define CASTLELAYOUT_H
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+// One piece, as read by the instanced vertex shader: 28 bytes against 64 for a world
+// matrix.
+struct CastleInstance
+{
+	// Centre of the piece.
+	DirectX::XMFLOAT3 Position;
+
+	// Turn about +y, in radians, applied after Scale.
+	float RotationY;
+
+	// Size of the piece along the mesh's own axes.
+	DirectX::XMFLOAT3 Scale;
+};
+
+enum class CastlePiece : int
+{
+	Wall = 0,   // box; x runs along the wall, z through it
+	Merlon,     // box, oriented like its wall
+	Tower,      // cylinder
+	Roof,       // cone
+	Finial,     // sphere
+	Count
+};
+
+struct CastleParams
+{
+	// Length of the curtain wall, measured between tower centres.
+	float Perimeter = 200.0f;
+
+	float WallHeight = 15.0f;
+	float WallThickness = 2.25f;
+
+	// Walls longer than this are split into equal blocks, which keeps the texture scale
+	// and the culling granularity of huge castles in check.  0 never splits.
+	float WallBlockLength = 60.0f;
+
+	// Towers stand on the corners of a regular polygon, so at least 3.
+	int TowerCount = 4;
+	float TowerRadius = 2.5f;
+	float TowerHeight = 18.5f;
+
+	// Cone on every tower, and a ball on every cone; 0 leaves them out.
+	float RoofHeight = 5.0f;
+	float FinialRadius = 0.5f;
+
+	// Distance between neighbouring merlon centres.  Merlons are half that wide, so
+	// the gaps between them are as wide as the merlons.  0 leaves them out.
+	float CrenellationSpacing = 15.0f;
+	float MerlonHeight = 2.5f;
+
+	// Opening in the middle of the first wall, the one facing -z; 0 for none.
+	float GateWidth = 15.0f;
+	float GateHeight = 10.5f;
+};
+
+// Instances [Start, Start + Count) of CastleLayout::Instances are of one piece kind.
+struct CastlePieceRange
+{
+	std::uint32_t Start = 0;
+	std::uint32_t Count = 0;
+
+	// Box around all of them, and the largest Scale component among them: how much a
+	// distance in the mesh can grow on screen.
+	DirectX::BoundingBox Bounds;
+	float MaxScale = 0.0f;
+};
+
+struct CastleLayout
+{
+	std::vector<CastleInstance> Instances;
+	CastlePieceRange Pieces[(int)CastlePiece::Count];
+};
+
+///<summary>
+/// Lays out the castle described by params, centred on the origin with the ground at
+/// y = 0.  Counts are worked out first, so Instances is allocated exactly once (and
+/// not at all when layout already has the capacity).
+///</summary>
+void BuildCastleLayout(const CastleParams& params, CastleLayout& layout);
+
+// World matrix of an instance: Scale, then RotationY, then Position.
+inline DirectX::XMMATRIX CastleInstanceWorld(const CastleInstance& instance)
+{
+	return DirectX::XMMatrixScaling(instance.Scale.x, instance.Scale.y, instance.Scale.z) *
+		DirectX::XMMatrixRotationY(instance.RotationY) *
+		DirectX::XMMatrixTranslation(instance.Position.x, instance.Position.y, instance.Position.z);
+}
+
+#endif // CASTLELAYOUT_H
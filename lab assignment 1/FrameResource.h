@@ -3,6 +3,7 @@
 #include "../Common/d3dUtil.h"
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
+#include "Waves.h"
 
 struct ObjectConstants
 {
@@ -49,6 +50,11 @@ struct Vertex
 	DirectX::XMFLOAT2 TexC;
 };
 
+// Waves::WriteVertices() output can stand in for Vertex data.
+static_assert(sizeof(WaveVertex) == sizeof(Vertex), "WaveVertex must match Vertex");
+static_assert(offsetof(WaveVertex, Normal) == offsetof(Vertex, Normal), "WaveVertex must match Vertex");
+static_assert(offsetof(WaveVertex, TexC) == offsetof(Vertex, TexC), "WaveVertex must match Vertex");
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
@@ -72,8 +78,9 @@ public:
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
-    // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // the commands that reference it.  So each frame needs their own.  Only the
+    // per-frame half of the water vertices lives here; see WaveCompactVertex.
+    std::unique_ptr<UploadBuffer<WaveCompactVertex>> WavesVB = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
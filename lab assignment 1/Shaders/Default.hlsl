@@ -78,12 +78,50 @@ cbuffer cbMaterial : register(b2)
 	float4x4 gMatTransform;
 };
 
+#ifdef WAVE_COMPACT
+// Water grid: static xz/uv in slot 0, per-frame height and octahedral normal in slot 1.
+struct VertexIn
+{
+	float2 PosXZ     : POSITION;
+	float2 TexC      : TEXCOORD;
+	float  Height    : HEIGHT;
+	float2 OctNormal : NORMAL;
+};
+
+// Inverse of EncodeWaveNormal() in Waves.cpp.
+float3 DecodeOctNormal(float2 e)
+{
+    float3 n = float3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+    if(n.y < 0.0f)
+        n.xz = (1.0f - abs(n.zx)) * float2(n.x >= 0.0f ? 1.0f : -1.0f, n.z >= 0.0f ? 1.0f : -1.0f);
+
+    return normalize(n);
+}
+#elif defined(INSTANCED)
+// Shared mesh in slot 0, one CastleInstance (see CastleLayout.h) per instance in slot 1.
+struct VertexIn
+{
+	float3 PosL          : POSITION;
+    float3 NormalL       : NORMAL;
+	float2 TexC          : TEXCOORD;
+	float3 InstPosition  : INSTPOSITION;
+	float  InstRotationY : INSTROTATION;
+	float3 InstScale     : INSTSCALE;
+};
+
+// Turns v about +y by the angle whose sine and cosine are s and c, as XMMatrixRotationY does.
+float3 RotateY(float3 v, float s, float c)
+{
+    return float3(v.x*c + v.z*s, v.y, v.z*c - v.x*s);
+}
+#else
 struct VertexIn
 {
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -96,13 +134,28 @@ struct VertexOut
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef WAVE_COMPACT
+    float3 posL = float3(vin.PosXZ.x, vin.Height, vin.PosXZ.y);
+    float3 normalL = DecodeOctNormal(vin.OctNormal);
+#elif defined(INSTANCED)
+    float s, c;
+    sincos(vin.InstRotationY, s, c);
+
+    // The scale is nonuniform, so the normal takes its inverse.
+    float3 posL = RotateY(vin.PosL*vin.InstScale, s, c) + vin.InstPosition;
+    float3 normalL = normalize(RotateY(vin.NormalL/vin.InstScale, s, c));
+#else
+    float3 posL = vin.PosL;
+    float3 normalL = vin.NormalL;
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)gWorld);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -0,0 +1,190 @@
+//***************************************************************************************
+// WaterClipmap.cpp
+//***************************************************************************************
+
+#include "WaterClipmap.h"
+#include <cassert>
+#include <cmath>
+
+WaterClipmap::WaterClipmap(int gridSize, int levelCount, float baseCellSize)
+{
+	assert(gridSize >= 4 && gridSize % 4 == 0);
+	assert(levelCount >= 1);
+	assert((gridSize + 1)*(gridSize + 1) <= 0x10000); // 16-bit indices per level
+
+	mGridSize = gridSize;
+	mLevelCount = levelCount;
+
+	mLevels.resize(levelCount);
+	for(int l = 0; l < levelCount; ++l)
+		mLevels[l].CellSize = baseCellSize*(float)(1 << l);
+
+	// Start centred on the origin, but let the first real Update() report a change
+	// so clients place their levels at least once.
+	Update(0.0f, 0.0f);
+	mPlaced = false;
+}
+
+void WaterClipmap::BuildStaticVertices(WaveStaticVertex* dst)const
+{
+	const int n = mGridSize;
+
+	for(int l = 0; l < mLevelCount; ++l)
+	{
+		const float cell = mLevels[l].CellSize;
+
+		for(int i = 0; i <= n; ++i)
+		{
+			for(int j = 0; j <= n; ++j)
+			{
+				WaveStaticVertex& v = *dst++;
+				v.PosXZ = DirectX::XMFLOAT2(j*cell, i*cell);
+				v.TexC = v.PosXZ;
+			}
+		}
+	}
+}
+
+namespace
+{
+	// Two triangles for the quad whose lower-left vertex is (i, j).  Rows run along +z,
+	// so this is the clockwise order when seen from above.
+	void AddQuad(std::vector<std::uint16_t>& indices, int n, int i, int j)
+	{
+		const int stride = n + 1;
+
+		indices.push_back((std::uint16_t)(i*stride + j));
+		indices.push_back((std::uint16_t)((i + 1)*stride + j));
+		indices.push_back((std::uint16_t)(i*stride + j + 1));
+
+		indices.push_back((std::uint16_t)((i + 1)*stride + j));
+		indices.push_back((std::uint16_t)((i + 1)*stride + j + 1));
+		indices.push_back((std::uint16_t)(i*stride + j + 1));
+	}
+}
+
+std::vector<std::uint16_t> WaterClipmap::BuildCenterIndices()const
+{
+	const int n = mGridSize;
+
+	std::vector<std::uint16_t> indices;
+	indices.reserve(6*n*n);
+
+	for(int i = 0; i < n; ++i)
+	{
+		for(int j = 0; j < n; ++j)
+			AddQuad(indices, n, i, j);
+	}
+
+	return indices;
+}
+
+std::vector<std::uint16_t> WaterClipmap::BuildRingIndices()const
+{
+	const int n = mGridSize;
+
+	// The next finer level covers the middle half of the cells in each direction.
+	const int holeBegin = n/4;
+	const int holeEnd = 3*n/4;
+
+	std::vector<std::uint16_t> indices;
+	indices.reserve(6*(n*n - (n/2)*(n/2)));
+
+	for(int i = 0; i < n; ++i)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			if(i >= holeBegin && i < holeEnd && j >= holeBegin && j < holeEnd)
+				continue;
+
+			AddQuad(indices, n, i, j);
+		}
+	}
+
+	return indices;
+}
+
+bool WaterClipmap::Update(float eyeX, float eyeZ)
+{
+	// Snapping to the coarsest level's doubled cell keeps every level's vertices on
+	// its own (and the next coarser level's) lattice.
+	const float snap = 2.0f*mLevels[mLevelCount - 1].CellSize;
+	const float centerX = std::floor(eyeX / snap + 0.5f)*snap;
+	const float centerZ = std::floor(eyeZ / snap + 0.5f)*snap;
+
+	const float halfCells = 0.5f*mGridSize;
+	const float originX = centerX - halfCells*mLevels[0].CellSize;
+	const float originZ = centerZ - halfCells*mLevels[0].CellSize;
+
+	if(mPlaced && originX == mLevels[0].OriginX && originZ == mLevels[0].OriginZ)
+		return false;
+
+	for(auto& level : mLevels)
+	{
+		level.OriginX = centerX - halfCells*level.CellSize;
+		level.OriginZ = centerZ - halfCells*level.CellSize;
+	}
+
+	mPlaced = true;
+	return true;
+}
+
+void WaterClipmap::WriteLevelVertices(int level, const WaveGridLayout& layout, const float* heights,
+	const float* normalX, const float* normalY, const float* normalZ, WaveCompactVertex* dst)const
+{
+	const WaterClipmapLevel& lv = mLevels[level];
+	const int n = mGridSize;
+	const int stride = n + 1;
+
+	const int cols = layout.ColumnCount;
+	const std::uint32_t up = EncodeWaveNormal(0.0f, 1.0f, 0.0f);
+
+	for(int i = 0; i <= n; ++i)
+	{
+		const float z = lv.OriginZ + i*lv.CellSize;
+
+		for(int j = 0; j <= n; ++j)
+		{
+			WaveCompactVertex& v = dst[i*stride + j];
+
+			WaveBilinearTap tap;
+			if(!ComputeWaveBilinearTap(layout, lv.OriginX + j*lv.CellSize, z, tap))
+			{
+				v.Height = 0.0f;
+				v.Normal = up;
+				continue;
+			}
+
+			const int k00 = tap.Index;
+			const int k10 = k00 + cols;
+
+			const float w00 = tap.W00;
+			const float w01 = tap.W01;
+			const float w10 = tap.W10;
+			const float w11 = tap.W11;
+
+			v.Height = w00*heights[k00] + w01*heights[k00 + 1] + w10*heights[k10] + w11*heights[k10 + 1];
+
+			// EncodeWaveNormal projects onto the octahedron, so the blend need not be unit length.
+			v.Normal = EncodeWaveNormal(
+				w00*normalX[k00] + w01*normalX[k00 + 1] + w10*normalX[k10] + w11*normalX[k10 + 1],
+				w00*normalY[k00] + w01*normalY[k00 + 1] + w10*normalY[k10] + w11*normalY[k10 + 1],
+				w00*normalZ[k00] + w01*normalZ[k00 + 1] + w10*normalZ[k10] + w11*normalZ[k10 + 1]);
+		}
+	}
+
+	// Stitch the outer edge to the coarser level around it.
+	for(int k = 1; k < n; k += 2)
+	{
+		const int edges[4][3] =
+		{
+			{ k - 1, k, k + 1 },                                            // row 0
+			{ n*stride + k - 1, n*stride + k, n*stride + k + 1 },           // row n
+			{ (k - 1)*stride, k*stride, (k + 1)*stride },                   // column 0
+			{ (k - 1)*stride + n, k*stride + n, (k + 1)*stride + n }        // column n
+		};
+
+		for(const auto& e : edges)
+			dst[e[1]].Height = 0.5f*(dst[e[0]].Height + dst[e[2]].Height);
+	}
+}
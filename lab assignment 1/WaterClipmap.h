@@ -0,0 +1,84 @@
+//***************************************************************************************
+// WaterClipmap.h
+//
+// Geometry-clipmap style LOD for the water surface.  Level 0 is a full square grid of
+// GridSize x GridSize cells around the eye; every following level has the same number
+// of cells at twice the cell size, with the middle quarter cut out where the finer
+// level sits.  The vertex cost is fixed no matter how large an area the outermost
+// level covers.
+//
+// All levels share one centre, snapped to multiples of the coarsest level's doubled
+// cell size.  Every level therefore only ever moves by whole cells of its own, so
+// vertices stay on a fixed world lattice and the surface does not swim.
+//
+// Everything here is plain CPU work (no Direct3D), in the water's local space: the
+// same space the Waves grid lives in, centred on the origin with +y up.
+//***************************************************************************************
+
+#ifndef WATERCLIPMAP_H
+#define WATERCLIPMAP_H
+
+#include <cstdint>
+#include <vector>
+#include "Waves.h"
+
+struct WaterClipmapLevel
+{
+	// Size of one grid cell.
+	float CellSize = 0.0f;
+
+	// Local-space xz of the level's first vertex (grid row 0, column 0).
+	float OriginX = 0.0f;
+	float OriginZ = 0.0f;
+};
+
+class WaterClipmap
+{
+public:
+	// gridSize is the number of cells per level side and must be a multiple of 4.
+	WaterClipmap(int gridSize, int levelCount, float baseCellSize);
+	WaterClipmap(const WaterClipmap& rhs) = delete;
+	WaterClipmap& operator=(const WaterClipmap& rhs) = delete;
+
+	int GridSize()const { return mGridSize; }
+	int LevelCount()const { return mLevelCount; }
+
+	// Vertices per level ((GridSize+1)^2) and for all levels together.  Level l owns
+	// vertices [l*LevelVertexCount(), (l+1)*LevelVertexCount()).
+	int LevelVertexCount()const { return (mGridSize + 1)*(mGridSize + 1); }
+	int VertexCount()const { return mLevelCount*LevelVertexCount(); }
+
+	const WaterClipmapLevel& Level(int level)const { return mLevels[level]; }
+
+	// Static stream for all levels: xz relative to the level origin (so only a
+	// translation is needed to place a level) and texture coordinates equal to it.
+	void BuildStaticVertices(WaveStaticVertex* dst)const;
+
+	// Triangle lists over one level's vertices (vertex 0 = the level's first vertex).
+	// Level 0 uses the full grid, all other levels the ring with the hole.
+	std::vector<std::uint16_t> BuildCenterIndices()const;
+	std::vector<std::uint16_t> BuildRingIndices()const;
+
+	// Recentres the levels on the eye position (local xz).  Returns true when the
+	// level origins changed.
+	bool Update(float eyeX, float eyeZ);
+
+	///<summary>
+	/// Fills one level's dynamic stream (LevelVertexCount() vertices) by bilinearly
+	/// sampling a solution; points outside the simulated grid are flat.  The odd
+	/// vertices on the level's outer edge are pulled onto the line between their
+	/// neighbours, which is exactly where the next coarser level has its edge, so
+	/// neighbouring levels meet without cracks.
+	///</summary>
+	void WriteLevelVertices(int level, const WaveGridLayout& layout, const float* heights,
+		const float* normalX, const float* normalY, const float* normalZ, WaveCompactVertex* dst)const;
+
+private:
+	int mGridSize = 0;
+	int mLevelCount = 0;
+	bool mPlaced = false;
+
+	std::vector<WaterClipmapLevel> mLevels;
+};
+
+#endif // WATERCLIPMAP_H
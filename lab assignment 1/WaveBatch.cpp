@@ -0,0 +1,221 @@
+//***************************************************************************************
+// WaveBatch.cpp
+//***************************************************************************************
+
+#include "WaveBatch.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "WaveKernels.h"
+
+using namespace WaveKernels;
+
+WaveBatch::WaveBatch()
+{
+}
+
+WaveBatch::~WaveBatch()
+{
+}
+
+int WaveBatch::AddGrid(int m, int n, float dx, float dt, float speed, float damping)
+{
+	Grid grid;
+	grid.Layout = BuildWaveGridLayout(m, n, dx);
+	grid.TimeStep = dt;
+
+	// Same constants as Waves.
+	float d = damping*dt + 2.0f;
+	float e = (speed*speed)*(dt*dt) / (dx*dx);
+	grid.K1 = (damping*dt - 2.0f) / d;
+	grid.K2 = (4.0f - 8.0f*e) / d;
+	grid.K3 = (2.0f*e) / d;
+
+	// Five planes per grid: prev, curr, and the normal components.
+	const size_t planeSize = (size_t)m*n;
+	const size_t base = mArena.size();
+	grid.Prev = base;
+	grid.Curr = base + planeSize;
+	grid.NormalX = base + 2*planeSize;
+	grid.NormalY = base + 3*planeSize;
+	grid.NormalZ = base + 4*planeSize;
+
+	mArena.resize(base + 5*planeSize, 0.0f);
+	std::fill(mArena.begin() + grid.NormalY, mArena.begin() + grid.NormalZ, 1.0f);
+
+	mGrids.push_back(std::move(grid));
+	BuildWorkItems();
+
+	return (int)mGrids.size() - 1;
+}
+
+void WaveBatch::WriteVertices(int grid, WaveVertex* dst)const
+{
+	WriteWaveVertices(mGrids[grid].Layout, Heights(grid), NormalsX(grid), NormalsY(grid), NormalsZ(grid),
+		0, RowCount(grid), dst);
+}
+
+void WaveBatch::WriteCompactVertices(int grid, WaveCompactVertex* dst)const
+{
+	WriteWaveCompactVertices(Heights(grid), NormalsX(grid), NormalsY(grid), NormalsZ(grid),
+		0, VertexCount(grid), dst);
+}
+
+void WaveBatch::SetScheduler(TaskScheduler* scheduler)
+{
+	mScheduler = scheduler ? scheduler : &mSerialScheduler;
+}
+
+void WaveBatch::SetBandRows(int bandRows)
+{
+	mBandRows = std::max(bandRows, 1);
+	BuildWorkItems();
+}
+
+void WaveBatch::SetMaxSubsteps(int maxSubsteps, WaveOverloadPolicy policy)
+{
+	mMaxSubsteps = std::max(maxSubsteps, 1);
+	mOverloadPolicy = policy;
+}
+
+void WaveBatch::Update(float dt)
+{
+	// Per grid, exactly what Waves::Update() does.
+	for(auto& grid : mGrids)
+	{
+		grid.TimeAccumulator += dt;
+
+		int stepCount = (int)(grid.TimeAccumulator / grid.TimeStep);
+		if(stepCount > mMaxSubsteps)
+			stepCount = mMaxSubsteps;
+
+		grid.TimeAccumulator -= stepCount*grid.TimeStep;
+
+		if(mOverloadPolicy == WaveOverloadPolicy::DropExcess)
+			grid.TimeAccumulator = std::fmod(grid.TimeAccumulator, grid.TimeStep);
+		else
+			grid.TimeAccumulator = std::min(grid.TimeAccumulator, mMaxSubsteps*grid.TimeStep);
+
+		grid.StepCount = stepCount;
+	}
+
+	Advance();
+}
+
+void WaveBatch::Step(int stepCount)
+{
+	for(auto& grid : mGrids)
+		grid.StepCount = std::max(stepCount, 0);
+
+	Advance();
+}
+
+void WaveBatch::Disturb(int grid, int i, int j, float magnitude)
+{
+	const Grid& g = mGrids[grid];
+	const int n = g.Layout.ColumnCount;
+
+	// Don't disturb boundaries.
+	assert(i > 1 && i < g.Layout.RowCount-2);
+	assert(j > 1 && j < n-2);
+
+	float halfMag = 0.5f*magnitude;
+
+	float* curr = &mArena[g.Curr];
+	curr[i*n+j]     += magnitude;
+	curr[i*n+j+1]   += halfMag;
+	curr[i*n+j-1]   += halfMag;
+	curr[(i+1)*n+j] += halfMag;
+	curr[(i-1)*n+j] += halfMag;
+}
+
+void WaveBatch::BuildWorkItems()
+{
+	mWorkItems.clear();
+
+	for(int g = 0; g < (int)mGrids.size(); ++g)
+	{
+		const int m = mGrids[g].Layout.RowCount;
+
+		for(int rowBegin = 1; rowBegin < m - 1; rowBegin += mBandRows)
+		{
+			WorkItem item;
+			item.Grid = g;
+			item.RowBegin = rowBegin;
+			item.RowEnd = std::min(rowBegin + mBandRows, m - 1);
+			mWorkItems.push_back(item);
+		}
+	}
+}
+
+void WaveBatch::Advance()
+{
+	int maxSteps = 0;
+	for(const auto& grid : mGrids)
+		maxSteps = std::max(maxSteps, grid.StepCount);
+
+	for(int s = 0; s < maxSteps; ++s)
+	{
+		// Grids that have taken all their steps drop out of later dispatches.
+		mActiveItems.clear();
+		for(const auto& item : mWorkItems)
+		{
+			if(mGrids[item.Grid].StepCount > s)
+				mActiveItems.push_back(item);
+		}
+
+		mScheduler->ParallelFor(0, (int)mActiveItems.size(), 1, [this](int first, int last)
+		{
+			for(int k = first; k < last; ++k)
+				SolveItem(mActiveItems[k]);
+		});
+
+		for(auto& grid : mGrids)
+		{
+			if(grid.StepCount > s)
+				std::swap(grid.Prev, grid.Curr);
+		}
+	}
+
+	mActiveItems.clear();
+	for(const auto& item : mWorkItems)
+	{
+		if(mGrids[item.Grid].StepCount > 0)
+			mActiveItems.push_back(item);
+	}
+
+	mScheduler->ParallelFor(0, (int)mActiveItems.size(), 1, [this](int first, int last)
+	{
+		for(int k = first; k < last; ++k)
+			ComputeNormalItem(mActiveItems[k]);
+	});
+}
+
+void WaveBatch::SolveItem(const WorkItem& item)
+{
+	const Grid& g = mGrids[item.Grid];
+	const int n = g.Layout.ColumnCount;
+
+	for(int i = item.RowBegin; i < item.RowEnd; ++i)
+	{
+		float* prev = &mArena[g.Prev + (size_t)i*n + 1];
+		const float* curr = &mArena[g.Curr + (size_t)i*n + 1];
+
+		StepRow(prev, prev, curr - n, curr, curr + n, n - 2, g.K1, g.K2, g.K3);
+	}
+}
+
+void WaveBatch::ComputeNormalItem(const WorkItem& item)
+{
+	const Grid& g = mGrids[item.Grid];
+	const int n = g.Layout.ColumnCount;
+
+	for(int i = item.RowBegin; i < item.RowEnd; ++i)
+	{
+		const size_t k = (size_t)i*n + 1;
+		const float* curr = &mArena[g.Curr + k];
+
+		NormalRow(&mArena[g.NormalX + k], &mArena[g.NormalY + k], &mArena[g.NormalZ + k],
+			curr - n, curr, curr + n, n - 2, 2.0f*g.Layout.SpatialStep);
+	}
+}
@@ -0,0 +1,118 @@
+//***************************************************************************************
+// WaveBatch.h
+//
+// Many independent wave grids (ponds, moats, ...) solved together.  All grids live in
+// one contiguous arena, and each time step is a single parallel dispatch over a flat
+// list of work items: a small grid is one item, a large one is split into row bands.
+// That pays the scheduling overhead once per step instead of once per grid, and keeps
+// every core busy even when no single grid is big enough to split.
+//
+// Each grid behaves like a Waves object in TwoPass mode: same stencil, same kernels,
+// same results.  Sleeping tiles and the other solver modes are not available here.
+//***************************************************************************************
+
+#ifndef WAVEBATCH_H
+#define WAVEBATCH_H
+
+#include <cstddef>
+#include <vector>
+#include "Waves.h"
+
+class WaveBatch
+{
+public:
+	WaveBatch();
+	WaveBatch(const WaveBatch& rhs) = delete;
+	WaveBatch& operator=(const WaveBatch& rhs) = delete;
+	~WaveBatch();
+
+	///<summary>
+	/// Adds an m x n grid with the same parameters as the Waves constructor and
+	/// returns its index.  The arena grows, so pointers returned by Heights() and
+	/// the Normals*() functions are invalidated; add every grid up front.
+	///</summary>
+	int AddGrid(int m, int n, float dx, float dt, float speed, float damping);
+
+	int GridCount()const { return (int)mGrids.size(); }
+	int RowCount(int grid)const { return mGrids[grid].Layout.RowCount; }
+	int ColumnCount(int grid)const { return mGrids[grid].Layout.ColumnCount; }
+	int VertexCount(int grid)const { return RowCount(grid)*ColumnCount(grid); }
+	const WaveGridLayout& GridLayout(int grid)const { return mGrids[grid].Layout; }
+
+	// Current solution of one grid, laid out like Waves::Heights() / NormalsX() etc.
+	const float* Heights(int grid)const { return &mArena[mGrids[grid].Curr]; }
+	const float* NormalsX(int grid)const { return &mArena[mGrids[grid].NormalX]; }
+	const float* NormalsY(int grid)const { return &mArena[mGrids[grid].NormalY]; }
+	const float* NormalsZ(int grid)const { return &mArena[mGrids[grid].NormalZ]; }
+
+	void WriteVertices(int grid, WaveVertex* dst)const;
+	void WriteCompactVertices(int grid, WaveCompactVertex* dst)const;
+
+	// As for Waves.  Work items span at most bandRows grid rows (default 16).
+	void SetScheduler(TaskScheduler* scheduler);
+	void SetBandRows(int bandRows);
+	void SetMaxSubsteps(int maxSubsteps, WaveOverloadPolicy policy);
+
+	// Waves::Update() for every grid at once.  Each grid keeps its own time step and
+	// accumulator, so grids may take different numbers of substeps.
+	void Update(float dt);
+	int LastSubstepCount(int grid)const { return mGrids[grid].StepCount; }
+
+	// Advances every grid exactly stepCount time steps and refreshes the normals.
+	void Step(int stepCount);
+
+	void Disturb(int grid, int i, int j, float magnitude);
+
+private:
+	struct Grid
+	{
+		WaveGridLayout Layout;
+
+		float K1 = 0.0f;
+		float K2 = 0.0f;
+		float K3 = 0.0f;
+		float TimeStep = 0.0f;
+		float TimeAccumulator = 0.0f;
+
+		// Steps the current Update()/Step() takes for this grid.
+		int StepCount = 0;
+
+		// Arena offsets of the grid's planes.  Prev and Curr swap every step.
+		size_t Prev = 0;
+		size_t Curr = 0;
+		size_t NormalX = 0;
+		size_t NormalY = 0;
+		size_t NormalZ = 0;
+	};
+
+	// Interior rows [RowBegin, RowEnd) of one grid.
+	struct WorkItem
+	{
+		int Grid = 0;
+		int RowBegin = 0;
+		int RowEnd = 0;
+	};
+
+	// Takes Grid::StepCount steps on every grid, then recomputes the normals of the
+	// grids that moved.
+	void Advance();
+	void BuildWorkItems();
+	void SolveItem(const WorkItem& item);
+	void ComputeNormalItem(const WorkItem& item);
+
+private:
+	std::vector<Grid> mGrids;
+	std::vector<float> mArena;
+
+	std::vector<WorkItem> mWorkItems;
+	std::vector<WorkItem> mActiveItems;
+	int mBandRows = 16;
+
+	int mMaxSubsteps = 8;
+	WaveOverloadPolicy mOverloadPolicy = WaveOverloadPolicy::DropExcess;
+
+	SerialTaskScheduler mSerialScheduler;
+	TaskScheduler* mScheduler = &mSerialScheduler;
+};
+
+#endif // WAVEBATCH_H
@@ -0,0 +1,287 @@
+//***************************************************************************************
+// WaveKernels.h
+//
+// Row kernels shared by the wave solvers (Waves and WaveBatch).  The instruction set
+// is picked at compile time: AVX2 when the compiler targets it, else SSE2 on x86/x64,
+// else plain C++.
+//***************************************************************************************
+
+#ifndef WAVEKERNELS_H
+#define WAVEKERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WAVES_KERNEL_AVX2
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define WAVES_KERNEL_SSE2
+#endif
+
+namespace WaveKernels
+{
+	//
+	// Row kernels.  Every pointer addresses the first interior column of a row, so
+	// p[-1] and p[count] are the (read-only) left and right neighbours.  The vector
+	// paths evaluate exactly the same expression as the scalar tail, in the same
+	// order, so all three kernels produce identical results.
+	//
+
+	// out[j] = k1*prev[j] + k2*mid[j] + k3*(down[j] + up[j] + mid[j+1] + mid[j-1])
+	// out may alias prev.
+	inline void StepRow(float* out, const float* prev, const float* up, const float* mid, const float* down,
+		int count, float k1, float k2, float k3)
+	{
+		int j = 0;
+
+#if defined(WAVES_KERNEL_AVX2)
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(mid + j + 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(mid + j - 1));
+
+			__m256 h = _mm256_mul_ps(vk1, _mm256_loadu_ps(prev + j));
+			h = _mm256_add_ps(h, _mm256_mul_ps(vk2, _mm256_loadu_ps(mid + j)));
+			h = _mm256_add_ps(h, _mm256_mul_ps(vk3, sum));
+			_mm256_storeu_ps(out + j, h);
+		}
+#elif defined(WAVES_KERNEL_SSE2)
+		const __m128 vk1 = _mm_set1_ps(k1);
+		const __m128 vk2 = _mm_set1_ps(k2);
+		const __m128 vk3 = _mm_set1_ps(k3);
+		for(; j + 4 <= count; j += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(mid + j + 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(mid + j - 1));
+
+			__m128 h = _mm_mul_ps(vk1, _mm_loadu_ps(prev + j));
+			h = _mm_add_ps(h, _mm_mul_ps(vk2, _mm_loadu_ps(mid + j)));
+			h = _mm_add_ps(h, _mm_mul_ps(vk3, sum));
+			_mm_storeu_ps(out + j, h);
+		}
+#endif
+
+		for(; j < count; ++j)
+		{
+			float sum = down[j] + up[j] + mid[j+1] + mid[j-1];
+			out[j] = k1*prev[j] + k2*mid[j] + k3*sum;
+		}
+	}
+
+	//
+	// Fixed-point heights are Q16.16: 1.0 is 65536.
+	//
+
+	const int FixedShift = 16;
+
+	inline std::int32_t ToFixed(float v)
+	{
+		return (std::int32_t)std::lround(v*(float)(1 << FixedShift));
+	}
+
+	inline float FromFixed(std::int32_t v)
+	{
+		return (float)v*(1.0f / (float)(1 << FixedShift));
+	}
+
+	// Integer version of StepRow: the same stencil with Q16.16 coefficients, summed
+	// exactly in 64 bits and rounded to nearest once.  The neighbour sum wraps in
+	// 32 bits in every kernel.  Integer math has no evaluation-order freedom, so
+	// all three kernels produce identical results by construction.
+	inline void StepRowFixed(std::int32_t* out, const std::int32_t* prev, const std::int32_t* up,
+		const std::int32_t* mid, const std::int32_t* down, int count,
+		std::int32_t k1, std::int32_t k2, std::int32_t k3)
+	{
+		const std::int64_t half = (std::int64_t)1 << (FixedShift - 1);
+
+		int j = 0;
+
+#if defined(WAVES_KERNEL_AVX2)
+		// _mm256_mul_epi32 multiplies the even 32-bit lanes into 64-bit products; the
+		// odd lanes are shifted down to take their turn.  Only the low 32 bits of
+		// each shifted sum are kept, and those are the same for a logical shift.
+		const __m256i vk1 = _mm256_set1_epi32(k1);
+		const __m256i vk2 = _mm256_set1_epi32(k2);
+		const __m256i vk3 = _mm256_set1_epi32(k3);
+		const __m256i vhalf = _mm256_set1_epi64x(half);
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256i sum = _mm256_add_epi32(
+				_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(down + j)), _mm256_loadu_si256((const __m256i*)(up + j))),
+				_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(mid + j + 1)), _mm256_loadu_si256((const __m256i*)(mid + j - 1))));
+			__m256i p = _mm256_loadu_si256((const __m256i*)(prev + j));
+			__m256i c = _mm256_loadu_si256((const __m256i*)(mid + j));
+
+			__m256i even = _mm256_add_epi64(vhalf, _mm256_mul_epi32(vk1, p));
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(vk2, c));
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(vk3, sum));
+
+			__m256i odd = _mm256_add_epi64(vhalf, _mm256_mul_epi32(vk1, _mm256_srli_epi64(p, 32)));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(vk2, _mm256_srli_epi64(c, 32)));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(vk3, _mm256_srli_epi64(sum, 32)));
+
+			even = _mm256_shuffle_epi32(_mm256_srli_epi64(even, FixedShift), _MM_SHUFFLE(2, 2, 2, 0));
+			odd = _mm256_shuffle_epi32(_mm256_srli_epi64(odd, FixedShift), _MM_SHUFFLE(2, 2, 2, 0));
+			_mm256_storeu_si256((__m256i*)(out + j), _mm256_unpacklo_epi32(even, odd));
+		}
+#elif defined(WAVES_KERNEL_SSE2)
+		// SSE2 only has an unsigned 32x32->64 multiply.  With h' = h + 2^31 (a flipped
+		// sign bit) and k = s*|k|, k*h = s*|k|*h' - k*2^31, so the products are taken
+		// unsigned, negated where k < 0, and the 2^31 terms folded into the rounding
+		// constant.  All of it is exact modulo 2^64.
+		const __m128i signBit = _mm_set1_epi32((int)0x80000000u);
+		const __m128i vk1 = _mm_set1_epi32(k1 < 0 ? -k1 : k1);
+		const __m128i vk2 = _mm_set1_epi32(k2 < 0 ? -k2 : k2);
+		const __m128i vk3 = _mm_set1_epi32(k3 < 0 ? -k3 : k3);
+		const __m128i neg1 = _mm_set1_epi32(k1 < 0 ? -1 : 0);
+		const __m128i neg2 = _mm_set1_epi32(k2 < 0 ? -1 : 0);
+		const __m128i neg3 = _mm_set1_epi32(k3 < 0 ? -1 : 0);
+		const std::uint64_t bias = (std::uint64_t)half -
+			((std::uint64_t)((std::int64_t)k1 + k2 + k3) << 31);
+		const __m128i vbias = _mm_set1_epi64x((long long)bias);
+		for(; j + 4 <= count; j += 4)
+		{
+			__m128i sum = _mm_add_epi32(
+				_mm_add_epi32(_mm_loadu_si128((const __m128i*)(down + j)), _mm_loadu_si128((const __m128i*)(up + j))),
+				_mm_add_epi32(_mm_loadu_si128((const __m128i*)(mid + j + 1)), _mm_loadu_si128((const __m128i*)(mid + j - 1))));
+			__m128i p = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(prev + j)), signBit);
+			__m128i c = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(mid + j)), signBit);
+			sum = _mm_xor_si128(sum, signBit);
+
+			// (x ^ neg) - neg negates x where neg is all ones.
+			__m128i even = vbias;
+			even = _mm_add_epi64(even, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk1, p), neg1), neg1));
+			even = _mm_add_epi64(even, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk2, c), neg2), neg2));
+			even = _mm_add_epi64(even, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk3, sum), neg3), neg3));
+
+			p = _mm_srli_epi64(p, 32);
+			c = _mm_srli_epi64(c, 32);
+			sum = _mm_srli_epi64(sum, 32);
+
+			__m128i odd = vbias;
+			odd = _mm_add_epi64(odd, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk1, p), neg1), neg1));
+			odd = _mm_add_epi64(odd, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk2, c), neg2), neg2));
+			odd = _mm_add_epi64(odd, _mm_sub_epi64(_mm_xor_si128(_mm_mul_epu32(vk3, sum), neg3), neg3));
+
+			even = _mm_shuffle_epi32(_mm_srli_epi64(even, FixedShift), _MM_SHUFFLE(2, 2, 2, 0));
+			odd = _mm_shuffle_epi32(_mm_srli_epi64(odd, FixedShift), _MM_SHUFFLE(2, 2, 2, 0));
+			_mm_storeu_si128((__m128i*)(out + j), _mm_unpacklo_epi32(even, odd));
+		}
+#endif
+
+		for(; j < count; ++j)
+		{
+			std::int32_t sum = (std::int32_t)((std::uint32_t)down[j] + (std::uint32_t)up[j] +
+				(std::uint32_t)mid[j+1] + (std::uint32_t)mid[j-1]);
+
+			std::int64_t h = (std::int64_t)k1*prev[j] + (std::int64_t)k2*mid[j] + (std::int64_t)k3*sum + half;
+			out[j] = (std::int32_t)(h >> FixedShift);
+		}
+	}
+
+	// Finite difference normal: normalize(l - r, 2*dx, b - t).  The vector paths scale
+	// by rsqrt refined with one Newton-Raphson step (~22 bits) instead of a sqrt and
+	// three divides.  The last partial vector goes through the same code on a padded
+	// copy, so a point's normal does not depend on where a tile boundary falls.
+	// Normals never feed back into the simulation, so this may differ from the
+	// scalar build in the last bits.
+	inline void NormalRow(float* nx, float* ny, float* nz, const float* up, const float* mid, const float* down,
+		int count, float twoDx)
+	{
+#if defined(WAVES_KERNEL_AVX2)
+		const int width = 8;
+		const __m256 vy = _mm256_set1_ps(twoDx);
+		const __m256 vyy = _mm256_mul_ps(vy, vy);
+		const __m256 vhalf = _mm256_set1_ps(0.5f);
+		const __m256 vthreeHalves = _mm256_set1_ps(1.5f);
+
+		auto block = [&](float* ox, float* oy, float* oz, const float* u, const float* m, const float* d)
+		{
+			__m256 x = _mm256_sub_ps(_mm256_loadu_ps(m - 1), _mm256_loadu_ps(m + 1));
+			__m256 z = _mm256_sub_ps(_mm256_loadu_ps(d), _mm256_loadu_ps(u));
+
+			__m256 lenSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), vyy), _mm256_mul_ps(z, z));
+
+			// r' = r*(1.5 - 0.5*lenSq*r*r)
+			__m256 r = _mm256_rsqrt_ps(lenSq);
+			__m256 hr = _mm256_mul_ps(_mm256_mul_ps(vhalf, lenSq), r);
+			r = _mm256_mul_ps(r, _mm256_sub_ps(vthreeHalves, _mm256_mul_ps(hr, r)));
+
+			_mm256_storeu_ps(ox, _mm256_mul_ps(x, r));
+			_mm256_storeu_ps(oy, _mm256_mul_ps(vy, r));
+			_mm256_storeu_ps(oz, _mm256_mul_ps(z, r));
+		};
+#elif defined(WAVES_KERNEL_SSE2)
+		const int width = 4;
+		const __m128 vy = _mm_set1_ps(twoDx);
+		const __m128 vyy = _mm_mul_ps(vy, vy);
+		const __m128 vhalf = _mm_set1_ps(0.5f);
+		const __m128 vthreeHalves = _mm_set1_ps(1.5f);
+
+		auto block = [&](float* ox, float* oy, float* oz, const float* u, const float* m, const float* d)
+		{
+			__m128 x = _mm_sub_ps(_mm_loadu_ps(m - 1), _mm_loadu_ps(m + 1));
+			__m128 z = _mm_sub_ps(_mm_loadu_ps(d), _mm_loadu_ps(u));
+
+			__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), vyy), _mm_mul_ps(z, z));
+
+			// r' = r*(1.5 - 0.5*lenSq*r*r)
+			__m128 r = _mm_rsqrt_ps(lenSq);
+			__m128 hr = _mm_mul_ps(_mm_mul_ps(vhalf, lenSq), r);
+			r = _mm_mul_ps(r, _mm_sub_ps(vthreeHalves, _mm_mul_ps(hr, r)));
+
+			_mm_storeu_ps(ox, _mm_mul_ps(x, r));
+			_mm_storeu_ps(oy, _mm_mul_ps(vy, r));
+			_mm_storeu_ps(oz, _mm_mul_ps(z, r));
+		};
+#endif
+
+#if defined(WAVES_KERNEL_AVX2) || defined(WAVES_KERNEL_SSE2)
+		int j = 0;
+		for(; j + width <= count; j += width)
+			block(nx + j, ny + j, nz + j, up + j, mid + j, down + j);
+
+		if(j < count)
+		{
+			// Zero padding still gives lenSq >= twoDx^2 > 0.
+			const int rest = count - j;
+			float u[8] = {}, m[10] = {}, d[8] = {}, ox[8], oy[8], oz[8];
+			for(int k = 0; k < rest; ++k)
+			{
+				u[k] = up[j + k];
+				d[k] = down[j + k];
+			}
+			for(int k = 0; k < rest + 2; ++k)
+				m[k] = mid[j - 1 + k];
+
+			block(ox, oy, oz, u, m + 1, d);
+
+			std::copy_n(ox, rest, nx + j);
+			std::copy_n(oy, rest, ny + j);
+			std::copy_n(oz, rest, nz + j);
+		}
+#else
+		for(int j = 0; j < count; ++j)
+		{
+			float x = mid[j-1] - mid[j+1];
+			float z = down[j] - up[j];
+
+			float len = sqrtf(x*x + twoDx*twoDx + z*z);
+
+			nx[j] = x / len;
+			ny[j] = twoDx / len;
+			nz[j] = z / len;
+		}
+#endif
+	}
+}
+
+#endif // WAVEKERNELS_H
@@ -3,12 +3,237 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include "WaveKernels.h"
 
 using namespace DirectX;
+using namespace WaveKernels;
+
+WaveGridLayout BuildWaveGridLayout(int m, int n, float dx)
+{
+	const float halfWidth = (n - 1)*dx*0.5f;
+	const float halfDepth = (m - 1)*dx*0.5f;
+
+	WaveGridLayout layout;
+	layout.RowCount = m;
+	layout.ColumnCount = n;
+	layout.SpatialStep = dx;
+	layout.X.resize(n);
+	layout.U.resize(n);
+	layout.Z.resize(m);
+	layout.V.resize(m);
+
+	// Map [-w/2,w/2] --> [0,1].
+	for(int j = 0; j < n; ++j)
+	{
+		layout.X[j] = -halfWidth + j*dx;
+		layout.U[j] = 0.5f + layout.X[j] / (n*dx);
+	}
+
+	for(int i = 0; i < m; ++i)
+	{
+		layout.Z[i] = halfDepth - i*dx;
+		layout.V[i] = 0.5f - layout.Z[i] / (m*dx);
+	}
+
+	return layout;
+}
+
+void WriteWaveVertices(const WaveGridLayout& layout, const float* heights,
+	const float* normalX, const float* normalY, const float* normalZ,
+	int rowBegin, int rowEnd, WaveVertex* dst)
+{
+	const int n = layout.ColumnCount;
+
+	for(int i = rowBegin; i < rowEnd; ++i)
+	{
+		const int row = i*n;
+		const float z = layout.Z[i];
+		const float v = layout.V[i];
+
+		for(int j = 0; j < n; ++j)
+		{
+			// Build the whole vertex first so it goes out as one sequential store.
+			WaveVertex vertex;
+			vertex.Pos = DirectX::XMFLOAT3(layout.X[j], heights[row + j], z);
+			vertex.Normal = DirectX::XMFLOAT3(normalX[row + j], normalY[row + j], normalZ[row + j]);
+			vertex.TexC = DirectX::XMFLOAT2(layout.U[j], v);
+
+			dst[row + j] = vertex;
+		}
+	}
+}
+
+namespace
+{
+	float SignNotZero(float x)
+	{
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	std::uint32_t PackSnorm16(float x)
+	{
+		x = std::min(std::max(x, -1.0f), 1.0f);
+		return (std::uint16_t)(std::int16_t)std::lrint(x*32767.0f);
+	}
+
+	float UnpackSnorm16(std::uint32_t bits)
+	{
+		return std::max((std::int16_t)(std::uint16_t)bits / 32767.0f, -1.0f);
+	}
+}
+
+std::uint32_t EncodeWaveNormal(float x, float y, float z)
+{
+	// Project onto the octahedron |x|+|y|+|z| = 1, then fold the lower half (y < 0)
+	// out over the corners so the xz-plane alone identifies the direction.  Water
+	// normals point mostly up, which keeps them away from the fold.
+	float invL1 = 1.0f / (std::fabs(x) + std::fabs(y) + std::fabs(z));
+	float u = x*invL1;
+	float v = z*invL1;
+
+	if(y < 0.0f)
+	{
+		float foldedU = (1.0f - std::fabs(v))*SignNotZero(u);
+		float foldedV = (1.0f - std::fabs(u))*SignNotZero(v);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	return PackSnorm16(u) | (PackSnorm16(v) << 16);
+}
+
+DirectX::XMFLOAT3 DecodeWaveNormal(std::uint32_t packed)
+{
+	float u = UnpackSnorm16(packed & 0xffff);
+	float v = UnpackSnorm16(packed >> 16);
+
+	float x = u;
+	float y = 1.0f - std::fabs(u) - std::fabs(v);
+	float z = v;
+
+	if(y < 0.0f)
+	{
+		x = (1.0f - std::fabs(v))*SignNotZero(u);
+		z = (1.0f - std::fabs(u))*SignNotZero(v);
+	}
+
+	float invLength = 1.0f / std::sqrt(x*x + y*y + z*z);
+	return DirectX::XMFLOAT3(x*invLength, y*invLength, z*invLength);
+}
+
+void WriteWaveCompactVertices(const float* heights,
+	const float* normalX, const float* normalY, const float* normalZ,
+	int begin, int end, WaveCompactVertex* dst)
+{
+	for(int i = begin; i < end; ++i)
+	{
+		WaveCompactVertex vertex;
+		vertex.Height = heights[i];
+		vertex.Normal = EncodeWaveNormal(normalX[i], normalY[i], normalZ[i]);
+
+		dst[i] = vertex;
+	}
+}
+
+void WriteWaveStaticVertices(const WaveGridLayout& layout, WaveStaticVertex* dst)
+{
+	const int n = layout.ColumnCount;
+
+	for(int i = 0; i < layout.RowCount; ++i)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			WaveStaticVertex& vertex = dst[i*n + j];
+			vertex.PosXZ = DirectX::XMFLOAT2(layout.X[j], layout.Z[i]);
+			vertex.TexC = DirectX::XMFLOAT2(layout.U[j], layout.V[i]);
+		}
+	}
+}
+
+namespace
+{
+	bool ComputeTap(const WaveGridLayout& layout, float invDx, float x, float z, WaveBilinearTap& tap)
+	{
+		const int rows = layout.RowCount;
+		const int cols = layout.ColumnCount;
+
+		// Grid coordinates; rows run along -z.
+		const float fx = (x - layout.X[0])*invDx;
+		const float fz = (layout.Z[0] - z)*invDx;
+
+		// Written so that NaNs fail too.
+		if(!(fx >= 0.0f && fz >= 0.0f && fx <= cols - 1 && fz <= rows - 1))
+			return false;
+
+		// The last row/column uses the cell before it with a weight of 1.
+		const int c0 = std::min((int)fx, cols - 2);
+		const int r0 = std::min((int)fz, rows - 2);
+		const float tx = fx - c0;
+		const float tz = fz - r0;
+
+		tap.Index = r0*cols + c0;
+		tap.W00 = (1.0f - tx)*(1.0f - tz);
+		tap.W01 = tx*(1.0f - tz);
+		tap.W10 = (1.0f - tx)*tz;
+		tap.W11 = tx*tz;
+		return true;
+	}
+
+	float Blend(const float* v, int cols, const WaveBilinearTap& tap)
+	{
+		const int k = tap.Index;
+		return tap.W00*v[k] + tap.W01*v[k + 1] + tap.W10*v[k + cols] + tap.W11*v[k + cols + 1];
+	}
+}
+
+bool ComputeWaveBilinearTap(const WaveGridLayout& layout, float x, float z, WaveBilinearTap& tap)
+{
+	return ComputeTap(layout, 1.0f / layout.SpatialStep, x, z, tap);
+}
+
+float SampleWaveHeight(const WaveGridLayout& layout, const float* heights, float x, float z)
+{
+	WaveBilinearTap tap;
+	if(!ComputeWaveBilinearTap(layout, x, z, tap))
+		return 0.0f;
+
+	return Blend(heights, layout.ColumnCount, tap);
+}
+
+DirectX::XMFLOAT3 SampleWaveNormal(const WaveGridLayout& layout,
+	const float* normalX, const float* normalY, const float* normalZ, float x, float z)
+{
+	WaveBilinearTap tap;
+	if(!ComputeWaveBilinearTap(layout, x, z, tap))
+		return DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+
+	const int cols = layout.ColumnCount;
+	const float nx = Blend(normalX, cols, tap);
+	const float ny = Blend(normalY, cols, tap);
+	const float nz = Blend(normalZ, cols, tap);
+
+	// Every grid normal has y > 0, so the blend cannot vanish.
+	const float invLength = 1.0f / std::sqrt(nx*nx + ny*ny + nz*nz);
+	return DirectX::XMFLOAT3(nx*invLength, ny*invLength, nz*invLength);
+}
+
+void SampleWaveHeights(const WaveGridLayout& layout, const float* heights,
+	const DirectX::XMFLOAT2* xz, int count, float* out)
+{
+	const float invDx = 1.0f / layout.SpatialStep;
+	const int cols = layout.ColumnCount;
+
+	for(int k = 0; k < count; ++k)
+	{
+		WaveBilinearTap tap;
+		out[k] = ComputeTap(layout, invDx, xz[k].x, xz[k].y, tap) ? Blend(heights, cols, tap) : 0.0f;
+	}
+}
 
 Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
 {
@@ -27,28 +252,25 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    // k1 + k2 + 4*k3 == 1 (a flat, still surface stays put); derive k2 so the
+    // quantized constants keep that exactly.
+    mK1Fixed = ToFixed(mK1);
+    mK3Fixed = ToFixed(mK3);
+    mK2Fixed = (1 << FixedShift) - mK1Fixed - 4*mK3Fixed;
 
-    // Generate grid vertices in system memory.
+    // Grid vertices are not stored; x/z and the texture coordinates only depend on
+    // the column/row, so they are computed here once.
+    mLayout = BuildWaveGridLayout(m, n, dx);
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
+    mPrevHeights.assign(m*n, 0.0f);
+    mCurrHeights.assign(m*n, 0.0f);
+    mNormalX.assign(m*n, 0.0f);
+    mNormalY.assign(m*n, 1.0f);
+    mNormalZ.assign(m*n, 0.0f);
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    mNormalTilesDown = (m - 2 + NormalTileSize - 1) / NormalTileSize;
+    mNormalTilesAcross = (n - 2 + NormalTileSize - 1) / NormalTileSize;
+    mNormalDirty.assign(mNormalTilesDown*mNormalTilesAcross, 0);
 }
 
 Waves::~Waves()
@@ -75,6 +297,18 @@ int Waves::TriangleCount()const
 	return mTriangleCount;
 }
 
+void Waves::WriteVertices(WaveVertex* dst)const
+{
+	WriteWaveVertices(mLayout, mCurrHeights.data(), mNormalX.data(), mNormalY.data(), mNormalZ.data(),
+		0, mNumRows, dst);
+}
+
+void Waves::WriteCompactVertices(WaveCompactVertex* dst)const
+{
+	WriteWaveCompactVertices(mCurrHeights.data(), mNormalX.data(), mNormalY.data(), mNormalZ.data(),
+		0, mVertexCount, dst);
+}
+
 float Waves::Width()const
 {
 	return mNumCols*mSpatialStep;
@@ -85,72 +319,601 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	// The normal is proportional to (l-r, 2dx, b-t) and the tangent to (2dx, r-l, 0),
+	// so the tangent is (n.y, -n.x, 0) renormalized.
+	float tx = mNormalY[i];
+	float ty = -mNormalX[i];
+	float len = sqrtf(tx*tx + ty*ty);
+
+	return XMFLOAT3(tx / len, ty / len, 0.0f);
+}
+
+void Waves::Capture(WaveSnapshot& snapshot)const
 {
-	static float t = 0;
+	snapshot.Layout = &mLayout;
 
+	snapshot.Heights.assign(mCurrHeights.begin(), mCurrHeights.end());
+	snapshot.NormalX.assign(mNormalX.begin(), mNormalX.end());
+	snapshot.NormalY.assign(mNormalY.begin(), mNormalY.end());
+	snapshot.NormalZ.assign(mNormalZ.begin(), mNormalZ.end());
+}
+
+const char* Waves::KernelName()
+{
+#if defined(WAVES_KERNEL_AVX2)
+	return "avx2";
+#elif defined(WAVES_KERNEL_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+void Waves::SetScheduler(TaskScheduler* scheduler)
+{
+	mScheduler = scheduler ? scheduler : &mSerialScheduler;
+}
+
+void Waves::SetTileSize(int tileRows, int tileCols)
+{
+	mTileRows = std::max(tileRows, 1);
+	mTileCols = tileCols;
+}
+
+void Waves::SetSolverMode(WaveSolverMode mode, int temporalBlockSize)
+{
+	if(mode == WaveSolverMode::FixedPoint && mSolverMode != WaveSolverMode::FixedPoint)
+	{
+		mPrevFixed.resize(mPrevHeights.size());
+		mCurrFixed.resize(mCurrHeights.size());
+		for(size_t k = 0; k < mCurrHeights.size(); ++k)
+		{
+			mPrevFixed[k] = ToFixed(mPrevHeights[k]);
+			mCurrFixed[k] = ToFixed(mCurrHeights[k]);
+			mCurrHeights[k] = FromFixed(mCurrFixed[k]);
+		}
+	}
+	else if(mode != WaveSolverMode::FixedPoint && mSolverMode == WaveSolverMode::FixedPoint)
+	{
+		for(size_t k = 0; k < mCurrHeights.size(); ++k)
+			mPrevHeights[k] = FromFixed(mPrevFixed[k]);
+	}
+
+	mSolverMode = mode;
+	mTemporalBlockSize = std::max(temporalBlockSize, 1);
+}
+
+void Waves::SetMaxSubsteps(int maxSubsteps, WaveOverloadPolicy policy)
+{
+	mMaxSubsteps = std::max(maxSubsteps, 1);
+	mOverloadPolicy = policy;
+}
+
+void Waves::Update(float dt)
+{
 	// Accumulate time.
-	t += dt;
+	mTimeAccumulator += dt;
+
+	// Only update the simulation at the specified time step, but take every
+	// step the accumulated time pays for so the speed is frame-rate independent.
+	int stepCount = (int)(mTimeAccumulator / mTimeStep);
+	if(stepCount > mMaxSubsteps)
+		stepCount = mMaxSubsteps;
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	mTimeAccumulator -= stepCount*mTimeStep;
+
+	if(mOverloadPolicy == WaveOverloadPolicy::DropExcess)
+		mTimeAccumulator = std::fmod(mTimeAccumulator, mTimeStep);
+	else
+		mTimeAccumulator = std::min(mTimeAccumulator, mMaxSubsteps*mTimeStep);
+
+	mLastSubstepCount = stepCount;
+
+	Step(stepCount);
+}
+
+void Waves::Step(int stepCount)
+{
+	if(stepCount <= 0)
+		return;
+
+	if(mSolverMode == WaveSolverMode::Fused)
+	{
+		// The fused sweeps touch every row, so every tile ends up live.
+		if(mSleepThreshold > 0.0f)
+			WakeAllTiles();
+
+		// Normals only matter for the final state, so only the last sweep makes them.
+		while(stepCount > 0)
+		{
+			int sweepSteps = std::min(stepCount, mTemporalBlockSize);
+			stepCount -= sweepSteps;
+
+			FusedSweep(sweepSteps, stepCount == 0 && !mLazyNormals);
+		}
+
+		MarkAllNormalsDirty();
+		return;
+	}
+
+	if(mSolverMode == WaveSolverMode::FixedPoint)
+	{
+		if(mSleepThreshold > 0.0f)
+			WakeAllTiles();
+
+		StepFixed(stepCount);
+		return;
+	}
+
+	if(mSleepThreshold > 0.0f)
+	{
+		StepSparse(stepCount);
+		return;
+	}
+
+	for(int s = 0; s < stepCount; ++s)
 	{
 		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
-		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
+		mScheduler->ParallelFor2D(1, mNumRows - 1, 1, mNumCols - 1, mTileRows, mTileCols,
+			[this](const TileRange2D& tile)
+		{
+			SolveTile(tile);
 		});
 
 		// We just overwrote the previous buffer with the new data, so
 		// this data needs to become the current solution and the old
 		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
-
-		t = 0.0f; // reset time
-
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
-		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
+		std::swap(mPrevHeights, mCurrHeights);
+	}
+
+	if(mLazyNormals)
+	{
+		MarkAllNormalsDirty();
+		return;
+	}
+
+	//
+	// Compute normals using finite difference scheme.
+	//
+	mScheduler->ParallelFor2D(1, mNumRows - 1, 1, mNumCols - 1, mTileRows, mTileCols,
+		[this](const TileRange2D& tile)
+	{
+		ComputeNormalTile(tile);
+	});
+}
+
+void Waves::SolveTile(const TileRange2D& tile)
+{
+	const int n = mNumCols;
+	const int count = tile.ColEnd - tile.ColBegin;
+
+	for(int i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element)
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to
+		// keep consistent with our row indices going down.
+		float* prev = &mPrevHeights[i*n + tile.ColBegin];
+		const float* curr = &mCurrHeights[i*n + tile.ColBegin];
+
+		StepRow(prev, prev, curr - n, curr, curr + n, count, mK1, mK2, mK3);
+	}
+}
+
+void Waves::StepFixed(int stepCount)
+{
+	// Every point only reads the previous two solutions, so how the grid is tiled
+	// and which thread gets which tile cannot change the result.
+	for(int s = 0; s < stepCount; ++s)
+	{
+		mScheduler->ParallelFor2D(1, mNumRows - 1, 1, mNumCols - 1, mTileRows, mTileCols,
+			[this](const TileRange2D& tile)
+		{
+			SolveTileFixed(tile);
+		});
+
+		std::swap(mPrevFixed, mCurrFixed);
+	}
+
+	// The normals and everything downstream read the float copy.  It must be
+	// complete before the normal pass reads a tile's neighbouring rows.
+	const int n = mNumCols;
+	mScheduler->ParallelFor(1, mNumRows - 1, mTileRows, [=](int firstRow, int lastRow)
+	{
+		for(int i = firstRow; i < lastRow; ++i)
+		{
+			for(int j = 1; j < n - 1; ++j)
+				mCurrHeights[i*n + j] = FromFixed(mCurrFixed[i*n + j]);
+		}
+	});
+
+	if(mLazyNormals)
+	{
+		MarkAllNormalsDirty();
+		return;
+	}
+
+	mScheduler->ParallelFor2D(1, mNumRows - 1, 1, mNumCols - 1, mTileRows, mTileCols,
+		[this](const TileRange2D& tile)
+	{
+		ComputeNormalTile(tile);
+	});
+}
+
+void Waves::SolveTileFixed(const TileRange2D& tile)
+{
+	const int n = mNumCols;
+	const int count = tile.ColEnd - tile.ColBegin;
+
+	for(int i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		std::int32_t* prev = &mPrevFixed[i*n + tile.ColBegin];
+		const std::int32_t* curr = &mCurrFixed[i*n + tile.ColBegin];
+
+		StepRowFixed(prev, prev, curr - n, curr, curr + n, count, mK1Fixed, mK2Fixed, mK3Fixed);
+	}
+}
+
+void Waves::ComputeNormalTile(const TileRange2D& tile)
+{
+	const int n = mNumCols;
+	const int count = tile.ColEnd - tile.ColBegin;
+
+	for(int i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		const int k = i*n + tile.ColBegin;
+		const float* curr = &mCurrHeights[k];
+
+		NormalRow(&mNormalX[k], &mNormalY[k], &mNormalZ[k],
+			curr - n, curr, curr + n, count, 2.0f*mSpatialStep);
+	}
+}
+
+void Waves::FusedSweep(int stepCount, bool computeNormals)
+{
+	mNextCurrHeights.resize(mCurrHeights.size());
+	if(stepCount > 1)
+		mNextPrevHeights.resize(mPrevHeights.size());
+
+	// Every band recomputes stepCount+1 halo rows on each side, so keep bands at
+	// least a few halos tall or the redundant work swamps the cache savings.
+	const int bandRows = std::max(mTileRows, 4*(stepCount + 1));
+
+	// Bands partition every row, boundary rows included, so the mNext* buffers are
+	// completely rewritten.
+	const int bandCount = (mNumRows + bandRows - 1) / bandRows;
+	mScheduler->ParallelFor(0, bandCount, 1, [=](int firstBand, int lastBand)
+	{
+		for(int b = firstBand; b < lastBand; ++b)
+		{
+			int rowBegin = b*bandRows;
+			int rowEnd = std::min(rowBegin + bandRows, mNumRows);
+
+			FusedBand(rowBegin, rowEnd, stepCount, computeNormals);
+		}
+	});
+
+	if(stepCount > 1)
+	{
+		std::swap(mPrevHeights, mNextPrevHeights);
+		std::swap(mCurrHeights, mNextCurrHeights);
+	}
+	else
+	{
+		// After a single step the new previous solution is just the old current one,
+		// so rotate the buffers instead of copying it.
+		std::swap(mPrevHeights, mCurrHeights);
+		std::swap(mCurrHeights, mNextCurrHeights);
+	}
+}
+
+void Waves::FusedBand(int rowBegin, int rowEnd, int stepCount, bool computeNormals)
+{
+	const int m = mNumRows;
+	const int n = mNumCols;
+
+	// Each step shrinks the rows we can trust by one on either side, and the normals
+	// of the band's edge rows need one more row beyond that.  Rows 0 and m-1 are
+	// fixed boundary conditions and stay valid for free.
+	const int halo = stepCount + 1;
+	const int first = std::max(rowBegin - halo, 0);
+	const int last = std::min(rowEnd + halo, m);
+	const int rows = last - first;
+
+	// Two scratch planes hold the intermediate solutions.  The first two steps read
+	// straight from the shared buffers, so nothing is copied in up front.
+	thread_local std::vector<float> scratch;
+	scratch.resize(2*(size_t)rows*n);
+
+	float* planes[2] = { scratch.data(), scratch.data() + (size_t)rows*n };
+
+	// The stencil reads, but never writes, the boundary columns and rows; give the
+	// scratch planes the same values the shared buffers hold there.
+	for(int p = 0; p < 2; ++p)
+	{
+		for(int r = 0; r < rows; ++r)
+		{
+			planes[p][(size_t)r*n] = mCurrHeights[(size_t)(first + r)*n];
+			planes[p][(size_t)r*n + n - 1] = mCurrHeights[(size_t)(first + r)*n + n - 1];
+		}
+		if(first == 0)
+			std::copy_n(&mCurrHeights[0], n, planes[p]);
+		if(last == m)
+			std::copy_n(&mCurrHeights[(size_t)(m - 1)*n], n, planes[p] + (size_t)(m - 1 - first)*n);
+	}
+
+	// Solutions h(s-2) and h(s-1) as (plane, first row stored in that plane).
+	float* olderPlane = mPrevHeights.data();
+	int olderBias = 0;
+	float* newerPlane = mCurrHeights.data();
+	int newerBias = 0;
+
+	for(int s = 1; s <= stepCount; ++s)
+	{
+		// h(s) overwrites h(s-2) in place once that lives in scratch; the first two
+		// steps must not touch the shared buffers, which other bands still read.
+		float* outPlane = (s <= 2) ? planes[s - 1] : olderPlane;
+
+		int lo = (first == 0) ? 1 : first + s;
+		int hi = (last == m) ? m - 1 : last - s;
+
+		for(int i = lo; i < hi; ++i)
+		{
+			float* out = outPlane + (size_t)(i - first)*n + 1;
+			const float* prev = olderPlane + (size_t)(i - olderBias)*n + 1;
+			const float* curr = newerPlane + (size_t)(i - newerBias)*n + 1;
+
+			StepRow(out, prev, curr - n, curr, curr + n, n - 2, mK1, mK2, mK3);
+		}
+
+		olderPlane = newerPlane;
+		olderBias = newerBias;
+		newerPlane = outPlane;
+		newerBias = first;
+	}
+
+	// Write back the band itself; its halo rows belong to the neighbouring bands.
+	const size_t bandSize = (size_t)(rowEnd - rowBegin)*n;
+	const float* newest = newerPlane + (size_t)(rowBegin - newerBias)*n;
+	std::copy(newest, newest + bandSize, mNextCurrHeights.begin() + (size_t)rowBegin*n);
+	if(stepCount > 1)
+	{
+		const float* older = olderPlane + (size_t)(rowBegin - olderBias)*n;
+		std::copy(older, older + bandSize, mNextPrevHeights.begin() + (size_t)rowBegin*n);
+	}
+
+	if(computeNormals)
+	{
+		for(int i = std::max(rowBegin, 1); i < std::min(rowEnd, m - 1); ++i)
+		{
+			const size_t k = (size_t)i*n + 1;
+			const float* curr = newerPlane + (size_t)(i - newerBias)*n + 1;
+
+			NormalRow(&mNormalX[k], &mNormalY[k], &mNormalZ[k], curr - n, curr, curr + n, n - 2, 2.0f*mSpatialStep);
+		}
+	}
+}
+
+void Waves::SetSleepThreshold(float threshold, int tileSize)
+{
+	mSleepThreshold = threshold;
+	mSleepTileSize = std::max(tileSize, 1);
+
+	if(mSleepThreshold <= 0.0f)
+	{
+		mActivityStats = WaveActivityStats();
+		return;
+	}
+
+	mSleepTilesDown = (mNumRows - 2 + mSleepTileSize - 1) / mSleepTileSize;
+	mSleepTilesAcross = (mNumCols - 2 + mSleepTileSize - 1) / mSleepTileSize;
+
+	const int tileCount = mSleepTilesDown*mSleepTilesAcross;
+	mTileStaysAwake.assign(tileCount, 0);
+	mTileActivity.assign(tileCount, TileActivity());
+
+	// Nothing is known about the current solution yet; tiles that turn out to be
+	// quiet drop off after the first step.
+	WakeAllTiles();
+
+	mActivityStats = WaveActivityStats();
+	mActivityStats.TileCount = tileCount;
+	mActivityStats.ActiveTileCount = tileCount;
+}
+
+void Waves::StepSparse(int stepCount)
+{
+	const int tileCount = mSleepTilesDown*mSleepTilesAcross;
+
+	mActivityStats.TileStepsSolved = 0;
+	mActivityStats.TileStepsSkipped = 0;
+
+	for(int s = 0; s < stepCount; ++s)
+	{
+		mActiveTiles.clear();
+		for(int t = 0; t < tileCount; ++t)
+		{
+			if(mTileAwake[t])
+				mActiveTiles.push_back(t);
+		}
+
+		mScheduler->ParallelFor(0, (int)mActiveTiles.size(), 1, [this](int first, int last)
+		{
+			for(int k = first; k < last; ++k)
+				SolveSleepTile(mActiveTiles[k]);
 		});
+
+		// Sleeping tiles are all zero in both buffers, so swapping them is harmless.
+		std::swap(mPrevHeights, mCurrHeights);
+
+		for(int t : mActiveTiles)
+		{
+			const TileRange2D range = SleepTileRange(t);
+			MarkNormalsDirty(range.RowBegin, range.RowEnd, range.ColBegin, range.ColEnd);
+		}
+
+		UpdateSleepStates();
+
+		mActivityStats.TileStepsSolved += (int)mActiveTiles.size();
+		mActivityStats.TileStepsSkipped += tileCount - (int)mActiveTiles.size();
+	}
+
+	mActiveTiles.clear();
+	for(int t = 0; t < tileCount; ++t)
+	{
+		if(mTileAwake[t])
+			mActiveTiles.push_back(t);
+	}
+
+	// Tiles that went to sleep had their normals reset to straight up already.
+	if(!mLazyNormals)
+	{
+		mScheduler->ParallelFor(0, (int)mActiveTiles.size(), 1, [this](int first, int last)
+		{
+			for(int k = first; k < last; ++k)
+				ComputeNormalTile(SleepTileRange(mActiveTiles[k]));
+		});
+	}
+
+	mActivityStats.TileCount = tileCount;
+	mActivityStats.ActiveTileCount = (int)mActiveTiles.size();
+	mActivityStats.ActiveTileRatio = tileCount > 0 ? (float)mActiveTiles.size() / tileCount : 0.0f;
+}
+
+TileRange2D Waves::SleepTileRange(int tile)const
+{
+	const int ty = tile / mSleepTilesAcross;
+	const int tx = tile - ty*mSleepTilesAcross;
+
+	TileRange2D range;
+	range.RowBegin = 1 + ty*mSleepTileSize;
+	range.RowEnd = std::min(range.RowBegin + mSleepTileSize, mNumRows - 1);
+	range.ColBegin = 1 + tx*mSleepTileSize;
+	range.ColEnd = std::min(range.ColBegin + mSleepTileSize, mNumCols - 1);
+	return range;
+}
+
+void Waves::SolveSleepTile(int tile)
+{
+	const TileRange2D range = SleepTileRange(tile);
+	const int n = mNumCols;
+	const int count = range.ColEnd - range.ColBegin;
+
+	TileActivity activity;
+
+	for(int i = range.RowBegin; i < range.RowEnd; ++i)
+	{
+		float* prev = &mPrevHeights[i*n + range.ColBegin];
+		const float* curr = &mCurrHeights[i*n + range.ColBegin];
+
+		StepRow(prev, prev, curr - n, curr, curr + n, count, mK1, mK2, mK3);
+
+		// prev now holds the new solution; measure it against the one it replaces.
+		float rowMax = 0.0f;
+		for(int j = 0; j < count; ++j)
+			rowMax = std::max(rowMax, std::max(std::fabs(prev[j]), std::fabs(prev[j] - curr[j])));
+
+		activity.Max = std::max(activity.Max, rowMax);
+		activity.Left = std::max(activity.Left, std::max(std::fabs(prev[0]), std::fabs(prev[0] - curr[0])));
+		activity.Right = std::max(activity.Right,
+			std::max(std::fabs(prev[count - 1]), std::fabs(prev[count - 1] - curr[count - 1])));
+
+		if(i == range.RowBegin)
+			activity.Top = rowMax;
+		if(i == range.RowEnd - 1)
+			activity.Bottom = rowMax;
+	}
+
+	mTileActivity[tile] = activity;
+}
+
+void Waves::UpdateSleepStates()
+{
+	const float threshold = mSleepThreshold;
+
+	// A tile stays awake while it is itself active, and wakes a neighbour when the
+	// edge they share is.  Decide everything before zeroing anything.
+	std::fill(mTileStaysAwake.begin(), mTileStaysAwake.end(), (std::uint8_t)0);
+
+	for(int t : mActiveTiles)
+	{
+		const TileActivity& a = mTileActivity[t];
+		const int ty = t / mSleepTilesAcross;
+		const int tx = t - ty*mSleepTilesAcross;
+
+		if(a.Max >= threshold)
+			mTileStaysAwake[t] = 1;
+		if(a.Top >= threshold && ty > 0)
+			mTileStaysAwake[t - mSleepTilesAcross] = 1;
+		if(a.Bottom >= threshold && ty < mSleepTilesDown - 1)
+			mTileStaysAwake[t + mSleepTilesAcross] = 1;
+		if(a.Left >= threshold && tx > 0)
+			mTileStaysAwake[t - 1] = 1;
+		if(a.Right >= threshold && tx < mSleepTilesAcross - 1)
+			mTileStaysAwake[t + 1] = 1;
+	}
+
+	for(int t : mActiveTiles)
+	{
+		if(!mTileStaysAwake[t])
+			PutTileToSleep(t);
+	}
+
+	// Sleeping tiles only get here through a neighbour, so this is the new state.
+	std::swap(mTileAwake, mTileStaysAwake);
+}
+
+void Waves::PutTileToSleep(int tile)
+{
+	const TileRange2D range = SleepTileRange(tile);
+	const int n = mNumCols;
+	const int count = range.ColEnd - range.ColBegin;
+
+	// Whatever is left is below the threshold; flatten it so the tile can be
+	// skipped without the two buffers drifting apart.
+	for(int i = range.RowBegin; i < range.RowEnd; ++i)
+	{
+		const int k = i*n + range.ColBegin;
+
+		std::fill_n(&mPrevHeights[k], count, 0.0f);
+		std::fill_n(&mCurrHeights[k], count, 0.0f);
+		std::fill_n(&mNormalX[k], count, 0.0f);
+		std::fill_n(&mNormalY[k], count, 1.0f);
+		std::fill_n(&mNormalZ[k], count, 0.0f);
+	}
+
+	MarkNormalsDirty(range.RowBegin, range.RowEnd, range.ColBegin, range.ColEnd);
+}
+
+void Waves::WakeAllTiles()
+{
+	mTileAwake.assign(mSleepTilesDown*mSleepTilesAcross, 1);
+}
+
+void Waves::WakeTiles(int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	if(mSleepThreshold <= 0.0f)
+		return;
+
+	// Only interior points belong to tiles.
+	rowBegin = std::max(rowBegin, 1);
+	rowEnd = std::min(rowEnd, mNumRows - 1);
+	colBegin = std::max(colBegin, 1);
+	colEnd = std::min(colEnd, mNumCols - 1);
+
+	if(rowEnd <= rowBegin || colEnd <= colBegin)
+		return;
+
+	for(int ty = (rowBegin - 1) / mSleepTileSize; ty <= (rowEnd - 2) / mSleepTileSize; ++ty)
+	{
+		for(int tx = (colBegin - 1) / mSleepTileSize; tx <= (colEnd - 2) / mSleepTileSize; ++tx)
+			mTileAwake[ty*mSleepTilesAcross + tx] = 1;
 	}
 }
 
@@ -163,10 +926,259 @@ void Waves::Disturb(int i, int j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	AddHeight(i*mNumCols+j,     magnitude);
+	AddHeight(i*mNumCols+j+1,   halfMag);
+	AddHeight(i*mNumCols+j-1,   halfMag);
+	AddHeight((i+1)*mNumCols+j, halfMag);
+	AddHeight((i-1)*mNumCols+j, halfMag);
+
+	WakeTiles(i - 1, i + 2, j - 1, j + 2);
+	MarkNormalsDirty(i - 1, i + 2, j - 1, j + 2);
+}
+
+namespace
+{
+	// Grid rows/columns an impulse can touch, before clipping: centre +- floor(Radius).
+	int ImpulseReach(const WaveImpulse& impulse)
+	{
+		return impulse.Radius > 0.0f ? (int)impulse.Radius : 0;
+	}
+}
+
+void Waves::Disturb(const WaveImpulse* impulses, int count)
+{
+	if(count <= 0)
+		return;
+
+	const int m = mNumRows;
+	const int n = mNumCols;
+
+	// Bins are row bands (so band tasks never write the same rows) split further by
+	// the column tile of the impulse centre, which makes each band sweep its rows
+	// roughly left to right.  An impulse spanning several bands goes in each of them.
+	const int bandRows = std::max(mTileRows, 1);
+	const int bandCount = (m + bandRows - 1) / bandRows;
+	const int colTile = 16;
+	const int colTileCount = (n + colTile - 1) / colTile;
+	const int binCount = bandCount*colTileCount;
+
+	mImpulseEntryBin.clear();
+	mImpulseEntryIndex.clear();
+
+	for(int k = 0; k < count; ++k)
+	{
+		const WaveImpulse& impulse = impulses[k];
+		const int reach = ImpulseReach(impulse);
+
+		const int rowBegin = std::max(impulse.Row - reach, 1);
+		const int rowEnd = std::min(impulse.Row + reach + 1, m - 1);
+		const int colBegin = std::max(impulse.Col - reach, 1);
+		const int colEnd = std::min(impulse.Col + reach + 1, n - 1);
+		if(rowEnd <= rowBegin || colEnd <= colBegin)
+			continue;
+
+		const int tx = std::min(std::max(impulse.Col, 0), n - 1) / colTile;
+
+		for(int band = rowBegin / bandRows; band <= (rowEnd - 1) / bandRows; ++band)
+		{
+			mImpulseEntryBin.push_back(band*colTileCount + tx);
+			mImpulseEntryIndex.push_back(k);
+		}
+	}
+
+	// Counting sort of the entries by bin.
+	mImpulseBinStart.assign(binCount + 1, 0);
+	for(int bin : mImpulseEntryBin)
+		++mImpulseBinStart[bin + 1];
+	for(int b = 0; b < binCount; ++b)
+		mImpulseBinStart[b + 1] += mImpulseBinStart[b];
+
+	mImpulseBinCursor.assign(mImpulseBinStart.begin(), mImpulseBinStart.end() - 1);
+	mSortedImpulses.resize(mImpulseEntryIndex.size());
+	for(size_t e = 0; e < mImpulseEntryIndex.size(); ++e)
+		mSortedImpulses[mImpulseBinCursor[mImpulseEntryBin[e]]++] = mImpulseEntryIndex[e];
+
+	mScheduler->ParallelFor(0, bandCount, 1, [=](int firstBand, int lastBand)
+	{
+		for(int band = firstBand; band < lastBand; ++band)
+		{
+			const int rowBegin = band*bandRows;
+			const int rowEnd = std::min(rowBegin + bandRows, m);
+
+			const int first = mImpulseBinStart[band*colTileCount];
+			const int last = mImpulseBinStart[(band + 1)*colTileCount];
+			for(int e = first; e < last; ++e)
+				ApplyImpulse(impulses[mSortedImpulses[e]], rowBegin, rowEnd);
+		}
+	});
+
+	if(mSleepThreshold > 0.0f || mLazyNormals)
+	{
+		for(int k = 0; k < count; ++k)
+		{
+			const int reach = ImpulseReach(impulses[k]);
+			WakeTiles(impulses[k].Row - reach, impulses[k].Row + reach + 1,
+				impulses[k].Col - reach, impulses[k].Col + reach + 1);
+			MarkNormalsDirty(impulses[k].Row - reach, impulses[k].Row + reach + 1,
+				impulses[k].Col - reach, impulses[k].Col + reach + 1);
+		}
+	}
+}
+
+void Waves::ApplyImpulse(const WaveImpulse& impulse, int rowBegin, int rowEnd)
+{
+	const int n = mNumCols;
+	const int reach = ImpulseReach(impulse);
+
+	// Only the interior is disturbed; the boundary stays at zero.
+	rowBegin = std::max(std::max(rowBegin, impulse.Row - reach), 1);
+	rowEnd = std::min(std::min(rowEnd, impulse.Row + reach + 1), mNumRows - 1);
+	const int colBegin = std::max(impulse.Col - reach, 1);
+	const int colEnd = std::min(impulse.Col + reach + 1, n - 1);
+
+	if(reach == 0)
+	{
+		if(rowBegin < rowEnd && colBegin < colEnd)
+			AddHeight(impulse.Row*n + impulse.Col, impulse.Magnitude);
+		return;
+	}
+
+	const float invR2 = 1.0f / (impulse.Radius*impulse.Radius);
+
+	for(int i = rowBegin; i < rowEnd; ++i)
+	{
+		const float di = (float)(i - impulse.Row);
+
+		for(int j = colBegin; j < colEnd; ++j)
+		{
+			const float dj = (float)(j - impulse.Col);
+			const float t = (di*di + dj*dj)*invR2;
+			if(t > 1.0f)
+				continue;
+
+			float weight = 1.0f;
+			if(impulse.Falloff == WaveFalloff::Linear)
+				weight = 1.0f - std::sqrt(t);
+			else if(impulse.Falloff == WaveFalloff::Smooth)
+				weight = (1.0f - t)*(1.0f - t);
+
+			AddHeight(i*n + j, impulse.Magnitude*weight);
+		}
+	}
+}
+
+void Waves::SetLazyNormals(bool lazy)
+{
+	// Leaving lazy mode must not leave stale normals behind.
+	if(!lazy)
+		UpdateNormals();
+
+	mLazyNormals = lazy;
+}
+
+void Waves::UpdateNormals()
+{
+	mDirtyNormalTiles.clear();
+	for(int t = 0; t < (int)mNormalDirty.size(); ++t)
+	{
+		if(mNormalDirty[t])
+		{
+			mDirtyNormalTiles.push_back(t);
+			mNormalDirty[t] = 0;
+		}
+	}
+
+	mScheduler->ParallelFor(0, (int)mDirtyNormalTiles.size(), 1, [this](int first, int last)
+	{
+		for(int k = first; k < last; ++k)
+			ComputeNormalTile(NormalTileRange(mDirtyNormalTiles[k]));
+	});
+}
+
+void Waves::MarkNormalsDirty(int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	if(!mLazyNormals)
+		return;
+
+	// A normal reads the heights one point away, so the changed region grows by one,
+	// then is clipped to the interior where normals are computed.
+	rowBegin = std::max(rowBegin - 1, 1);
+	rowEnd = std::min(rowEnd + 1, mNumRows - 1);
+	colBegin = std::max(colBegin - 1, 1);
+	colEnd = std::min(colEnd + 1, mNumCols - 1);
+
+	if(rowEnd <= rowBegin || colEnd <= colBegin)
+		return;
+
+	for(int ty = (rowBegin - 1) / NormalTileSize; ty <= (rowEnd - 2) / NormalTileSize; ++ty)
+	{
+		for(int tx = (colBegin - 1) / NormalTileSize; tx <= (colEnd - 2) / NormalTileSize; ++tx)
+			mNormalDirty[ty*mNormalTilesAcross + tx] = 1;
+	}
+}
+
+void Waves::MarkAllNormalsDirty()
+{
+	if(mLazyNormals)
+		std::fill(mNormalDirty.begin(), mNormalDirty.end(), (std::uint8_t)1);
+}
+
+TileRange2D Waves::NormalTileRange(int tile)const
+{
+	const int ty = tile / mNormalTilesAcross;
+	const int tx = tile - ty*mNormalTilesAcross;
+
+	TileRange2D range;
+	range.RowBegin = 1 + ty*NormalTileSize;
+	range.RowEnd = std::min(range.RowBegin + NormalTileSize, mNumRows - 1);
+	range.ColBegin = 1 + tx*NormalTileSize;
+	range.ColEnd = std::min(range.ColBegin + NormalTileSize, mNumCols - 1);
+	return range;
+}
+
+void Waves::AddHeight(int k, float delta)
+{
+	// In FixedPoint mode each disturbance is quantized on its own, so the integer
+	// state only depends on the disturbances, not on how they were batched.
+	if(mSolverMode == WaveSolverMode::FixedPoint)
+	{
+		mCurrFixed[k] += ToFixed(delta);
+		mCurrHeights[k] = FromFixed(mCurrFixed[k]);
+	}
+	else
+	{
+		mCurrHeights[k] += delta;
+	}
+}
+
+std::uint64_t Waves::Checksum()const
+{
+	std::uint64_t hash = 14695981039346656037ull;
+
+	auto mix = [&hash](std::uint32_t word)
+	{
+		hash ^= word;
+		hash *= 1099511628211ull;
+	};
+
+	for(int k = 0; k < mVertexCount; ++k)
+	{
+		std::uint32_t prev;
+		std::uint32_t curr;
+		if(mSolverMode == WaveSolverMode::FixedPoint)
+		{
+			prev = (std::uint32_t)mPrevFixed[k];
+			curr = (std::uint32_t)mCurrFixed[k];
+		}
+		else
+		{
+			std::memcpy(&prev, &mPrevHeights[k], sizeof(prev));
+			std::memcpy(&curr, &mCurrHeights[k], sizeof(curr));
+		}
+
+		mix(prev);
+		mix(curr);
+	}
+
+	return hash;
 }
-	
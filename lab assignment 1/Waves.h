@@ -4,13 +4,237 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// The height field is stored structure-of-arrays: only the y-coordinate of each grid
+// point is kept in memory, and x/z are derived from the grid spacing on demand.  This
+// keeps the stencil loop streaming nothing but heights, so the SIMD kernels in
+// Waves.cpp touch one float per grid point instead of a whole XMFLOAT3.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
+#include <cstdint>
 #include <vector>
 #include <DirectXMath.h>
+#include "../Common/TaskScheduler.h"
+
+enum class WaveSolverMode
+{
+	// One full-grid sweep per time step, then one full-grid normal sweep.
+	TwoPass,
+
+	// Each row band (plus halo rows) is advanced several time steps in a per-thread
+	// scratch while it is in cache, and its normals are computed before it is
+	// written back.  Bands always span full rows.
+	Fused,
+
+	// TwoPass on Q16.16 fixed-point heights.  The stencil is pure integer math, so
+	// the solution is bit-identical on every machine, kernel, tiling and thread
+	// count (given the same disturbances).  Heights must stay well inside +-8192.
+	FixedPoint
+};
+
+// What Update() does when a frame owes more than the substep cap.
+enum class WaveOverloadPolicy
+{
+	// Throw the excess away; the simulation runs slower than real time under load.
+	DropExcess,
+
+	// Keep the excess (up to one more capped frame) and work it off on later frames.
+	CarryExcess
+};
+
+// Layout of a rendered water vertex.  Matches Vertex in FrameResource.h so results can
+// be written straight into the vertex upload buffer.
+struct WaveVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+// The parts of the grid vertices that never change.  x and u depend only on the
+// column, z and v only on the row, so they are kept once per column/row.
+struct WaveGridLayout
+{
+	int RowCount = 0;
+	int ColumnCount = 0;
+	float SpatialStep = 0.0f;
+
+	std::vector<float> X;
+	std::vector<float> U;
+	std::vector<float> Z;
+	std::vector<float> V;
+};
+
+// Builds the layout of an m x n grid with spacing dx, centred on the origin.
+WaveGridLayout BuildWaveGridLayout(int m, int n, float dx);
+
+///<summary>
+/// Writes grid rows [rowBegin, rowEnd) of a solution into dst, which is indexed by
+/// vertex (row r starts at dst + r*ColumnCount).  dst is only written, never read, and
+/// in address order, so it may point at write-combined upload heap memory.
+///</summary>
+void WriteWaveVertices(const WaveGridLayout& layout, const float* heights,
+	const float* normalX, const float* normalY, const float* normalZ,
+	int rowBegin, int rowEnd, WaveVertex* dst);
+
+// Compact per-frame water vertex (R32_FLOAT height + R16G16_SNORM normal, 8 bytes).  The
+// normal is octahedral-encoded; x/z and the texture coordinates never change, so they
+// live in a separate static stream of WaveStaticVertex instead.
+struct WaveCompactVertex
+{
+	float Height;
+	std::uint32_t Normal;
+};
+
+struct WaveStaticVertex
+{
+	DirectX::XMFLOAT2 PosXZ;
+	DirectX::XMFLOAT2 TexC;
+};
+
+// Packs a unit normal into two snorm16 octahedral coordinates (x in the low half).
+std::uint32_t EncodeWaveNormal(float x, float y, float z);
+
+// Inverse of EncodeWaveNormal; matches the decode in Default.hlsl.
+DirectX::XMFLOAT3 DecodeWaveNormal(std::uint32_t packed);
+
+// Writes vertices [begin, end) of a solution into dst[begin, end), in address order.
+void WriteWaveCompactVertices(const float* heights,
+	const float* normalX, const float* normalY, const float* normalZ,
+	int begin, int end, WaveCompactVertex* dst);
+
+// Writes the static stream for a grid (RowCount*ColumnCount vertices).
+void WriteWaveStaticVertices(const WaveGridLayout& layout, WaveStaticVertex* dst);
+
+// The four grid points around a sample position and their bilinear weights.  The
+// points are Index, Index+1 (next column), Index+ColumnCount (next row) and
+// Index+ColumnCount+1.
+struct WaveBilinearTap
+{
+	int Index = 0;
+	float W00 = 0.0f;
+	float W01 = 0.0f;
+	float W10 = 0.0f;
+	float W11 = 0.0f;
+};
+
+// Finds the tap for local (x, z).  Returns false if the point is outside the grid
+// (or not a number), where the water is taken to be flat at height 0.
+bool ComputeWaveBilinearTap(const WaveGridLayout& layout, float x, float z, WaveBilinearTap& tap);
+
+///<summary>
+/// Bilinearly interpolated height and (renormalized) normal of a solution at local
+/// (x, z), the space Position() reports in.  Outside the grid the height is 0 and
+/// the normal points straight up.  The batched form samples count xz pairs into
+/// heights[0..count).
+///</summary>
+float SampleWaveHeight(const WaveGridLayout& layout, const float* heights, float x, float z);
+DirectX::XMFLOAT3 SampleWaveNormal(const WaveGridLayout& layout,
+	const float* normalX, const float* normalY, const float* normalZ, float x, float z);
+void SampleWaveHeights(const WaveGridLayout& layout, const float* heights,
+	const DirectX::XMFLOAT2* xz, int count, float* out);
+
+// Shape of a WaveImpulse's footprint, as a function of distance d from its centre.
+enum class WaveFalloff
+{
+	// Full magnitude wherever d <= Radius.
+	Constant,
+
+	// 1 - d/Radius (a cone).
+	Linear,
+
+	// (1 - d^2/Radius^2)^2, which has no crease at the rim.
+	Smooth
+};
+
+// One disturbance for the batched Waves::Disturb().
+struct WaveImpulse
+{
+	// Grid point at the centre of the footprint.
+	int Row = 0;
+	int Col = 0;
+
+	// Height added at the centre.
+	float Magnitude = 0.0f;
+
+	// Footprint radius in grid cells; <= 0 touches the centre point only.
+	float Radius = 0.0f;
+	WaveFalloff Falloff = WaveFalloff::Smooth;
+};
+
+// Tile activity counters reported by Waves::ActivityStats().
+struct WaveActivityStats
+{
+	// Sleep tiles covering the grid interior (0 while sleeping is disabled).
+	int TileCount = 0;
+
+	// Tiles awake after the last Step(), and that as a fraction of TileCount.
+	int ActiveTileCount = 0;
+	float ActiveTileRatio = 1.0f;
+
+	// Tile updates performed and skipped over all time steps of the last Step().
+	int TileStepsSolved = 0;
+	int TileStepsSkipped = 0;
+};
+
+// An immutable copy of a Waves solution.  Nothing writes to it after capture, so
+// any number of threads may read and sample it at once.
+struct WaveSnapshot
+{
+	// Static grid data shared with the source Waves.
+	const WaveGridLayout* Layout = nullptr;
+
+	// Number of updates the simulation had finished when this snapshot was taken
+	// (maintained by whoever takes the snapshots).
+	std::uint64_t Frame = 0;
+
+	std::vector<float> Heights;
+	std::vector<float> NormalX;
+	std::vector<float> NormalY;
+	std::vector<float> NormalZ;
+
+	int VertexCount()const { return Layout->RowCount*Layout->ColumnCount; }
+
+	DirectX::XMFLOAT3 Position(int i)const
+	{
+		int row = i / Layout->ColumnCount;
+		int col = i - row*Layout->ColumnCount;
+		return DirectX::XMFLOAT3(Layout->X[col], Heights[i], Layout->Z[row]);
+	}
+
+	DirectX::XMFLOAT3 Normal(int i)const { return DirectX::XMFLOAT3(NormalX[i], NormalY[i], NormalZ[i]); }
+
+	float SampleHeight(float x, float z)const
+	{
+		return SampleWaveHeight(*Layout, Heights.data(), x, z);
+	}
+
+	DirectX::XMFLOAT3 SampleNormal(float x, float z)const
+	{
+		return SampleWaveNormal(*Layout, NormalX.data(), NormalY.data(), NormalZ.data(), x, z);
+	}
+
+	void SampleHeights(const DirectX::XMFLOAT2* xz, int count, float* out)const
+	{
+		SampleWaveHeights(*Layout, Heights.data(), xz, count, out);
+	}
+
+	// Writes the snapshot into dst (VertexCount() vertices) in one pass.
+	void WriteVertices(WaveVertex* dst)const
+	{
+		WriteWaveVertices(*Layout, Heights.data(), NormalX.data(), NormalY.data(), NormalZ.data(),
+			0, Layout->RowCount, dst);
+	}
+
+	void WriteCompactVertices(WaveCompactVertex* dst)const
+	{
+		WriteWaveCompactVertices(Heights.data(), NormalX.data(), NormalY.data(), NormalZ.data(),
+			0, VertexCount(), dst);
+	}
+};
 
 class Waves
 {
@@ -26,19 +250,173 @@ public:
 	int TriangleCount()const;
 	float Width()const;
 	float Depth()const;
+	float SpatialStep()const { return mSpatialStep; }
+
+	// Returns the solution at the ith grid point.  Only the height is stored;
+	// x and z are reconstructed from the grid spacing.
+    DirectX::XMFLOAT3 Position(int i)const
+    {
+        int row = i / mNumCols;
+        int col = i - row*mNumCols;
+        return DirectX::XMFLOAT3(mLayout.X[col], mCurrHeights[i], mLayout.Z[row]);
+    }
+
+	// Returns the solution height at the ith grid point.
+    float Height(int i)const { return mCurrHeights[i]; }
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the whole current height field (RowCount()*ColumnCount() floats, row major).
+    const float* Heights()const { return mCurrHeights.data(); }
 
-	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	// Returns the solution normal at the ith grid point.  With lazy normals this is
+	// the normal as of the last UpdateNormals().
+    DirectX::XMFLOAT3 Normal(int i)const { return DirectX::XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]); }
+
+	// Returns the normal components of the whole grid, one array per component.
+    const float* NormalsX()const { return mNormalX.data(); }
+    const float* NormalsY()const { return mNormalY.data(); }
+    const float* NormalsZ()const { return mNormalZ.data(); }
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	// The tangent lies in the xy-plane and is perpendicular to the normal, so it is
+	// derived from the normal rather than stored.
+    DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Static per-row/per-column vertex data, built once at construction.
+	const WaveGridLayout& GridLayout()const { return mLayout; }
+
+	// Bilinear samples of the current solution at local (x, z); see SampleWaveHeight().
+	// These read the live grid, so they must not overlap Step() or Disturb().  Other
+	// threads should sample a WaveSnapshot instead.
+	float SampleHeight(float x, float z)const { return SampleWaveHeight(mLayout, mCurrHeights.data(), x, z); }
+	DirectX::XMFLOAT3 SampleNormal(float x, float z)const
+	{
+		return SampleWaveNormal(mLayout, mNormalX.data(), mNormalY.data(), mNormalZ.data(), x, z);
+	}
+	void SampleHeights(const DirectX::XMFLOAT2* xz, int count, float* out)const
+	{
+		SampleWaveHeights(mLayout, mCurrHeights.data(), xz, count, out);
+	}
+
+	// Copies the current solution (normals as of the last UpdateNormals() when they
+	// are lazy) into snapshot, reusing its storage.  Frame is left alone.
+	void Capture(WaveSnapshot& snapshot)const;
+
+	// Writes the current solution into dst (VertexCount() vertices) in one pass.
+	void WriteVertices(WaveVertex* dst)const;
+	void WriteCompactVertices(WaveCompactVertex* dst)const;
+
+	// Name of the stencil kernel selected at compile time ("avx2", "sse2" or "scalar").
+	static const char* KernelName();
+
+	// Runs the solver and normal passes on the given scheduler (nullptr = serial, the
+	// default).  The scheduler must outlive this object or be reset first.
+	void SetScheduler(TaskScheduler* scheduler);
 
+	// Size of the tiles the grid is split into for the parallel passes; a column count
+	// <= 0 makes each tile span the full row.  Defaults to 16 rows x full width.
+	void SetTileSize(int tileRows, int tileCols);
+
+	// Selects how Step() advances the grid.  temporalBlockSize caps how many time
+	// steps the fused solver takes per sweep.  TwoPass and Fused give identical
+	// results; the default is TwoPass.  Switching to FixedPoint quantizes the
+	// current solution, so lockstep peers should switch before the first step.
+	void SetSolverMode(WaveSolverMode mode, int temporalBlockSize = 4);
+	WaveSolverMode SolverMode()const { return mSolverMode; }
+
+	// Enables sleeping tiles: the interior is split into tileSize x tileSize tiles, and
+	// a tile whose heights and per-step height changes all stay below threshold is
+	// zeroed and skipped by the solver and normal passes until Disturb() or an active
+	// neighbour wakes it.  threshold <= 0 disables sleeping (the default).  Only the
+	// TwoPass solver skips tiles; Fused and FixedPoint always advance the whole grid.
+	void SetSleepThreshold(float threshold, int tileSize = 16);
+	WaveActivityStats ActivityStats()const { return mActivityStats; }
+
+	// Limits how many time steps one Update() may take and what happens to the
+	// time beyond that.  Defaults to 8 substeps, DropExcess.
+	void SetMaxSubsteps(int maxSubsteps, WaveOverloadPolicy policy);
+
+	// Accumulates dt and advances as many whole time steps as it covers (capped),
+	// keeping the remainder for the next call.  All substeps go through a single
+	// Step() call so they share one normal pass.
 	void Update(float dt);
+
+	// Number of time steps the last Update() took.
+	int LastSubstepCount()const { return mLastSubstepCount; }
+
+	// Advances the simulation exactly stepCount time steps and refreshes the normals
+	// (unless they are lazy).
+	void Step(int stepCount);
+
+	///<summary>
+	/// With lazy normals, Step() and Disturb() only mark the tiles whose normals
+	/// they invalidate, and nothing is recomputed until UpdateNormals().  Frames that
+	/// only read heights (buoyancy queries and the like) then skip the normal pass
+	/// entirely, and a sleeping-tile grid only refreshes what actually moved.  Off
+	/// by default, in which case UpdateNormals() has nothing to do.
+	///</summary>
+	void SetLazyNormals(bool lazy);
+	bool LazyNormals()const { return mLazyNormals; }
+
+	// Recomputes the normals of every dirty tile.  Call before reading normals,
+	// TangentX() or vertices when lazy normals are on.
+	void UpdateNormals();
+
 	void Disturb(int i, int j, float magnitude);
 
+	// Applies a whole batch of impulses.  Footprints are clipped to the interior, so
+	// impulses near (or past) the boundary are fine.  The batch is binned into row
+	// bands and each band is applied in one pass on the scheduler, so this is meant
+	// for thousands of impulses per frame.
+	void Disturb(const WaveImpulse* impulses, int count);
+
+	///<summary>
+	/// 64-bit FNV-1a hash (one 32-bit word at a time) of the previous and current
+	/// solutions, which together are the whole simulation state.  In FixedPoint mode
+	/// it hashes the integer heights, so peers running the same inputs get the same
+	/// value on any machine; otherwise it hashes the float bit patterns.
+	///</summary>
+	std::uint64_t Checksum()const;
+
+private:
+    // Advances an interior tile one time step, writing the result over the
+    // previous solution.
+    void SolveTile(const TileRange2D& tile);
+
+    // Recomputes the normals of an interior tile from the current solution.
+    void ComputeNormalTile(const TileRange2D& tile);
+
+    // Advances every row band stepCount steps into the mNext* buffers, then swaps.
+    void FusedSweep(int stepCount, bool computeNormals);
+    void FusedBand(int rowBegin, int rowEnd, int stepCount, bool computeNormals);
+
+    // FixedPoint counterparts of Step() and SolveTile().
+    void StepFixed(int stepCount);
+    void SolveTileFixed(const TileRange2D& tile);
+
+    // Adds delta to the current height at grid index k, in whichever representation
+    // the solver mode keeps.
+    void AddHeight(int k, float delta);
+
+    // TwoPass Step() that only visits awake sleep tiles.
+    void StepSparse(int stepCount);
+    TileRange2D SleepTileRange(int tile)const;
+    void SolveSleepTile(int tile);
+    void UpdateSleepStates();
+    void PutTileToSleep(int tile);
+    void WakeAllTiles();
+
+    // Adds the rows [rowBegin, rowEnd) part of an impulse's footprint.
+    void ApplyImpulse(const WaveImpulse& impulse, int rowBegin, int rowEnd);
+
+    // Wakes every sleep tile overlapping grid rows [rowBegin, rowEnd) x columns [colBegin, colEnd).
+    void WakeTiles(int rowBegin, int rowEnd, int colBegin, int colEnd);
+
+    // Marks the normals that depend on heights in rows [rowBegin, rowEnd) x columns
+    // [colBegin, colEnd) as dirty; a no-op unless lazy normals are on.
+    void MarkNormalsDirty(int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void MarkAllNormalsDirty();
+    TileRange2D NormalTileRange(int tile)const;
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +432,78 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Simulation time not yet consumed by a whole time step.
+    float mTimeAccumulator = 0.0f;
+    int mMaxSubsteps = 8;
+    WaveOverloadPolicy mOverloadPolicy = WaveOverloadPolicy::DropExcess;
+    int mLastSubstepCount = 0;
+
+    WaveGridLayout mLayout;
+
+    std::vector<float> mPrevHeights;
+    std::vector<float> mCurrHeights;
+    std::vector<float> mNormalX;
+    std::vector<float> mNormalY;
+    std::vector<float> mNormalZ;
+
+    // FixedPoint state: Q16.16 heights and stencil constants.  While this mode is
+    // active these are authoritative and mCurrHeights is a converted copy.
+    std::vector<std::int32_t> mPrevFixed;
+    std::vector<std::int32_t> mCurrFixed;
+    std::int32_t mK1Fixed = 0;
+    std::int32_t mK2Fixed = 0;
+    std::int32_t mK3Fixed = 0;
+
+    // Output buffers of the fused solver.  Bands read their halo rows from the
+    // current buffers, so results cannot be written back in place.
+    std::vector<float> mNextPrevHeights;
+    std::vector<float> mNextCurrHeights;
+
+    WaveSolverMode mSolverMode = WaveSolverMode::TwoPass;
+    int mTemporalBlockSize = 4;
+
+    // Largest |height| and |height change| seen by a sleep tile in its last update,
+    // over the whole tile and along each of its four edges.
+    struct TileActivity
+    {
+        float Max = 0.0f;
+        float Top = 0.0f;
+        float Bottom = 0.0f;
+        float Left = 0.0f;
+        float Right = 0.0f;
+    };
+
+    // Sleep tiles, numbered row-major over the interior.
+    float mSleepThreshold = 0.0f;
+    int mSleepTileSize = 16;
+    int mSleepTilesDown = 0;
+    int mSleepTilesAcross = 0;
+    std::vector<std::uint8_t> mTileAwake;
+    std::vector<std::uint8_t> mTileStaysAwake;
+    std::vector<TileActivity> mTileActivity;
+    std::vector<int> mActiveTiles;
+    WaveActivityStats mActivityStats;
+
+    // Scratch for the batched Disturb(): (bin, impulse) entries counting-sorted
+    // by bin, where a bin is a row band times the column tile of the impulse centre.
+    std::vector<int> mImpulseBinStart;
+    std::vector<int> mImpulseBinCursor;
+    std::vector<int> mImpulseEntryBin;
+    std::vector<int> mImpulseEntryIndex;
+    std::vector<int> mSortedImpulses;
+
+    // Lazy normals: interior split into NormalTileSize^2 tiles, row-major.
+    static const int NormalTileSize = 16;
+    bool mLazyNormals = false;
+    int mNormalTilesDown = 0;
+    int mNormalTilesAcross = 0;
+    std::vector<std::uint8_t> mNormalDirty;
+    std::vector<int> mDirtyNormalTiles;
+
+    SerialTaskScheduler mSerialScheduler;
+    TaskScheduler* mScheduler = &mSerialScheduler;
+    int mTileRows = 16;
+    int mTileCols = 0;
 };
 
-#endif // WAVES_H
\ No newline at end of file
+#endif // WAVES_H